@@ -1,4 +1,5 @@
 #include "1802.h"
+#include "Trace.h"
 #include "mbed.h"
 
 // modified from https://os.mbed.com/users/Yar/code/CSE321_LCD_for_Nucleo/
@@ -8,27 +9,50 @@
 // constructor
 CSE321_LCD::CSE321_LCD(unsigned char lcd_cols, unsigned char lcd_rows,
                        unsigned char charsize, PinName sda, PinName scl)
-    : i2c(sda, scl) {
+    : _progress(0, 1), i2c(sda, scl) {
   _addr = LCD_ADDRESS_1802;
   _cols = lcd_cols;
   _rows = lcd_rows;
   _charsize = charsize;
   _backlightval = LCD_BACKLIGHT;
+  _cursor_col = 0;
+  _cursor_row = 0;
+  memset(_frame, ' ', sizeof(_frame));
+  memset(_shown, ' ', sizeof(_shown));
+  resetStats();
+  _head = 0;
+  _tail = 0;
+  _active = false;
+  _queued = 0;
+  _completed = 0;
+  _ready_at[0] = 0;
+  _ready_at[1] = 0;
+  _bus_queue = nullptr;
+  _clock.start();
+  memset(_rgb, 0, sizeof(_rgb));
+  _fade_step = 0;
+  _fade_steps = 0;
+  _fade_queue = nullptr;
+  _fade_event = 0;
 }
 
-void CSE321_LCD::begin() {
+CSE321_LCD::Token CSE321_LCD::begin(EventQueue *queue) {
+  _bus_queue = queue;
 
   // Initialize displayfunction parameter for setting up LCD display
   _displayfunction |= LCD_2LINE;
   _displayfunction |= LCD_5x8DOTS;
 
-  // Wait for more than 30 ms after power rises above 4.5V per the data sheet
-  thread_sleep_for(50);
+  // Wait for more than 30 ms after power rises above 4.5V per the data sheet;
+  // the backlight controller is on the same supply
+  core_util_critical_section_enter();
+  _ready_at[0] = _clock.elapsed_time().count() + LCD_POWERUP_US;
+  _ready_at[1] = _ready_at[0];
+  core_util_critical_section_exit();
 
   // Send first function set command. Wait longer that 39 us per the data
   // sheet
   sendCommand(LCD_FUNCTIONSET | _displayfunction);
-  thread_sleep_for(45);
 
   // turn the display on
   displayON();
@@ -36,45 +60,141 @@ void CSE321_LCD::begin() {
   // clear the display
   clear();
 
-  // Initialize backlight
-  setReg(0, 0);
-  setReg(1, 0);
-  setReg(0x08, 0xAA);
-
-  //   }
+  // Initialize backlight in one burst: MODE1 and MODE2 normal, the colour
+  // registers, group PWM and frequency at their reset values, and LEDOUT with
+  // every LED under its own PWM register
+  char data[10] = {MODE1_REG | RGB_AUTO_INCREMENT,
+                   0x00,
+                   0x00,
+                   (char)_rgb[2],
+                   (char)_rgb[1],
+                   (char)_rgb[0],
+                   0x00,
+                   (char)0xFF,
+                   0x00,
+                   (char)0xAA};
+  return transmit(RGB_ADDRESS, data, sizeof(data), 0);
 }
 
-void CSE321_LCD::clear() {
-  sendCommand(LCD_CLEARDISPLAY);
-  wait_us(2000);
+CSE321_LCD::Token CSE321_LCD::clear() {
+  Token token = sendCommand(LCD_CLEARDISPLAY);
+
+  // the display is blank with the cursor at home
+  memset(_shown, ' ', sizeof(_shown));
+  _cursor_col = 0;
+  _cursor_row = 0;
+  return token;
 }
 
-void CSE321_LCD::sendCommand(char value) {
+CSE321_LCD::Token CSE321_LCD::sendCommand(char value) {
   char data[2] = {0x80, value};
-  i2c.write(_addr, data, 2);
+
+  // clear and home take 1.53 ms, function set is given the begin() margin
+  int settle_us = LCD_COMMAND_US;
+  if (value == LCD_CLEARDISPLAY || value == LCD_RETURNHOME) {
+    settle_us = LCD_CLEAR_US;
+  } else if ((value & 0xE0) == LCD_FUNCTIONSET) {
+    settle_us = LCD_FUNCTIONSET_US;
+  }
+  return transmit(_addr, data, 2, settle_us);
 }
 
 // set color thing for seeed
-void CSE321_LCD::setRGB(char r, char g, char b) {
+CSE321_LCD::Token CSE321_LCD::setRGB(char r, char g, char b) {
+  stopFade();
+  return writeRGB(r, g, b);
+}
+
+void CSE321_LCD::fadeTo(char r, char g, char b,
+                        std::chrono::milliseconds duration,
+                        EventQueue *queue) {
+  unsigned char to[3] = {(unsigned char)r, (unsigned char)g, (unsigned char)b};
+  // already fading there, or already showing it: nothing to write
+  if (_fade_steps != 0 ? memcmp(to, _fade_to, sizeof(to)) == 0
+                       : memcmp(to, _rgb, sizeof(to)) == 0) {
+    return;
+  }
+
+  int steps = duration.count() / LCD_FADE_STEP_MS;
+  if (steps <= 0) {
+    setRGB(r, g, b);
+    return;
+  }
+
+  stopFade();
+  memcpy(_fade_from, _rgb, sizeof(_rgb));
+  memcpy(_fade_to, to, sizeof(to));
+  _fade_step = 0;
+  _fade_steps = steps;
+  _fade_queue = queue;
+  _fade_event = queue->call_every(std::chrono::milliseconds(LCD_FADE_STEP_MS),
+                                  callback(this, &CSE321_LCD::fadeStep));
+
+  // no room on the queue: show the colour at once instead
+  if (_fade_event == 0) {
+    setRGB(r, g, b);
+  }
+}
+
+void CSE321_LCD::stopFade() {
+  if (_fade_event != 0) {
+    _fade_queue->cancel(_fade_event);
+    _fade_event = 0;
+  }
+  _fade_steps = 0;
+}
+
+void CSE321_LCD::fadeStep() {
+  TRACE_SCOPE(TRACE_LCD_FADE);
+  int step = _fade_step + 1;
+  unsigned char rgb[3];
+  for (int i = 0; i < 3; i++) {
+    int from = _fade_from[i];
+    rgb[i] = from + (_fade_to[i] - from) * step / _fade_steps;
+  }
 
-  this->setReg(RED_REG, r);
-  this->setReg(GREEN_REG, g);
-  this->setReg(BLUE_REG, b);
+  writeRGB(rgb[0], rgb[1], rgb[2]);
+  _fade_step = step;
+  if (step == _fade_steps) {
+    stopFade();
+  }
 }
 
-void CSE321_LCD::displayON() {
+CSE321_LCD::Token CSE321_LCD::writeRGB(unsigned char r, unsigned char g,
+                                       unsigned char b) {
+  if (_rgb[0] == r && _rgb[1] == g && _rgb[2] == b) {
+    return lastToken();
+  }
+
+  // blue, green and red are consecutive registers
+  char data[4] = {BLUE_REG | RGB_AUTO_INCREMENT, (char)b, (char)g, (char)r};
+  Token token = transmit(RGB_ADDRESS, data, sizeof(data), 0);
+  if (token != 0) {
+    _rgb[0] = r;
+    _rgb[1] = g;
+    _rgb[2] = b;
+  }
+  return token;
+}
+
+CSE321_LCD::Token CSE321_LCD::displayON() {
   _displaycontrol |= LCD_DISPLAYON;
-  this->sendCommand(LCD_DISPLAYCONTROL | _displaycontrol);
+  return this->sendCommand(LCD_DISPLAYCONTROL | _displaycontrol);
 }
 
-void CSE321_LCD::setReg(char addr, char val) {
+CSE321_LCD::Token CSE321_LCD::setReg(char addr, char val) {
   char data[2];
   data[0] = addr;
   data[1] = val;
-  i2c.write(RGB_ADDRESS, data, 2);
+
+  // keep the cached colour right for writeRGB()
+  if (addr >= BLUE_REG && addr <= RED_REG) {
+    _rgb[RED_REG - addr] = val;
+  }
+  return transmit(RGB_ADDRESS, data, 2, 0);
 }
 
-void CSE321_LCD::setCursor(unsigned char col, unsigned char row) {
+CSE321_LCD::Token CSE321_LCD::setCursor(unsigned char col, unsigned char row) {
   // change the cordinate of where the next charecter will be put
   if (row == 0) {
     col = col | 0x80;
@@ -82,19 +202,181 @@ void CSE321_LCD::setCursor(unsigned char col, unsigned char row) {
     col = col | 0xc0;
   }
 
+  _cursor_col = col & 0x3f;
+  _cursor_row = row;
+
   char data[2];
   data[0] = 0x80;
   data[1] = col;
-  i2c.write(_addr, data, 2);
+  return transmit(_addr, data, 2, LCD_COMMAND_US);
 }
 
 int CSE321_LCD::print(const char *text) { // output a string to the LCD
-  char data[2];
+  TRACE_SCOPE(TRACE_LCD_PRINT);
+  return write(text, strlen(text));
+}
+
+int CSE321_LCD::write(const char *text, size_t length) {
+  // control byte 0x40 (Co = 0, RS = 1): every byte that follows is data
+  char data[LCD_BURST_SIZE];
   data[0] = 0x40;
-  while (*text) {
-    data[1] = *text;
-    i2c.write(_addr, data, 2);
-    text++;
+  size_t done = 0;
+  while (done < length) {
+    size_t chunk = length - done;
+    if (chunk > LCD_BURST_SIZE - 1) {
+      chunk = LCD_BURST_SIZE - 1;
+    }
+    memcpy(data + 1, text + done, chunk);
+    transmit(_addr, data, chunk + 1, LCD_DATA_US);
+
+    // keep the shadow in step with the display
+    for (size_t i = 0; i < chunk; i++) {
+      if (_cursor_row < LCD_FRAME_ROWS && _cursor_col < LCD_FRAME_COLS) {
+        _shown[_cursor_row][_cursor_col] = text[done + i];
+      }
+      _cursor_col++;
+    }
+    done += chunk;
+  }
+  return length;
+}
+
+void CSE321_LCD::setLine(unsigned char row, const char *text) {
+  if (row >= LCD_FRAME_ROWS) {
+    return;
+  }
+  int cols = _cols < LCD_FRAME_COLS ? _cols : LCD_FRAME_COLS;
+  for (int col = 0; col < cols; col++) {
+    _frame[row][col] = *text ? *text++ : ' ';
+  }
+}
+
+CSE321_LCD::Token CSE321_LCD::update() {
+  TRACE_SCOPE(TRACE_LCD_UPDATE);
+  int rows = _rows < LCD_FRAME_ROWS ? _rows : LCD_FRAME_ROWS;
+  int cols = _cols < LCD_FRAME_COLS ? _cols : LCD_FRAME_COLS;
+  Token sent = 0;
+  for (int row = 0; row < rows; row++) {
+    int col = 0;
+    while (col < cols) {
+      // skip what the display already shows
+      if (_frame[row][col] == _shown[row][col]) {
+        col++;
+        continue;
+      }
+
+      // send the run of changed characters from one cursor position
+      int start = col;
+      while (col < cols && _frame[row][col] != _shown[row][col]) {
+        col++;
+      }
+
+      if (_cursor_row != row || _cursor_col != start) {
+        setCursor(start, row);
+      }
+      write(&_frame[row][start], col - start);
+      sent = lastToken();
+    }
+  }
+  return sent;
+}
+
+bool CSE321_LCD::isDone(Token token) const {
+  return (int32_t)(_completed - token) >= 0;
+}
+
+void CSE321_LCD::wait(Token token) {
+  while (!isDone(token)) {
+    _progress.try_acquire_for(10ms);
+  }
+}
+
+void CSE321_LCD::resetStats() {
+  _transactions = 0;
+  _bytes = 0;
+  _errors = 0;
+}
+
+CSE321_LCD::Token CSE321_LCD::transmit(int addr, const char *data, int length,
+                                       int settle_us) {
+  // wait for a free slot if the bus has fallen behind; a caller in an
+  // interrupt cannot wait
+  core_util_critical_section_enter();
+  while (_tail - _head == LCD_QUEUE_DEPTH) {
+    core_util_critical_section_exit();
+    if (core_util_is_isr_active()) {
+      return 0;
+    }
+    _progress.try_acquire_for(10ms);
+    core_util_critical_section_enter();
+  }
+
+  Transaction &t = _queue[_tail % LCD_QUEUE_DEPTH];
+  t.addr = addr;
+  t.length = length;
+  t.settle_us = settle_us;
+  memcpy(t.data, data, length);
+  _transactions++;
+  _bytes += length;
+  _tail++;
+  Token token = ++_queued;
+  bool start = !_active;
+  _active = true;
+  core_util_critical_section_exit();
+
+  if (start) {
+    scheduleNext();
+  }
+  return token;
+}
+
+void CSE321_LCD::scheduleNext() {
+  // a full queue is tried again shortly rather than stalling the bus
+  if (_bus_queue->call(this, &CSE321_LCD::startNext) == 0) {
+    _settle.attach(callback(this, &CSE321_LCD::scheduleNext), 1ms);
+  }
+}
+
+void CSE321_LCD::startNext() {
+  // transmit() only restarts the bus once it has seen it go idle
+  core_util_critical_section_enter();
+  bool idle = _head == _tail;
+  if (idle) {
+    _active = false;
+  }
+  core_util_critical_section_exit();
+  if (idle) {
+    return;
+  }
+
+  // let the target finish its previous command first
+  Transaction &t = _queue[_head % LCD_QUEUE_DEPTH];
+  uint64_t now = _clock.elapsed_time().count();
+  uint64_t ready_at = _ready_at[target(t.addr)];
+  if (now < ready_at) {
+    _settle.attach(callback(this, &CSE321_LCD::scheduleNext),
+                   std::chrono::microseconds(ready_at - now));
+    return;
+  }
+
+  if (i2c.transfer(t.addr, t.data, t.length, NULL, 0,
+                   callback(this, &CSE321_LCD::transferDone),
+                   I2C_EVENT_ALL) != 0) {
+    // bus still busy, try again shortly
+    _settle.attach(callback(this, &CSE321_LCD::scheduleNext), 100us);
+  }
+}
+
+void CSE321_LCD::transferDone(int event) {
+  TRACE_SCOPE(TRACE_LCD_I2C_DONE);
+  Transaction &t = _queue[_head % LCD_QUEUE_DEPTH];
+  if (event & (I2C_EVENT_ERROR | I2C_EVENT_ERROR_NO_SLAVE |
+               I2C_EVENT_TRANSFER_EARLY_NACK)) {
+    _errors++;
   }
-  return 0;
+  _ready_at[target(t.addr)] = _clock.elapsed_time().count() + t.settle_us;
+  _head++;
+  _completed++;
+  _progress.release();
+  scheduleNext();
 }
\ No newline at end of file
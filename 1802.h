@@ -58,19 +58,57 @@
 #define GREEN_REG 0x03
 #define BLUE_REG 0x02
 
+// backlight controller registers and control byte flags
+#define MODE1_REG 0x00
+#define LEDOUT_REG 0x08
+#define RGB_AUTO_INCREMENT 0x80
+
+// backlight fade step
+#define LCD_FADE_STEP_MS 20
+
 // model flag
 #define LCD1602 0x00
 #define LCD1802 0x02
 
+// largest I2C transaction sent by write(), control byte included
+#define LCD_BURST_SIZE 33
+
+// transactions that can wait for the bus
+#define LCD_QUEUE_DEPTH 16
+
+// time the controller needs after a command or data write, in microseconds
+#define LCD_POWERUP_US 50000
+#define LCD_FUNCTIONSET_US 45000
+#define LCD_CLEAR_US 2000
+#define LCD_COMMAND_US 39
+#define LCD_DATA_US 43
+
+// frame buffer size
+#define LCD_FRAME_COLS 16
+#define LCD_FRAME_ROWS 2
+
 /**
  * This is the driver for the Liquid Crystal LCD displays that use the I2C bus.
  *
  * After creating an instance of this class, first call begin() before anything
  * else. The backlight is on by default, since that is the most likely operating
  * mode in most cases.
+ *
+ * Nothing blocks on the bus: every command, text write and backlight register
+ * is queued and sent with I2C::transfer() from the thread of the EventQueue
+ * given to begin(), since I2C::transfer() takes the bus mutex and cannot be
+ * called from an interrupt. The completion interrupt and the settle Timeout
+ * only post the next transaction to that queue. The delays each controller
+ * needs after a command are kept as deadlines before its next transaction.
+ * Each queued transaction has a Token; wait() blocks until it is on the
+ * display. The driver is meant to be used from one thread at a time, other
+ * than the thread of the bus queue.
  */
 class CSE321_LCD {
 public:
+  /// Completion token of a queued transaction, 0 if nothing was queued.
+  typedef uint32_t Token;
+
   /**
    * Constructor
    *
@@ -87,20 +125,61 @@ public:
 
   /**
    * Set the LCD display in the correct begin state, must be called before
-   * anything else is done.
+   * anything else is done. The power-up delays are queued, not slept.
+   *
+   * @param queue Queue whose thread starts every I2C transaction.
+   * @returns Token of the last initialization transaction.
    */
-  void begin();
+  Token begin(EventQueue *queue = mbed_event_queue());
 
   /**
    * Remove all the characters currently shown. Next print/write operation will
    * start from the first position on LCD display.
    */
-  void clear();
+  Token clear();
 
-  void displayON();
-  void setCursor(unsigned char, unsigned char);
+  Token displayON();
+  Token setCursor(unsigned char, unsigned char);
   int print(const char *text);
 
+  /**
+   * Write characters at the cursor position as one I2C transaction: a single
+   * continuous-data control byte followed by the characters.
+   *
+   * @param text    Characters to write.
+   * @param length  Number of characters.
+   * @returns Number of characters written.
+   */
+  int write(const char *text, size_t length);
+
+  /**
+   * Write a row of the frame buffer. The text is cut or padded with spaces to
+   * the width of the display. Nothing is sent until update().
+   *
+   * @param row   Row to write (0 or 1).
+   * @param text  Text of the row.
+   */
+  void setLine(unsigned char row, const char *text);
+
+  /**
+   * Row of the frame buffer, for text formatted in place such as with
+   * LcdText. It holds LCD_FRAME_COLS characters and no terminator. Nothing is
+   * sent until update().
+   *
+   * @param row   Row to write, below LCD_FRAME_ROWS.
+   * @returns The first character of the row.
+   */
+  char *line(unsigned char row) { return _frame[row]; }
+
+  /**
+   * Send the frame buffer to the display. Only the runs of characters that
+   * differ from what the display already shows are sent, each after a single
+   * setCursor().
+   *
+   * @returns Token of the last transaction sent, 0 if nothing changed.
+   */
+  Token update();
+
   /** Set RGB color of backlight
    *   @param r Value for the red component of the RGB backlight (Between 0 and
    * 255).
@@ -108,15 +187,93 @@ public:
    * and 255).
    *   @param b Value for the blue component of the RGB backlight (Between 0 and
    * 255).
+   *
+   * The three colour registers are written in one auto-increment burst, and
+   * not at all if the colour is already shown. Stops a fade in progress.
+   */
+  Token setRGB(char r, char g, char b);
+
+  /** Fade the backlight to a colour in the background
+   *   @param r Red component to end on.
+   *   @param g Green component to end on.
+   *   @param b Blue component to end on.
+   *   @param duration Length of the fade.
+   *   @param queue Queue the steps run on, normally that of the caller.
+   *
+   * The fade is stepped by a periodic event on @p queue every
+   * LCD_FADE_STEP_MS, one burst per step, so the steps are queued from a
+   * thread like any other write. Fading to the colour of the fade in
+   * progress leaves it running, and fading to the colour already shown
+   * with no fade running writes nothing.
    */
-  void setRGB(char r, char g, char b);
+  void fadeTo(char r, char g, char b, std::chrono::milliseconds duration,
+              EventQueue *queue);
+
+  /// True while a fade is in progress.
+  bool fading() const { return _fade_steps != 0; }
   // Send command to display
-  void sendCommand(char value);
+  Token sendCommand(char value);
 
   // Set register value
-  void setReg(char addr, char val);
+  Token setReg(char addr, char val);
+
+  /// Token of the most recently queued transaction.
+  Token lastToken() const { return _queued; }
+
+  /// True once the transaction of @p token, and all before it, are done.
+  bool isDone(Token token) const;
+
+  /// Block the calling thread until isDone(@p token).
+  void wait(Token token);
+
+  /// I2C transactions sent to the LCD and backlight since construction or
+  /// resetStats().
+  unsigned int transactions() const { return _transactions; }
+
+  /// I2C bytes sent since construction or resetStats(), addresses excluded.
+  unsigned int bytesSent() const { return _bytes; }
+
+  /// Transactions the bus did not acknowledge.
+  unsigned int errors() const { return _errors; }
+
+  /// Reset the transaction, byte and error counters.
+  void resetStats();
 
 private:
+  // One queued I2C write
+  struct Transaction {
+    int addr;
+    int length;
+    // time the target needs after the transaction, in microseconds
+    int settle_us;
+    char data[LCD_BURST_SIZE];
+  };
+
+  // Queue one I2C transaction, count it and start the bus if idle
+  Token transmit(int addr, const char *data, int length, int settle_us);
+
+  // Start the transaction at the head of the queue once its target is ready,
+  // on the thread of the bus queue
+  void startNext();
+
+  // Post startNext() to the bus queue; safe from interrupts
+  void scheduleNext();
+
+  // I2C::transfer() completion, interrupt context
+  void transferDone(int event);
+
+  // Index of the deadline of the target at addr in _ready_at
+  static int target(int addr) { return addr == RGB_ADDRESS ? 1 : 0; }
+
+  // Write the colour registers unless they already hold r, g, b
+  Token writeRGB(unsigned char r, unsigned char g, unsigned char b);
+
+  // One step of a fade, on the fade queue
+  void fadeStep();
+
+  // Cancel the fade in progress, if any
+  void stopFade();
+
   unsigned char _addr;
   unsigned char _displayfunction;
   unsigned char _displaycontrol;
@@ -126,6 +283,57 @@ private:
   unsigned char _charsize;
   unsigned char _backlightval;
 
+  // Cursor position, tracked so the shadow follows print()
+  unsigned char _cursor_col;
+  unsigned char _cursor_row;
+
+  // Text the next update() should show
+  char _frame[LCD_FRAME_ROWS][LCD_FRAME_COLS];
+
+  // Text the display is showing
+  char _shown[LCD_FRAME_ROWS][LCD_FRAME_COLS];
+
+  // I2C traffic counters
+  unsigned int _transactions;
+  unsigned int _bytes;
+  unsigned int _errors;
+
+  // Transactions waiting for the bus; _head is on the bus while _active
+  Transaction _queue[LCD_QUEUE_DEPTH];
+  volatile unsigned int _head;
+  volatile unsigned int _tail;
+  volatile bool _active;
+
+  // Tokens handed out and completed
+  Token _queued;
+  volatile Token _completed;
+
+  // Microseconds since construction; the next transaction to the LCD, and to
+  // the backlight, may start at _ready_at[target()]
+  Timer _clock;
+  uint64_t _ready_at[2];
+
+  // Thread the transactions are started from
+  EventQueue *_bus_queue;
+
+  // Holds the next transaction until its deadline
+  Timeout _settle;
+
+  // Released each time a transaction completes
+  Semaphore _progress;
+
+  // Colour in the backlight registers, as red, green, blue
+  unsigned char _rgb[3];
+
+  // Fade in progress: colours at its ends, steps done out of _fade_steps and
+  // the periodic event that runs them
+  unsigned char _fade_from[3];
+  unsigned char _fade_to[3];
+  volatile int _fade_step;
+  volatile int _fade_steps;
+  EventQueue *_fade_queue;
+  int _fade_event;
+
   // MBED I2C object used to transfer data to LCD
   I2C i2c;
 };
\ No newline at end of file
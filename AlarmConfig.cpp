@@ -0,0 +1,78 @@
+#include "AlarmConfig.h"
+
+#include <stddef.h>
+#include <string.h>
+#include "kvstore_global_api.h"
+
+// "FACF", first in every record
+#define CONFIG_MAGIC 0x46434146u
+
+/** The record as stored, fixed size and padded explicitly.
+ *
+ * The CRC-32 covers every byte before it.
+ */
+struct ConfigRecord {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    int16_t temperature_threshold;
+    int16_t warning_threshold;
+    uint8_t humidity_threshold;
+    uint8_t celsius;
+    uint16_t reserved;
+    uint32_t crc;
+};
+
+static_assert(sizeof(ConfigRecord) == 20, "ConfigRecord must not change size within a version");
+
+static uint32_t record_crc(const ConfigRecord &record)
+{
+    MbedCRC<POLY_32BIT_ANSI, 32> engine;
+    uint32_t crc = 0;
+    engine.compute(&record, offsetof(ConfigRecord, crc), &crc);
+    return crc;
+}
+
+// Same ranges the keypad prompts accept: 0 to 50 C or up to 122 F, 20 to 80 %
+static bool in_range(const ConfigRecord &record)
+{
+    return record.temperature_threshold >= temperature::from_fahrenheit_hundredths(0) &&
+           record.temperature_threshold <= temperature::from_whole(50) &&
+           record.warning_threshold < record.temperature_threshold &&
+           record.humidity_threshold >= 20 && record.humidity_threshold <= 80 &&
+           record.celsius <= 1;
+}
+
+bool load_config(AlarmConfig &config)
+{
+    ConfigRecord record;
+    size_t size = 0;
+    if (kv_get(CONFIG_KEY, &record, sizeof(record), &size) != MBED_SUCCESS ||
+        size != sizeof(record)) {
+        return false;
+    }
+    if (record.magic != CONFIG_MAGIC || record.version != CONFIG_VERSION ||
+        record.size != sizeof(record) || record.crc != record_crc(record) || !in_range(record)) {
+        return false;
+    }
+    config.temperature_threshold = record.temperature_threshold;
+    config.warning_threshold = record.warning_threshold;
+    config.humidity_threshold = record.humidity_threshold;
+    config.celsius = record.celsius;
+    return true;
+}
+
+bool save_config(const AlarmConfig &config)
+{
+    ConfigRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = CONFIG_MAGIC;
+    record.version = CONFIG_VERSION;
+    record.size = sizeof(record);
+    record.temperature_threshold = config.temperature_threshold;
+    record.warning_threshold = config.warning_threshold;
+    record.humidity_threshold = uint8_t(config.humidity_threshold);
+    record.celsius = config.celsius ? 1 : 0;
+    record.crc = record_crc(record);
+    return kv_set(CONFIG_KEY, &record, sizeof(record), 0) == MBED_SUCCESS;
+}
@@ -0,0 +1,44 @@
+#ifndef ALARM_CONFIG_H
+#define ALARM_CONFIG_H
+
+#include "mbed.h"
+#include "Temperature.h"
+
+// KVStore key of the stored configuration, in the internal flash store placed by mbed_app.json
+#define CONFIG_KEY "/kv/alarm_config"
+
+// Layout of the stored record; a record of any other version is ignored
+#define CONFIG_VERSION 1
+
+/** Thresholds and display unit, as typed on the keypad. */
+struct AlarmConfig {
+    /// Temperature threshold in tenths of a degree celsius, whatever unit it was entered in
+    Tenths temperature_threshold;
+    /// Temperature above which the backlight turns amber, in tenths of a degree celsius
+    Tenths warning_threshold;
+    /// Humidity threshold in percent
+    int humidity_threshold;
+    /// True to display celsius, false for fahrenheit
+    bool celsius;
+};
+
+/** Read the configuration stored by save_config().
+ *
+ * The record is checked for its version, size, CRC-32 and value ranges, so
+ * a torn write or a record from other firmware is never used.
+ *
+ * @param config Receives the configuration; unchanged on failure.
+ * @returns true if a good configuration was read.
+ */
+bool load_config(AlarmConfig &config);
+
+/** Store @p config in internal flash, replacing the previous one.
+ *
+ * Takes as long as the flash takes to program, milliseconds to tens of
+ * milliseconds; call it from a thread.
+ *
+ * @returns true once the record is stored.
+ */
+bool save_config(const AlarmConfig &config);
+
+#endif
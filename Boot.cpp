@@ -0,0 +1,77 @@
+#include "Boot.h"
+
+#include <stdio.h>
+
+const char *boot_phase_name(BootPhase phase)
+{
+    static const char *const names[BOOT_PHASE_COUNT] = {
+        "lcd", "config", "sensor", "setup", "decision",
+    };
+    return phase < BOOT_PHASE_COUNT ? names[phase] : "?";
+}
+
+BootSequencer::BootSequencer()
+{
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        _phase[i] = BootPhaseTimes();
+    }
+}
+
+void BootSequencer::start(BootPhase phase, std::chrono::microseconds ready_in)
+{
+    uint32_t now = us_ticker_read();
+    core_util_critical_section_enter();
+    BootPhaseTimes &p = _phase[phase];
+    p.start_us = now;
+    p.deadline_us = ready_in.count() > 0 ? now + uint32_t(ready_in.count()) : 0;
+    p.started = true;
+    core_util_critical_section_exit();
+}
+
+void BootSequencer::finish(BootPhase phase)
+{
+    uint32_t now = us_ticker_read();
+    core_util_critical_section_enter();
+    BootPhaseTimes &p = _phase[phase];
+    if (!p.finished) {
+        p.end_us = now;
+        p.finished = true;
+    }
+    core_util_critical_section_exit();
+}
+
+BootPhaseTimes BootSequencer::phase(BootPhase phase) const
+{
+    core_util_critical_section_enter();
+    BootPhaseTimes p = _phase[phase];
+    core_util_critical_section_exit();
+    return p;
+}
+
+void BootSequencer::dump(FileHandle &out) const
+{
+    char line[80];
+    int length = snprintf(line, sizeof(line), "boot: phase start_ms deadline_ms end_ms\r\n");
+    out.write(line, length);
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        BootPhaseTimes p = phase(BootPhase(i));
+        if (!p.started) {
+            continue;
+        }
+        length = snprintf(line, sizeof(line), "%s %lu.%03lu", boot_phase_name(BootPhase(i)),
+                          (unsigned long)(p.start_us / 1000), (unsigned long)(p.start_us % 1000));
+        if (p.deadline_us) {
+            length += snprintf(line + length, sizeof(line) - length, " %lu.%03lu",
+                               (unsigned long)(p.deadline_us / 1000), (unsigned long)(p.deadline_us % 1000));
+        } else {
+            length += snprintf(line + length, sizeof(line) - length, " -");
+        }
+        if (p.finished) {
+            length += snprintf(line + length, sizeof(line) - length, " %lu.%03lu\r\n",
+                               (unsigned long)(p.end_us / 1000), (unsigned long)(p.end_us % 1000));
+        } else {
+            length += snprintf(line + length, sizeof(line) - length, " -\r\n");
+        }
+        out.write(line, length);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include "mbed.h"
+
+/** Steps of bringing the alarm up after a reset. They overlap: each one is
+ * started as early as it can be and finishes on its own time. */
+enum BootPhase {
+    /// LCD and backlight init sequence queued by CSE321_LCD::begin(), until it is on the display
+    BOOT_LCD,
+    /// Reading the stored thresholds from flash
+    BOOT_CONFIG,
+    /// DHT-11 power-up settle and first frame
+    BOOT_SENSOR,
+    /// Thresholds typed on the keypad, on a board without a stored configuration
+    BOOT_SETUP,
+    /// Reset to the first alarm decision on a reading, with thresholds set
+    BOOT_DECISION,
+    BOOT_PHASE_COUNT
+};
+
+/** Timing of one boot phase, in us_ticker microseconds since reset. */
+struct BootPhaseTimes {
+    /// When the phase started
+    uint32_t start_us;
+    /// Earliest time the hardware can be ready, from its data sheet; 0 if it has no such limit
+    uint32_t deadline_us;
+    /// When the phase finished
+    uint32_t end_us;
+    bool started;
+    bool finished;
+};
+
+/** Records when each boot phase starts and finishes.
+ *
+ * A phase is started with the power-up time its hardware needs, which gives
+ * the deadline before which it cannot finish; the work of the others goes on
+ * meanwhile. dump() shows how close each phase came to its deadline and how
+ * long the alarm took to make its first decision after reset.
+ *
+ * A phase may be finished on another thread than the one that started it,
+ * and read on a third: every phase is written and copied out inside a
+ * critical section, so a reader never sees an end time without its flag.
+ */
+class BootSequencer
+{
+public:
+    BootSequencer();
+
+    /** Start @p phase now.
+     *
+     * @param phase Phase to start.
+     * @param ready_in Time its hardware needs from now before it can be ready.
+     */
+    void start(BootPhase phase, std::chrono::microseconds ready_in = std::chrono::microseconds(0));
+
+    /// Finish @p phase now; only the first call counts.
+    void finish(BootPhase phase);
+
+    /// True once @p phase has finished.
+    bool finished(BootPhase phase) const { return this->phase(phase).finished; }
+
+    /// Copy of the timing of @p phase.
+    BootPhaseTimes phase(BootPhase phase) const;
+
+    /// Write the timing of every phase as text, one line each.
+    void dump(FileHandle &out) const;
+
+private:
+    BootPhaseTimes _phase[BOOT_PHASE_COUNT];
+};
+
+/// Short name of @p phase.
+const char *boot_phase_name(BootPhase phase);
+
+#endif
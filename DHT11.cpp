@@ -8,14 +8,25 @@
 
 
 #include "DHT11.h"
+#include "Trace.h"
  
-DHT11::DHT11(PinName const &p) : _pin(p) {
+DHT11::DHT11(PinName const &p, Decoder decoder)
+    : _decoder(decoder), _pin(p), _edge(p), _frame_done(0, 1), _queue(nullptr) {
     // Set creation time so we can make 
     // sure we pause at least 1 second for 
     // startup.
     _timer.start();
     _temperature = 0; //default unit of Celcius 
     _humidity = 0;
+    _edge_count = 0;
+    _busy = false;
+    _lost_completions = 0;
+    _last_frame = std::chrono::milliseconds(0);
+    _read_before = false;
+
+    // The edge interrupt only listens to the pin during a frame
+    _edge.disable_irq();
+    _edge.fall(callback(this, &DHT11::edge_isr));
 }
 
 int DHT11::read() {
@@ -23,17 +34,81 @@ int DHT11::read() {
   
     // BUFFER TO RECEIVE
     uint8_t bits[5]; // DHT11 is a 40 bit signal, grouped in 5 bytes, each byte has own purpose
-    uint8_t cnt = 7; //byte bit tracker
-    uint8_t idx = 0; // bit set tracking
-    //read in MSB to LSB 
  
     // EMPTY BUFFER
     for (int i=0; i< 5; i++) bits[i] = 0;
     
+    if (!claim()) return DHTLIB_ERROR_BUSY;
+
     // Verify sensor settled after boot
-    while(_timer.elapsed_time().count() < 1500) {}
-    _timer.stop();
+    std::chrono::milliseconds settle = settle_time();
+    if (settle.count() > 0) thread_sleep_for(settle.count());
+
+    int result = _decoder == DECODER_EDGES ? read_edges(bits) : read_polled(bits);
+    frame_ended();
+    _busy = false;
+    if (result != DHTLIB_OK) return result;
+    return store(bits);
+}
+
+bool DHT11::start_read(EventQueue *queue, Callback<void(Sample)> done) {
+    if (!claim()) return false;
+    _queue = queue;
+    _done = done;
+
+    // Hold the start signal off until the sensor has settled after boot
+    std::chrono::milliseconds settle = settle_time();
+    if (settle.count() > 0) {
+        _phase.attach(callback(this, &DHT11::start_pulse_isr), settle);
+    } else {
+        start_pulse_isr();
+    }
+    return true;
+}
+
+bool DHT11::claim() {
+    // Reads may be started from several threads
+    core_util_critical_section_enter();
+    bool idle = !_busy;
+    _busy = true;
+    core_util_critical_section_exit();
+    return idle;
+}
+
+int DHT11::store(uint8_t bits[5]) {
+    // WRITE TO RIGHT VARS
+    // bits[1] is zero on the DHT11. Newer parts send the tenths of the
+    // temperature in the low bits of bits[3] and set its bit 7 below 0 C;
+    // older ones send zero.
+    _humidity    = bits[0];
+    _temperature = temperature::from_whole(bits[2]) + (bits[3] & 0x7F);
+    if (bits[3] & 0x80) _temperature = -_temperature;
+    uint8_t sum = bits[0] + bits[1] + bits[2] + bits[3];  
  
+    if (bits[4] != sum) return DHTLIB_ERROR_CHECKSUM;
+    return DHTLIB_OK;
+}
+
+std::chrono::milliseconds DHT11::settle_time() {
+    auto ready = std::chrono::milliseconds(DHT11_SETTLE_MS);
+    if (_read_before && _last_frame + std::chrono::milliseconds(DHT11_INTERVAL_MS) > ready) {
+        ready = _last_frame + std::chrono::milliseconds(DHT11_INTERVAL_MS);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(_timer.elapsed_time());
+    return elapsed < ready ? ready - elapsed : std::chrono::milliseconds(0);
+}
+
+void DHT11::frame_ended() {
+    // Rounded up, so the interval is never cut short
+    _last_frame = std::chrono::duration_cast<std::chrono::milliseconds>(_timer.elapsed_time()) + std::chrono::milliseconds(1);
+    _read_before = true;
+}
+
+int DHT11::read_polled(uint8_t bits[5]) {
+    uint8_t cnt = 7; //byte bit tracker
+    uint8_t idx = 0; // bit set tracking
+    //read in MSB to LSB 
+
     // Notify it we are ready to read
     _pin.output();
     _pin = 0;
@@ -75,24 +150,134 @@ int DHT11::read() {
         }
         else cnt--;
     }
- 
-    // WRITE TO RIGHT VARS
-    // as bits[1] and bits[3] are allways zero they are omitted in formulas.
-    _humidity    = bits[0];
-    _temperature = bits[2];
-    uint8_t sum = bits[0] + bits[2];  
- 
-    if (bits[4] != sum) return DHTLIB_ERROR_CHECKSUM;
     return DHTLIB_OK;
 }
+
+int DHT11::read_edges(uint8_t bits[5]) {
+    // Notify it we are ready to read
+    _pin.output();
+    _pin = 0;
+    thread_sleep_for(18);
+
+    // Release the line and let the interrupt capture the frame. The whole
+    // frame lasts about 4 ms; the thread sleeps until it is complete.
+    // A frame that completed just after the last read gave up has left a
+    // token behind; drop it so this read waits for its own frame
+    while (_frame_done.try_acquire()) {}
+    _edge_count = 0;
+    _edge_timer.reset();
+    _edge_timer.start();
+    _pin.input();
+    _edge.enable_irq();
+    bool complete = _frame_done.try_acquire_for(10ms);
+    _edge.disable_irq();
+    _edge_timer.stop();
+    if (!complete || _edge_count != FRAME_EDGES) return DHTLIB_ERROR_TIMEOUT;
+    return decode_edges(bits);
+}
+
+int DHT11::decode_edges(uint8_t bits[5]) {
+    // ACKNOWLEDGE: 80 us low + 80 us high between the first two edges
+    uint32_t ack = _edges[1] - _edges[0];
+    if (ack < 120 || ack > 200) return DHTLIB_ERROR_TIMEOUT;
+
+    // Each bit is 50 us low followed by 26-28 us (0) or 70 us (1) high, so
+    // falling edge to falling edge is ~78 us for a 0 and ~120 us for a 1.
+    for (int i=0; i<40; i++)
+    {
+        uint32_t width = _edges[i + 2] - _edges[i + 1];
+        if (width < 60 || width > 160) return DHTLIB_ERROR_TIMEOUT;
+        if (width > 100) bits[i / 8] |= (1 << (7 - i % 8));
+    }
+    return DHTLIB_OK;
+}
+
+void DHT11::edge_isr() {
+    TRACE_SCOPE(TRACE_DHT_EDGE);
+    uint32_t now = _edge_timer.elapsed_time().count();
+    int n = _edge_count;
+    // The sensor answers 20-40 us after release; anything sooner is our
+    // own start pulse latched while the interrupt was masked
+    if (n >= FRAME_EDGES || now < 10) return;
+    _edges[n] = now;
+    _edge_count = n + 1;
+    if (n + 1 < FRAME_EDGES) return;
+
+    if (_queue) {
+        // Asynchronous read: decode in the completion's thread
+        _edge.disable_irq();
+        _phase.detach();
+        post_finish(DHTLIB_OK);
+    } else {
+        _frame_done.release();
+    }
+}
+
+void DHT11::start_pulse_isr() {
+    // Notify it we are ready to read
+    _pin.output();
+    _pin = 0;
+    _phase.attach(callback(this, &DHT11::release_isr), 18ms);
+}
+
+void DHT11::release_isr() {
+    // Release the line and capture the frame, giving up after 10 ms
+    _edge_count = 0;
+    _edge_timer.reset();
+    _edge_timer.start();
+    _pin.input();
+    _edge.enable_irq();
+    _phase.attach(callback(this, &DHT11::timeout_isr), 10ms);
+}
+
+void DHT11::timeout_isr() {
+    _edge.disable_irq();
+    post_finish(DHTLIB_ERROR_TIMEOUT);
+}
+
+void DHT11::post_finish(int status) {
+    if (_queue->call(this, &DHT11::finish, status) != 0) return;
+
+    // The queue is full: the sample is lost, but the sensor must not stay
+    // busy or no read would ever start again
+    frame_ended();
+    _lost_completions++;
+    _queue = nullptr;
+    _busy = false;
+}
+
+void DHT11::finish(int status) {
+    TRACE_SCOPE(TRACE_DHT_DECODE);
+    _edge_timer.stop();
+    frame_ended();
+    if (status == DHTLIB_OK) {
+        uint8_t bits[5] = {0, 0, 0, 0, 0};
+        status = decode_edges(bits);
+        if (status == DHTLIB_OK) status = store(bits);
+    }
+
+    Sample sample = {status, _temperature, _humidity};
+    Callback<void(Sample)> done = _done;
+    _queue = nullptr;
+    _busy = false;
+    done(sample);
+}
+ 
+Tenths DHT11::getTemperature() {
+    return(_temperature);
+}
  
 float DHT11::getFahrenheit() { //performs C to F conversion
-    return((_temperature * 1.8) + 32);
+    return(temperature::to_fahrenheit(_temperature) / 10.0f);
 }
  
 int DHT11::getCelsius() {
-    return(_temperature);
+    return(temperature::floor_div(_temperature, 10));
 }
 int DHT11::getHumidity() {
     return(_humidity);
+}
+
+unsigned DHT11::lost_completions() {
+    return(_lost_completions);
 }
\ No newline at end of file
@@ -9,10 +9,18 @@
 #define DHT11_H
  
 #include "mbed.h"
+#include "Temperature.h"
  
 #define DHTLIB_OK                0
 #define DHTLIB_ERROR_CHECKSUM   -1
 #define DHTLIB_ERROR_TIMEOUT    -2
+#define DHTLIB_ERROR_BUSY       -3
+
+// The data sheet asks for a second after power-up before the first start signal
+#define DHT11_SETTLE_MS 1000
+
+// and a second between the end of a frame and the next start signal
+#define DHT11_INTERVAL_MS 1000
  
 /** Class for the DHT11 sensor.
  * 
@@ -26,18 +34,38 @@
  * 
  * int main() {
  *     sensor.read()
- *     pc.printf("T: %f, H: %d\r\n", sensor.getFahrenheit(), sensor.getHumidity());
+ *     pc.printf("T: %d, H: %d\r\n", sensor.getTemperature(), sensor.getHumidity());
  * }
  * @endcode
  */
 class DHT11
 {
 public:
+    /** How read() turns the sensor's pulses into bits. */
+    enum Decoder {
+        /// Spin on the pin and time every high pulse with a Timer.
+        DECODER_POLLED,
+        /// Timestamp falling edges from an interrupt while the calling
+        /// thread sleeps, then decode the pulse widths.
+        DECODER_EDGES
+    };
+
+    /** Result of an asynchronous read. */
+    struct Sample {
+        /// DHTLIB_OK or one of the DHTLIB_ERROR_* codes
+        int status;
+        /// tenths of a degree celsius, valid when status is DHTLIB_OK
+        Tenths temperature;
+        /// percentage of humidity, valid when status is DHTLIB_OK
+        int humidity;
+    };
+
     /** Construct the sensor object.
      *
      * @param pin PinName for the sensor pin.
+     * @param decoder Bit decoder used by read().
      */
-    DHT11(PinName const &p);
+    DHT11(PinName const &p, Decoder decoder = DECODER_POLLED);
     
     /** Update the humidity and temp from the sensor.
      *
@@ -45,18 +73,39 @@ public:
      *   0 on success, otherwise error.
      */
     int read();
+
+    /** Start a read without blocking the caller.
+     *
+     * The start pulse is timed with a Timeout and the frame is captured by
+     * the edge interrupt, whichever decoder read() uses. Once the frame is
+     * in, or has timed out, done is posted to the queue and runs there with
+     * the decoded sample. The getters are updated before it runs.
+     *
+     * @param queue Queue the completion is posted to.
+     * @param done Completion called with the sample.
+     * @returns
+     *   false if a read is already in progress.
+     */
+    bool start_read(EventQueue *queue, Callback<void(Sample)> done);
     
+    /** Get the temp(c) from the saved object.
+     *
+     * @returns
+     *   Celsius in tenths of a degree
+     */
+    Tenths getTemperature();
+
     /** Get the temp(f) from the saved object.
      *
      * @returns
-     *   Fahrenheit float
+     *   Fahrenheit float, converted from tenths in integer math
      */
     float getFahrenheit();
     
     /** Get the temp(c) from the saved object.
      *
      * @returns
-     *   Celsius int
+     *   Celsius int, rounded down to whole degrees
      */
     int getCelsius();
     
@@ -66,16 +115,94 @@ public:
      *   Humidity percent int
      */
     int getHumidity();
+
+    /** Time left until the sensor takes the next start signal: a second
+     * after power-up and a second after the previous frame.
+     *
+     * Reads started earlier are held until then, so a boot sequence can start
+     * the first read at once and do other work meanwhile, and a read
+     * schedule that drifts close to the previous frame stays within the
+     * data sheet.
+     */
+    std::chrono::milliseconds settle_time();
+
+    /** Asynchronous reads whose completion could not be posted.
+     *
+     * A full queue drops the sample; the sensor is released so the next
+     * start_read() goes ahead.
+     */
+    unsigned lost_completions();
  
 private:
+    /// Falling edges in a frame: acknowledge, 40 bit starts, end of frame
+    static const int FRAME_EDGES = 42;
+
+    /// Send the start signal and decode by polling the pin.
+    int read_polled(uint8_t bits[5]);
+
+    /// Send the start signal and decode from captured edge times.
+    int read_edges(uint8_t bits[5]);
+
+    /// Mark the sensor busy; false if a read is already in progress.
+    bool claim();
+
+    /// Note the end of a frame, for the interval before the next one.
+    void frame_ended();
+
+    /// Decode the captured edge times into bits.
+    int decode_edges(uint8_t bits[5]);
+
+    /// Store a decoded frame and verify its checksum.
+    int store(uint8_t bits[5]);
+
+    /// Falling edge interrupt handler used by DECODER_EDGES and start_read().
+    void edge_isr();
+
+    /// start_read() phases, run from the _phase Timeout.
+    void start_pulse_isr();
+    void release_isr();
+    void timeout_isr();
+
+    /// Post finish() to the completion queue, or give the read up if it is full.
+    void post_finish(int status);
+
+    /// Decode and deliver an asynchronous read on its queue.
+    void finish(int status);
+
     /// percentage of humidity
     int _humidity;
-    /// celsius
-    int _temperature;
+    /// celsius in tenths of a degree
+    Tenths _temperature;
+    /// decoder used by read()
+    Decoder _decoder;
     /// pin to read the sensor info on
     DigitalInOut _pin;
+    /// falling edge interrupt on the same pin
+    InterruptIn _edge;
     /// times startup (must settle for at least a second)
     Timer _timer;
+    /// _timer at the end of the last frame, or of the read that waited for it
+    std::chrono::milliseconds _last_frame;
+    /// a read has been made since construction
+    bool _read_before;
+    /// time base of the captured edges
+    Timer _edge_timer;
+    /// falling edge times of the current frame in microseconds
+    uint32_t _edges[FRAME_EDGES];
+    /// number of valid entries in _edges
+    volatile int _edge_count;
+    /// released by edge_isr() once the whole frame is captured
+    Semaphore _frame_done;
+    /// sequences the start pulse and frame timeout of start_read()
+    Timeout _phase;
+    /// completion queue of the read in progress, null for read()
+    EventQueue *volatile _queue;
+    /// completion of the read in progress
+    Callback<void(Sample)> _done;
+    /// a read is in progress
+    volatile bool _busy;
+    /// completions dropped by a full queue
+    volatile unsigned _lost_completions;
 };
  
 #endif
\ No newline at end of file
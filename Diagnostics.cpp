@@ -0,0 +1,99 @@
+#include "Diagnostics.h"
+
+#include <stdio.h>
+
+Diagnostics::Diagnostics() : _next(0), _count(0), _threads(0), _last_uptime(0), _last_idle(0)
+{
+}
+
+void Diagnostics::sample()
+{
+    DiagSample &s = _ring[_next];
+    s = DiagSample();
+    s.time_ms = uint32_t(Kernel::Clock::now().time_since_epoch().count());
+
+    mbed_stats_heap_t heap;
+    mbed_stats_heap_get(&heap);
+    s.heap_current = heap.current_size;
+    s.heap_max = heap.max_size;
+    s.heap_allocs = heap.alloc_cnt;
+    s.heap_failures = heap.alloc_fail_cnt;
+
+    // Load since the previous sample, from the time spent in the idle thread
+    mbed_stats_cpu_t cpu;
+    mbed_stats_cpu_get(&cpu);
+    us_timestamp_t uptime = cpu.uptime - _last_uptime;
+    us_timestamp_t idle = cpu.idle_time - _last_idle;
+    s.cpu_load = uptime && idle <= uptime ? uint16_t((uptime - idle) * 1000 / uptime) : 0;
+    _last_uptime = cpu.uptime;
+    _last_idle = cpu.idle_time;
+
+    // Stack high-water mark of each thread; the watermark is the space never touched
+    osThreadId_t ids[DIAG_MAX_THREADS];
+    uint32_t n = osThreadEnumerate(ids, DIAG_MAX_THREADS);
+    for (uint32_t i = 0; i < n; i++) {
+        unsigned index = slot(ids[i]);
+        if (index < DIAG_MAX_THREADS) {
+            uint32_t space = osThreadGetStackSpace(ids[i]);
+            uint32_t size = _thread[index].stack_size;
+            s.stack_used[index] = uint16_t(space < size ? size - space : 0);
+        }
+    }
+
+    _next = (_next + 1) % DIAG_HISTORY;
+    if (_count < DIAG_HISTORY) {
+        _count++;
+    }
+}
+
+const DiagSample &Diagnostics::history(unsigned age) const
+{
+    return _ring[(_next + DIAG_HISTORY - 1 - age % DIAG_HISTORY) % DIAG_HISTORY];
+}
+
+unsigned Diagnostics::slot(osThreadId_t id)
+{
+    for (unsigned i = 0; i < _threads; i++) {
+        if (_thread[i].id == id) {
+            return i;
+        }
+    }
+    if (_threads == DIAG_MAX_THREADS) {
+        return DIAG_MAX_THREADS;
+    }
+    DiagThread &t = _thread[_threads];
+    t.id = id;
+    t.name = osThreadGetName(id);
+    t.stack_size = osThreadGetStackSize(id);
+    t.priority = osThreadGetPriority(id);
+    return _threads++;
+}
+
+void Diagnostics::dump(FileHandle &out) const
+{
+    char line[96];
+    int length;
+
+    length = snprintf(line, sizeof(line), "diag: %u threads, %u samples\r\n", _threads, _count);
+    out.write(line, length);
+    for (unsigned i = 0; i < _threads; i++) {
+        const DiagThread &t = _thread[i];
+        length = snprintf(line, sizeof(line), "thread %u: %s, priority %d, stack %lu\r\n", i,
+                          t.name ? t.name : "?", int(t.priority), (unsigned long)t.stack_size);
+        out.write(line, length);
+    }
+
+    length = snprintf(line, sizeof(line), "time_ms heap heap_max allocs fails cpu_permille stack_used...\r\n");
+    out.write(line, length);
+    for (unsigned age = _count; age-- > 0;) {
+        const DiagSample &s = history(age);
+        length = snprintf(line, sizeof(line), "%lu %lu %lu %lu %lu %u", (unsigned long)s.time_ms,
+                          (unsigned long)s.heap_current, (unsigned long)s.heap_max,
+                          (unsigned long)s.heap_allocs, (unsigned long)s.heap_failures, s.cpu_load);
+        for (unsigned i = 0; i < _threads && length < int(sizeof(line)) - 8; i++) {
+            length += snprintf(line + length, sizeof(line) - length, " %u", s.stack_used[i]);
+        }
+        length += snprintf(line + length, sizeof(line) - length, "\r\n");
+        out.write(line, length);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "mbed.h"
+
+// Threads followed, the RTOS idle and timer threads included
+#define DIAG_MAX_THREADS 6
+
+// Samples kept in the history
+#define DIAG_HISTORY 32
+
+/** One snapshot of the heap, CPU and stack statistics. */
+struct DiagSample {
+    /// Kernel clock time of the snapshot
+    uint32_t time_ms;
+    /// Heap bytes in use
+    uint32_t heap_current;
+    /// Most heap bytes ever in use
+    uint32_t heap_max;
+    /// Heap allocations so far
+    uint32_t heap_allocs;
+    /// Failed heap allocations so far
+    uint32_t heap_failures;
+    /// CPU time outside the idle thread since the previous snapshot, in tenths of a percent
+    uint16_t cpu_load;
+    /// Most stack each thread of Diagnostics::thread() ever used, in bytes
+    uint16_t stack_used[DIAG_MAX_THREADS];
+};
+
+/** A thread as it was first seen; its stack use is in DiagSample::stack_used. */
+struct DiagThread {
+    osThreadId_t id;
+    const char *name;
+    uint32_t stack_size;
+    osPriority_t priority;
+};
+
+/** Periodic heap, CPU and stack statistics of every RTOS thread.
+ *
+ * sample() takes a snapshot with mbed_stats and the CMSIS-RTOS2 thread calls
+ * into a fixed ring of the last DIAG_HISTORY snapshots, and dump() writes the
+ * ring as text. Nothing is allocated: the thread list is enumerated into an
+ * array on the stack instead of through mbed_stats_stack_get_each(), which
+ * mallocs one.
+ *
+ * On the target the statistics need "platform.all-stats-enabled" in
+ * mbed_app.json; without it every figure reads zero.
+ *
+ * The class is meant to be used from one thread.
+ */
+class Diagnostics
+{
+public:
+    Diagnostics();
+
+    /// Take a snapshot into the ring, dropping the oldest once it is full.
+    void sample();
+
+    /// Snapshots held, up to DIAG_HISTORY.
+    unsigned count() const { return _count; }
+
+    /// Snapshot @p age samples before the newest one; count() must not be zero.
+    const DiagSample &history(unsigned age) const;
+
+    /// Threads seen so far, up to DIAG_MAX_THREADS.
+    unsigned threads() const { return _threads; }
+
+    /// Thread @p index, in the order they were first seen.
+    const DiagThread &thread(unsigned index) const { return _thread[index]; }
+
+    /** Write the threads and every snapshot, oldest first, as text lines.
+     *
+     * @param out Stream to write to, such as the console.
+     */
+    void dump(FileHandle &out) const;
+
+private:
+    // Slot of thread @p id, added if there is room; DIAG_MAX_THREADS if not
+    unsigned slot(osThreadId_t id);
+
+    DiagSample _ring[DIAG_HISTORY];
+    unsigned _next;
+    unsigned _count;
+    DiagThread _thread[DIAG_MAX_THREADS];
+    unsigned _threads;
+    us_timestamp_t _last_uptime;
+    us_timestamp_t _last_idle;
+};
+
+#endif
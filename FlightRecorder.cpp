@@ -0,0 +1,299 @@
+#include "FlightRecorder.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// "FAFR", first in every sector header
+#define RECORDER_MAGIC 0x52464146u
+
+// Layout of the sector header and of FlightRecord; a sector of any other version is ignored
+#define RECORDER_VERSION 1
+
+static_assert(sizeof(FlightRecord) == 16, "FlightRecord must stay 16 bytes within a version");
+static_assert((RECORDER_QUEUE & (RECORDER_QUEUE - 1)) == 0, "RECORDER_QUEUE must be a power of two");
+
+/** First slot of every sector. */
+struct FlightSectorHeader {
+    uint32_t magic;
+    /// One more than the sector erased before it
+    uint32_t generation;
+    uint16_t version;
+    uint16_t record_size;
+    /// CRC-32 of the bytes before it
+    uint32_t check;
+};
+
+static_assert(sizeof(FlightSectorHeader) == sizeof(FlightRecord), "the header takes one record slot");
+
+const char *flight_event_name(int event)
+{
+    switch (event) {
+    case FLIGHT_BOOT:
+        return "boot";
+    case FLIGHT_SAMPLE:
+        return "sample";
+    case FLIGHT_LEVEL:
+        return "level";
+    case FLIGHT_SENSOR_ERROR:
+        return "sensor_error";
+    case FLIGHT_CONFIG:
+        return "config";
+    default:
+        return "?";
+    }
+}
+
+static uint32_t crc32(const void *data, size_t size)
+{
+    MbedCRC<POLY_32BIT_ANSI, 32> engine;
+    uint32_t crc = 0;
+    engine.compute(data, size, &crc);
+    return crc;
+}
+
+FlightRecorder::FlightRecorder()
+    : _mounted(false), _base(0), _sector_size(0), _sectors(0), _slots(0), _erase_value(0xFF),
+      _head(0), _generation(0), _next_slot(0), _boot(1), _batched(0), _urgent(false),
+      _written(0), _failed(0), _read_generation(1), _read_slot(1), _read_header(true)
+{
+}
+
+int FlightRecorder::mount()
+{
+    int err = _flash.init();
+    if (err) {
+        return err;
+    }
+    _base = _flash.get_flash_start() + _flash.get_flash_size() - RECORDER_SIZE;
+    _sector_size = _flash.get_sector_size(_base);
+    _sectors = RECORDER_SIZE / _sector_size;
+    _slots = _sector_size / sizeof(FlightRecord);
+    _erase_value = uint8_t(_flash.get_erase_value());
+    if (_sectors < 2 || sizeof(FlightRecord) % _flash.get_page_size() != 0) {
+        return RECORDER_ERROR_GEOMETRY;
+    }
+#ifdef MBED_CONF_STORAGE_TDB_INTERNAL_INTERNAL_SIZE
+    // A TDB_INTERNAL store left without a base address or size is put at the end of flash
+    uint32_t kv_base = MBED_CONF_STORAGE_TDB_INTERNAL_INTERNAL_BASE_ADDRESS;
+    uint32_t kv_size = MBED_CONF_STORAGE_TDB_INTERNAL_INTERNAL_SIZE;
+    if (kv_base == 0 || kv_size == 0 || (kv_base < _base + RECORDER_SIZE && _base < kv_base + kv_size)) {
+        return RECORDER_ERROR_KVSTORE;
+    }
+#endif
+
+    // The newest sector has the highest generation; on an empty log the first batch
+    // erases sector 0
+    _head = _sectors - 1;
+    _generation = 0;
+    for (unsigned i = 0; i < _sectors; i++) {
+        uint32_t g = generation(i);
+        if (g > _generation) {
+            _generation = g;
+            _head = i;
+        }
+    }
+
+    // Records are appended in order, so the first erased slot of the newest sector is the
+    // end of the log. The boot count carries on from the newest record of any sector.
+    _next_slot = _slots;
+    uint16_t last_boot = 0;
+    for (unsigned i = 0; i < _sectors; i++) {
+        if (!generation(i)) {
+            continue;
+        }
+        for (unsigned slot = 1; slot < _slots; slot++) {
+            FlightRecord r;
+            _flash.read(&r, sector_address(i) + slot * sizeof(r), sizeof(r));
+            if (erased(r)) {
+                if (i == _head) {
+                    _next_slot = slot;
+                }
+                break;
+            }
+            if (valid(r) && r.boot > last_boot) {
+                last_boot = r.boot;
+            }
+        }
+    }
+    _boot = uint16_t(last_boot + 1);
+    _mounted = true;
+    return 0;
+}
+
+bool FlightRecorder::record(FlightEvent event, int level, Tenths celsius, int humidity, int status, int detail)
+{
+    // The check is added by the writer, so this stays a copy into the queue
+    FlightRecord r;
+    r.boot = _boot;
+    r.event = uint8_t(event);
+    r.level = uint8_t(level);
+    r.time_ms = uint32_t(Kernel::Clock::now().time_since_epoch().count());
+    r.celsius = celsius;
+    r.humidity = uint8_t(humidity);
+    r.status = int8_t(status);
+    r.detail = int16_t(detail);
+    r.check = 0;
+    return _queue.push(r);
+}
+
+void FlightRecorder::flush(bool force)
+{
+    FlightRecord r;
+    while (_queue.pop(r)) {
+        if (!_mounted) {
+            _failed++;
+            continue;
+        }
+        r.check = check(r);
+        _batch[_batched++] = r;
+        if (r.event != FLIGHT_SAMPLE) {
+            _urgent = true;
+        }
+        if (_batched == RECORDER_BATCH) {
+            program_batch();
+        }
+    }
+    if (_batched == 0) {
+        return;
+    }
+    uint32_t now = uint32_t(Kernel::Clock::now().time_since_epoch().count());
+    if (force || _urgent || now - _batch[0].time_ms >= RECORDER_FLUSH_MS) {
+        program_batch();
+    }
+}
+
+void FlightRecorder::program_batch()
+{
+    unsigned done = 0;
+    while (done < _batched) {
+        if (_next_slot >= _slots && !rotate()) {
+            _failed += _batched - done;
+            break;
+        }
+
+        // A batch that does not fit the sector is split at its end
+        unsigned n = _batched - done;
+        if (n > _slots - _next_slot) {
+            n = _slots - _next_slot;
+        }
+        uint32_t address = sector_address(_head) + _next_slot * sizeof(FlightRecord);
+        if (_flash.program(&_batch[done], address, n * sizeof(FlightRecord)) == 0) {
+            _written += n;
+        } else {
+            _failed += n;
+        }
+        _next_slot += n;
+        done += n;
+    }
+    _batched = 0;
+    _urgent = false;
+}
+
+bool FlightRecorder::rotate()
+{
+    unsigned next = (_head + 1) % _sectors;
+    if (_flash.erase(sector_address(next), _sector_size) != 0) {
+        return false;
+    }
+    FlightSectorHeader header;
+    header.magic = RECORDER_MAGIC;
+    header.generation = _generation + 1;
+    header.version = RECORDER_VERSION;
+    header.record_size = sizeof(FlightRecord);
+    header.check = crc32(&header, offsetof(FlightSectorHeader, check));
+    if (_flash.program(&header, sector_address(next), sizeof(header)) != 0) {
+        return false;
+    }
+    _head = next;
+    _generation++;
+    _next_slot = 1;
+    return true;
+}
+
+uint32_t FlightRecorder::generation(unsigned index)
+{
+    FlightSectorHeader header;
+    if (_flash.read(&header, sector_address(index), sizeof(header)) != 0) {
+        return 0;
+    }
+    if (header.magic != RECORDER_MAGIC || header.version != RECORDER_VERSION ||
+        header.record_size != sizeof(FlightRecord) ||
+        header.check != crc32(&header, offsetof(FlightSectorHeader, check))) {
+        return 0;
+    }
+    return header.generation;
+}
+
+uint16_t FlightRecorder::check(const FlightRecord &record)
+{
+    return uint16_t(crc32(&record, offsetof(FlightRecord, check)));
+}
+
+bool FlightRecorder::valid(const FlightRecord &record) const
+{
+    return record.check == check(record);
+}
+
+bool FlightRecorder::erased(const FlightRecord &record) const
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&record);
+    for (size_t i = 0; i < sizeof(record); i++) {
+        if (bytes[i] != _erase_value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FlightRecorder::rewind()
+{
+    _read_generation = oldest_generation();
+    _read_slot = 1;
+    _read_header = true;
+}
+
+bool FlightRecorder::read(FileHandle &out, unsigned max)
+{
+    char line[80];
+    int length;
+    if (_read_header) {
+        length = snprintf(line, sizeof(line), "boot,time_ms,event,level,celsius_tenths,humidity,status,detail\r\n");
+        out.write(line, length);
+        _read_header = false;
+    }
+    if (!_mounted) {
+        return false;
+    }
+
+    // Oldest sector first, by generation. A sector erased since the last call has left the
+    // ring and is skipped; its slot now holds a newer generation, read in its turn.
+    while (max > 0 && _read_generation <= _generation) {
+        if (_read_generation < oldest_generation()) {
+            _read_generation = oldest_generation();
+            _read_slot = 1;
+        }
+        unsigned index = (_head + _sectors - (_generation - _read_generation)) % _sectors;
+        if (_read_slot >= _slots || (_read_slot == 1 && generation(index) != _read_generation)) {
+            _read_generation++;
+            _read_slot = 1;
+            continue;
+        }
+        FlightRecord r;
+        _flash.read(&r, sector_address(index) + _read_slot * sizeof(r), sizeof(r));
+        if (erased(r)) {
+            _read_slot = _slots;
+            continue;
+        }
+        _read_slot++;
+        if (!valid(r)) {
+            continue;
+        }
+        length = snprintf(line, sizeof(line), "%u,%lu,%s,%u,%d,%u,%d,%d\r\n", r.boot,
+                          (unsigned long)r.time_ms, flight_event_name(r.event), r.level, r.celsius,
+                          r.humidity, r.status, r.detail);
+        out.write(line, length);
+        max--;
+    }
+    return _read_generation <= _generation;
+}
@@ -0,0 +1,183 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "mbed.h"
+#include "SpscRing.h"
+#include "Temperature.h"
+
+// Flash at the very end of the internal flash kept for the log, a whole number of sectors. On the
+// L4R5ZI this is the top of bank 2, so erasing it does not stall code running from bank 1. A
+// KVStore in internal flash must be placed below it.
+#ifndef RECORDER_SIZE
+#define RECORDER_SIZE (32 * 1024)
+#endif
+
+// mount() errors of its own; FlashIAP errors are passed on as they are
+/// The log region is not two sectors or more, or a record is not whole flash pages
+#define RECORDER_ERROR_GEOMETRY (-1)
+/// The KVStore in internal flash overlaps the log region, or is left where it would
+#define RECORDER_ERROR_KVSTORE (-2)
+
+// Records that can wait in RAM for the writer, a power of two
+#define RECORDER_QUEUE 32
+
+// Records programmed to flash at once
+#define RECORDER_BATCH 16
+
+// Longest a record waits in RAM before it is programmed even if the batch is not full
+#define RECORDER_FLUSH_MS 60000
+
+/** What a FlightRecord marks. */
+enum FlightEvent {
+    /// The firmware started; detail is the reset_reason_t
+    FLIGHT_BOOT = 1,
+    /// Periodic reading; detail is the rate of rise in tenths of a degree per minute
+    FLIGHT_SAMPLE,
+    /// The alarm level changed to level; detail is the previous level
+    FLIGHT_LEVEL,
+    /// A sensor read failed; status is the DHTLIB error, detail the failed reads in a row
+    FLIGHT_SENSOR_ERROR,
+    /// Thresholds set; celsius and humidity are the thresholds, detail 1 for a celsius display
+    FLIGHT_CONFIG,
+};
+
+/** One log entry, as stored in flash. */
+struct FlightRecord {
+    /// Boot the record was made in, counting from 1 on a fresh log
+    uint16_t boot;
+    /// FlightEvent
+    uint8_t event;
+    /// AlarmLevel at the time
+    uint8_t level;
+    /// Kernel clock time since that boot
+    uint32_t time_ms;
+    /// Temperature in tenths of a degree celsius
+    int16_t celsius;
+    /// Humidity in percent
+    uint8_t humidity;
+    /// DHTLIB status of the last read
+    int8_t status;
+    /// Depends on event
+    int16_t detail;
+    /// Low half of the CRC-32 of the bytes before it; a torn write fails it
+    uint16_t check;
+};
+
+/** Circular log of FlightRecords in internal flash, kept across resets.
+ *
+ * The log region is a ring of sectors. Each sector starts with a header
+ * holding its generation, which grows by one each time the next sector is
+ * erased, so the sectors wear evenly and the newest one is found again at
+ * boot. Records are only ever appended; the oldest sector is erased when the
+ * newest is full.
+ *
+ * record() copies a record into a lock-free ring and returns: it never waits
+ * for the flash, so it can be called from the detection path. flush() runs on
+ * a thread that may wait, and programs queued records a batch at a time.
+ *
+ * record() must be called from one thread at a time, and mount(), flush() and
+ * the reader from one other thread.
+ */
+class FlightRecorder
+{
+public:
+    FlightRecorder();
+
+    /** Find the end of the log and the boot count; call once before anything else.
+     *
+     * Refuses to mount if the KVStore in internal flash shares the log region,
+     * as each would erase the other's sectors.
+     *
+     * @returns 0 on success, a RECORDER_ERROR_ or the FlashIAP error; the
+     *          recorder then drops every record.
+     */
+    int mount();
+
+    /// Boot number given to the records of this boot.
+    uint16_t boot() const { return _boot; }
+
+    /** Queue a record stamped with the current time; never blocks.
+     *
+     * @returns false, counting it as dropped, if the queue is full.
+     */
+    bool record(FlightEvent event, int level, Tenths celsius, int humidity, int status, int detail);
+
+    /** Program queued records to flash.
+     *
+     * Records go out in batches of RECORDER_BATCH. A smaller batch is programmed
+     * when @p force is set, when it holds an event other than a sample, or once
+     * its oldest record is RECORDER_FLUSH_MS old. Blocks while the flash is
+     * programmed or a sector is erased.
+     */
+    void flush(bool force = false);
+
+    /// Start reading the log from its oldest record.
+    void rewind();
+
+    /** Write up to @p max records from the read position as text lines.
+     *
+     * A header line comes first after rewind(). The position is kept by
+     * sector generation, so flushes between calls do not disturb it: records
+     * programmed meanwhile are read too, and a sector erased meanwhile is
+     * skipped.
+     *
+     * @returns true if there are more records to read.
+     */
+    bool read(FileHandle &out, unsigned max);
+
+    /// Records programmed to flash since boot.
+    uint32_t written() const { return _written; }
+
+    /// Records lost because the queue was full or the flash failed.
+    uint32_t dropped() const { return _queue.dropped() + _failed; }
+
+private:
+    // Address of sector @p index of the log region
+    uint32_t sector_address(unsigned index) const { return _base + index * _sector_size; }
+
+    // Generation of sector @p index, 0 if it holds no valid header
+    uint32_t generation(unsigned index);
+
+    // Generation of the oldest sector still in the ring
+    uint32_t oldest_generation() const { return _generation >= _sectors ? _generation - _sectors + 1 : 1; }
+
+    // Erase the sector after the newest one and make it the newest
+    bool rotate();
+
+    // Program the batch and empty it
+    void program_batch();
+
+    static uint16_t check(const FlightRecord &record);
+    bool valid(const FlightRecord &record) const;
+    bool erased(const FlightRecord &record) const;
+
+    FlashIAP _flash;
+    bool _mounted;
+    uint32_t _base;
+    uint32_t _sector_size;
+    unsigned _sectors;
+    unsigned _slots; // Record slots per sector, the header included
+    uint8_t _erase_value;
+
+    unsigned _head; // Newest sector
+    uint32_t _generation; // Its generation
+    unsigned _next_slot; // Next free slot in it
+    uint16_t _boot;
+
+    SpscRing<FlightRecord, RECORDER_QUEUE> _queue;
+    FlightRecord _batch[RECORDER_BATCH];
+    unsigned _batched;
+    bool _urgent;
+    uint32_t _written;
+    uint32_t _failed;
+
+    // Reader position: generation of the sector, and slot within it
+    uint32_t _read_generation;
+    unsigned _read_slot;
+    bool _read_header;
+};
+
+/// Short name of @p event.
+const char *flight_event_name(int event);
+
+#endif
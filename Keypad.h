@@ -0,0 +1,251 @@
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include "mbed.h"
+#include "SpscRing.h"
+#include "Trace.h"
+
+/** What happened to a key. */
+enum KeyEventType { KEY_PRESS, KEY_RELEASE, KEY_LONG_PRESS };
+
+/** A debounced key event. */
+struct KeyEvent {
+    /// key character from the keymap
+    char key;
+    /// KeyEventType
+    uint8_t type;
+    /// us_ticker time of the event
+    uint32_t time_us;
+};
+
+/** Compile-time list of the row or column pins of a keypad. */
+template <PinName... Pins>
+struct KeypadPins {
+};
+
+template <typename Rows, typename Cols, typename Keymap>
+class Keypad;
+
+/** Ticker-driven scanner for a keypad matrix wired straight to GPIO.
+ *
+ * Rows are driven high one at a time with a single BSRR write. All columns are
+ * sampled with a single IDR read and looked up in the keymap. The rows must
+ * share one port, and so must the columns; both are checked at compile time.
+ * Every key has its own integrator debounce, so any number of keys can be held
+ * at once.
+ *
+ * Example:
+ * @code
+ * struct PhoneKeymap {
+ *     static constexpr char key(int row, int col) { return "123456789*0#"[row * 3 + col]; }
+ * };
+ *
+ * Keypad<KeypadPins<PD_6, PD_5, PD_4, PD_3>, KeypadPins<PE_2, PE_4, PE_5>, PhoneKeymap> keypad;
+ *
+ * int main() {
+ *     keypad.start(500us);
+ *     KeyEvent event = keypad.wait();
+ * }
+ * @endcode
+ *
+ * @tparam RowPins Row pins, driven high in turn.
+ * @tparam ColPins Column pins, read with pull-downs.
+ * @tparam Keymap Type with `static constexpr char key(int row, int col)`.
+ */
+template <PinName... RowPins, PinName... ColPins, typename Keymap>
+class Keypad<KeypadPins<RowPins...>, KeypadPins<ColPins...>, Keymap>
+{
+public:
+    static constexpr int ROWS = sizeof...(RowPins);
+    static constexpr int COLS = sizeof...(ColPins);
+
+    /// Consecutive scans a key must agree on before it changes state.
+    static constexpr int DEBOUNCE_SCANS = 3;
+
+    /// Time a key must be held to report a long press.
+    static constexpr uint32_t LONG_PRESS_US = 1000000;
+
+    Keypad() : _ready(0, 1), _row(0)
+    {
+        const PinName rows[ROWS] = {RowPins...};
+        const PinName cols[COLS] = {ColPins...};
+        for (int row = 0; row < ROWS; row++) {
+            // Set this row and reset the others in one write
+            uint32_t set = pin_bit(rows[row]);
+            _row_drive[row] = set | ((ROW_MASK & ~set) << 16);
+        }
+        for (int col = 0; col < COLS; col++) {
+            _col_bit[col] = pin_bit(cols[col]);
+        }
+        memset(_count, 0, sizeof(_count));
+        memset(_down, 0, sizeof(_down));
+        memset(_long, 0, sizeof(_long));
+    }
+
+    /** Configure the pins and start scanning.
+     *
+     * @param row_period Time each row is driven before its columns are read.
+     */
+    void start(std::chrono::microseconds row_period)
+    {
+        // Clock both ports; rows are outputs, columns inputs with pull-downs
+        RCC->AHB2ENR |= (1u << ROW_PORT) | (1u << COL_PORT);
+        GPIO_TypeDef *rows = gpio(ROW_PORT);
+        GPIO_TypeDef *cols = gpio(COL_PORT);
+        rows->MODER = (rows->MODER & ~spread(ROW_MASK, 0x3)) | spread(ROW_MASK, 0x1);
+        cols->MODER &= ~spread(COL_MASK, 0x3);
+        cols->PUPDR = (cols->PUPDR & ~spread(COL_MASK, 0x3)) | spread(COL_MASK, 0x2);
+
+        _row = 0;
+        rows->BSRR = _row_drive[0];
+        _ticker.attach(callback(this, &Keypad::scan), row_period);
+    }
+
+    /// Stop scanning.
+    void stop() { _ticker.detach(); }
+
+    /** Take the next key event without waiting.
+     *
+     * @returns false if there is none.
+     */
+    bool get(KeyEvent &event) { return _events.pop(event); }
+
+    /// Sleep until a key event arrives and take it.
+    KeyEvent wait()
+    {
+        KeyEvent event;
+        while (!_events.pop(event)) {
+            _ready.acquire();
+        }
+        return event;
+    }
+
+    /// Debounced state of the key at @p row, @p col.
+    bool pressed(int row, int col) const { return _down[row][col]; }
+
+    /// Events lost because nobody took them in time.
+    unsigned dropped() const { return _events.dropped(); }
+
+private:
+    static constexpr uint32_t port_of(PinName pin) { return ((uint32_t)pin >> 4) & 0xF; }
+    static constexpr uint32_t pin_bit(PinName pin) { return 1u << ((uint32_t)pin & 0xF); }
+
+    static constexpr uint32_t mask_of(const PinName *pins, int count)
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < count; i++) {
+            mask |= pin_bit(pins[i]);
+        }
+        return mask;
+    }
+
+    static constexpr bool one_port(const PinName *pins, int count)
+    {
+        for (int i = 1; i < count; i++) {
+            if (port_of(pins[i]) != port_of(pins[0])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Two-bit register field value @p field for every pin in @p mask
+    static constexpr uint32_t spread(uint32_t mask, uint32_t field)
+    {
+        uint32_t value = 0;
+        for (int bit = 0; bit < 16; bit++) {
+            if (mask & (1u << bit)) {
+                value |= field << (2 * bit);
+            }
+        }
+        return value;
+    }
+
+    static constexpr PinName ROW_LIST[ROWS] = {RowPins...};
+    static constexpr PinName COL_LIST[COLS] = {ColPins...};
+    static constexpr uint32_t ROW_PORT = port_of(ROW_LIST[0]);
+    static constexpr uint32_t COL_PORT = port_of(COL_LIST[0]);
+    static constexpr uint32_t ROW_MASK = mask_of(ROW_LIST, ROWS);
+    static constexpr uint32_t COL_MASK = mask_of(COL_LIST, COLS);
+
+    static_assert(one_port(ROW_LIST, ROWS), "keypad rows must share one GPIO port");
+    static_assert(one_port(COL_LIST, COLS), "keypad columns must share one GPIO port");
+    static_assert(Keymap::key(ROWS - 1, COLS - 1) != 0, "keymap does not cover the matrix");
+
+    static GPIO_TypeDef *gpio(uint32_t port)
+    {
+        switch (port) {
+            case 0: return GPIOA;
+            case 1: return GPIOB;
+            case 2: return GPIOC;
+            case 3: return GPIOD;
+            case 4: return GPIOE;
+            case 5: return GPIOF;
+            case 6: return GPIOG;
+            default: return GPIOH;
+        }
+    }
+
+    // Ticker handler: read the row driven since the last tick, drive the next
+    void scan()
+    {
+        TRACE_SCOPE(TRACE_KEYPAD_SCAN);
+        uint32_t idr = gpio(COL_PORT)->IDR;
+        uint32_t now = us_ticker_read();
+        for (int col = 0; col < COLS; col++) {
+            debounce(_row, col, (idr & _col_bit[col]) != 0, now);
+        }
+        _row = (_row + 1) % ROWS;
+        gpio(ROW_PORT)->BSRR = _row_drive[_row];
+    }
+
+    // Move the key's integrator one step towards the sample, queue its events
+    void debounce(int row, int col, bool sample, uint32_t now)
+    {
+        uint8_t &count = _count[row][col];
+        if (sample && count < DEBOUNCE_SCANS) {
+            count++;
+        } else if (!sample && count > 0) {
+            count--;
+        }
+
+        if (!_down[row][col] && count == DEBOUNCE_SCANS) {
+            _down[row][col] = true;
+            _long[row][col] = false;
+            _since[row][col] = now;
+            post(row, col, KEY_PRESS, now);
+        } else if (_down[row][col] && count == 0) {
+            _down[row][col] = false;
+            post(row, col, KEY_RELEASE, now);
+        } else if (_down[row][col] && !_long[row][col] && now - _since[row][col] >= LONG_PRESS_US) {
+            _long[row][col] = true;
+            post(row, col, KEY_LONG_PRESS, now);
+        }
+    }
+
+    void post(int row, int col, KeyEventType type, uint32_t now)
+    {
+        KeyEvent event = {Keymap::key(row, col), (uint8_t)type, now};
+        _events.push(event);
+        _ready.release();
+    }
+
+    SpscRing<KeyEvent, 16> _events;
+    Semaphore _ready;
+    Ticker _ticker;
+    int _row;
+    uint32_t _row_drive[ROWS];
+    uint32_t _col_bit[COLS];
+    uint8_t _count[ROWS][COLS];
+    bool _down[ROWS][COLS];
+    bool _long[ROWS][COLS];
+    uint32_t _since[ROWS][COLS];
+};
+
+template <PinName... RowPins, PinName... ColPins, typename Keymap>
+constexpr PinName Keypad<KeypadPins<RowPins...>, KeypadPins<ColPins...>, Keymap>::ROW_LIST[];
+
+template <PinName... RowPins, PinName... ColPins, typename Keymap>
+constexpr PinName Keypad<KeypadPins<RowPins...>, KeypadPins<ColPins...>, Keymap>::COL_LIST[];
+
+#endif
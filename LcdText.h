@@ -0,0 +1,116 @@
+#ifndef LCD_TEXT_H
+#define LCD_TEXT_H
+
+#include <stdint.h>
+
+/** Fixed-width fields written straight into a row of characters.
+ *
+ * Every field has a width known at compile time and the type carries the
+ * columns used so far, so a row that would not fit does not compile. Numbers
+ * are right-aligned in their field, so they do not jump around as they change,
+ * and show as '#' when they do not fit. Nothing is allocated and printf is not
+ * involved.
+ *
+ * @code
+ * LcdText<LCD_FRAME_COLS>(lcd.line(0)).text("Temp.: ").fixed<5, 1>(tenths).glyph(degree).text("C").end();
+ * @endcode
+ *
+ * @tparam Cols Width of the row.
+ * @tparam Used Columns written so far.
+ */
+template <unsigned Cols, unsigned Used = 0>
+class LcdText
+{
+public:
+    /// Start writing at column Used of @p row, which holds Cols characters.
+    explicit LcdText(char *row) : _row(row) {}
+
+    /// Append a string literal.
+    template <unsigned N>
+    LcdText<Cols, Used + N - 1> text(const char (&literal)[N]) const
+    {
+        static_assert(Used + N - 1 <= Cols, "text does not fit the row");
+        for (unsigned i = 0; i + 1 < N; i++) {
+            _row[Used + i] = literal[i];
+        }
+        return LcdText<Cols, Used + N - 1>(_row);
+    }
+
+    /// Append up to Width characters of @p str, padded with spaces.
+    template <unsigned Width>
+    LcdText<Cols, Used + Width> field(const char *str) const
+    {
+        static_assert(Used + Width <= Cols, "field does not fit the row");
+        for (unsigned i = 0; i < Width; i++) {
+            _row[Used + i] = *str ? *str++ : ' ';
+        }
+        return LcdText<Cols, Used + Width>(_row);
+    }
+
+    /// Append one character, such as a glyph of the character ROM.
+    LcdText<Cols, Used + 1> glyph(char c) const
+    {
+        static_assert(Used + 1 <= Cols, "glyph does not fit the row");
+        _row[Used] = c;
+        return LcdText<Cols, Used + 1>(_row);
+    }
+
+    /// Append @p value right-aligned in Width columns.
+    template <unsigned Width>
+    LcdText<Cols, Used + Width> integer(int32_t value) const
+    {
+        return fixed<Width, 0>(value);
+    }
+
+    /** Append a fixed-point number right-aligned in Width columns.
+     *
+     * @tparam Width Columns of the field, sign and point included.
+     * @tparam Decimals Digits after the point.
+     * @param value Number in units of 10^-Decimals, such as tenths for 1.
+     */
+    template <unsigned Width, unsigned Decimals>
+    LcdText<Cols, Used + Width> fixed(int32_t value) const
+    {
+        static_assert(Used + Width <= Cols, "field does not fit the row");
+        static_assert(Width > (Decimals ? Decimals + 1 : 0), "field too narrow for its decimals");
+        static_assert(Decimals < 10, "too many decimals");
+
+        // Digits from the last one, then the sign
+        char reversed[12];
+        unsigned n = 0;
+        uint32_t magnitude = value < 0 ? 0u - uint32_t(value) : uint32_t(value);
+        do {
+            if (Decimals && n == Decimals) {
+                reversed[n++] = '.';
+            }
+            reversed[n++] = char('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude || n <= Decimals);
+        if (value < 0) {
+            reversed[n++] = '-';
+        }
+
+        char *field = _row + Used;
+        for (unsigned i = 0; i < Width; i++) {
+            if (n > Width) {
+                field[i] = '#';
+            } else {
+                field[i] = i < Width - n ? ' ' : reversed[Width - 1 - i];
+            }
+        }
+        return LcdText<Cols, Used + Width>(_row);
+    }
+
+    /// Fill the rest of the row with spaces.
+    void end() const
+    {
+        for (unsigned i = Used; i < Cols; i++) {
+            _row[i] = ' ';
+        }
+    }
+
+private:
+    char *_row;
+};
+
+#endif
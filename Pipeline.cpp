@@ -0,0 +1,27 @@
+#include "Pipeline.h"
+
+StageStats stage_stats[STAGE_COUNT];
+StageHook stage_hook = nullptr;
+
+const char *stage_name(Stage stage)
+{
+    static const char *const names[STAGE_COUNT] = {"acquire", "filter", "evaluate", "render"};
+    return stage < STAGE_COUNT ? names[stage] : "?";
+}
+
+void stage_done(Stage stage, uint32_t start_us)
+{
+    uint32_t end_us = us_ticker_read();
+    uint32_t elapsed = end_us - start_us;
+
+    StageStats &stats = stage_stats[stage];
+    stats.runs++;
+    stats.total_us += elapsed;
+    if (elapsed > stats.max_us) {
+        stats.max_us = elapsed;
+    }
+
+    if (stage_hook) {
+        stage_hook(stage, start_us, end_us);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "mbed.h"
+
+/** Stages of the sampling pipeline, in the order a sample goes through them. */
+enum Stage {
+    /// Sensor transaction, from the request to the sample
+    STAGE_ACQUIRE,
+    /// Validation and filtering of the sample into a reading
+    STAGE_FILTER,
+    /// Threshold comparison and siren control
+    STAGE_EVALUATE,
+    /// LCD update
+    STAGE_RENDER,
+    STAGE_COUNT
+};
+
+/** Run time of one stage, in us_ticker microseconds. */
+struct StageStats {
+    uint32_t runs;
+    uint64_t total_us;
+    uint32_t max_us;
+};
+
+/** Called each time a stage finishes.
+ *
+ * @param stage Stage that ran.
+ * @param start_us us_ticker time the stage started.
+ * @param end_us us_ticker time the stage finished.
+ */
+typedef void (*StageHook)(Stage stage, uint32_t start_us, uint32_t end_us);
+
+/// Run time of every stage so far.
+extern StageStats stage_stats[STAGE_COUNT];
+
+/// Instrumentation hook, or null; set it before the pipeline starts.
+extern StageHook stage_hook;
+
+/// Short name of @p stage.
+const char *stage_name(Stage stage);
+
+/** Record that @p stage finished now and pass it to the hook.
+ *
+ * Each stage must be timed from a single thread.
+ *
+ * @param stage Stage that ran.
+ * @param start_us us_ticker time the stage started.
+ */
+void stage_done(Stage stage, uint32_t start_us);
+
+#endif
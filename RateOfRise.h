@@ -0,0 +1,121 @@
+#ifndef RATE_OF_RISE_H
+#define RATE_OF_RISE_H
+
+#include <stdint.h>
+
+/** Least-squares slope of the last N timestamped samples, updated in O(1).
+ *
+ * Keeps the window in a ring buffer together with the regression sums. Times
+ * are kept relative to the oldest sample in the window, so the sums stay
+ * small and exact in 64-bit integers; moving the window shifts them with a
+ * few multiplications instead of a pass over the samples.
+ *
+ * @tparam N Window length in samples.
+ */
+template <unsigned N>
+class RateOfRise
+{
+    static_assert(N >= 2 && N <= 256, "window must hold 2 to 256 samples");
+
+public:
+    RateOfRise() { reset(); }
+
+    /// Forget every sample.
+    void reset()
+    {
+        _count = 0;
+        _oldest = 0;
+        _sum_t = _sum_y = _sum_tt = _sum_ty = 0;
+    }
+
+    /** Add a sample, dropping the oldest one once the window is full.
+     *
+     * @param time_ms Sample time in milliseconds; wraps like any tick count.
+     * @param value Sample value in any fixed-point unit.
+     */
+    void add(uint32_t time_ms, int32_t value)
+    {
+        if (_count == N) {
+            // Drop the oldest sample, then measure times from the next one
+            const Sample &old = _samples[_oldest];
+            int64_t t = int64_t(old.time_ms - _base_ms);
+            remove(t, old.value);
+            _oldest = (_oldest + 1) % N;
+            _count--;
+            rebase(_samples[_oldest].time_ms);
+        } else if (_count == 0) {
+            _base_ms = time_ms;
+        }
+
+        _samples[(_oldest + _count) % N] = Sample{time_ms, value};
+        _count++;
+        int64_t t = int64_t(time_ms - _base_ms);
+        _sum_t += t;
+        _sum_y += value;
+        _sum_tt += t * t;
+        _sum_ty += t * value;
+    }
+
+    /// Samples in the window.
+    unsigned count() const { return _count; }
+
+    /// True once the window is full.
+    bool full() const { return _count == N; }
+
+    /// Time between the oldest and the newest sample, in milliseconds.
+    uint32_t span_ms() const
+    {
+        return _count ? _samples[(_oldest + _count - 1) % N].time_ms - _base_ms : 0;
+    }
+
+    /** Slope of the window in value units per minute, rounded towards zero.
+     *
+     * @returns 0 until there are two samples at different times.
+     */
+    int32_t per_minute() const
+    {
+        int64_t n = _count;
+        int64_t den = n * _sum_tt - _sum_t * _sum_t;
+        if (n < 2 || den <= 0) {
+            return 0;
+        }
+        int64_t num = n * _sum_ty - _sum_t * _sum_y;
+        return int32_t(num * 60000 / den);
+    }
+
+private:
+    struct Sample {
+        uint32_t time_ms;
+        int32_t value;
+    };
+
+    void remove(int64_t t, int32_t value)
+    {
+        _sum_t -= t;
+        _sum_y -= value;
+        _sum_tt -= t * t;
+        _sum_ty -= t * value;
+    }
+
+    // Measure times from @p base_ms: every t becomes t - d
+    void rebase(uint32_t base_ms)
+    {
+        int64_t d = int64_t(base_ms - _base_ms);
+        int64_t n = _count;
+        _sum_tt += n * d * d - 2 * d * _sum_t;
+        _sum_ty -= d * _sum_y;
+        _sum_t -= n * d;
+        _base_ms = base_ms;
+    }
+
+    Sample _samples[N];
+    unsigned _count;
+    unsigned _oldest;
+    uint32_t _base_ms;
+    int64_t _sum_t;
+    int64_t _sum_y;
+    int64_t _sum_tt;
+    int64_t _sum_ty;
+};
+
+#endif
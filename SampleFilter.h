@@ -0,0 +1,139 @@
+#ifndef SAMPLE_FILTER_H
+#define SAMPLE_FILTER_H
+
+#include <stdint.h>
+
+/** Running median of the last N samples.
+ *
+ * Drops isolated outliers while passing real steps through after (N - 1) / 2
+ * samples, so a median of 3 removes any single bad sample for one sample of
+ * latency. The window is kept sorted: the slot of the sample that leaves and
+ * of the one that arrives are found by binary search, and at most N values
+ * move.
+ *
+ * @tparam N Window length, odd.
+ */
+template <unsigned N>
+class MedianFilter
+{
+    static_assert(N % 2 == 1, "median window must be odd");
+
+public:
+    MedianFilter() { reset(); }
+
+    /// Forget every sample.
+    void reset()
+    {
+        _count = 0;
+        _next = 0;
+    }
+
+    /** Add a sample.
+     *
+     * @returns the median of the window; of the samples so far until it is full.
+     */
+    int32_t update(int32_t value)
+    {
+        if (_count == N) {
+            erase(_window[_next]);
+        } else {
+            _count++;
+        }
+        insert(value);
+        _window[_next] = value;
+        _next = (_next + 1) % N;
+        return _sorted[(_count - 1) / 2];
+    }
+
+    /// True once the window is full. Until then a single bad sample can be the median.
+    bool settled() const { return _count == N; }
+
+private:
+    // First slot of _sorted whose value is not less than @p value
+    unsigned lower_bound(int32_t value, unsigned size) const
+    {
+        unsigned lo = 0;
+        unsigned hi = size;
+        while (lo < hi) {
+            unsigned mid = (lo + hi) / 2;
+            if (_sorted[mid] < value) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    void erase(int32_t value)
+    {
+        for (unsigned i = lower_bound(value, N); i + 1 < N; i++) {
+            _sorted[i] = _sorted[i + 1];
+        }
+    }
+
+    // Inserts into the first _count - 1 sorted slots
+    void insert(int32_t value)
+    {
+        unsigned at = lower_bound(value, _count - 1);
+        for (unsigned i = _count - 1; i > at; i--) {
+            _sorted[i] = _sorted[i - 1];
+        }
+        _sorted[at] = value;
+    }
+
+    int32_t _window[N];
+    int32_t _sorted[N];
+    unsigned _count;
+    unsigned _next;
+};
+
+/** Exponential moving average with a weight of 1 / 2^Shift.
+ *
+ * Smooths noise at O(1) with no multiplications. It does not reject outliers;
+ * put it after a MedianFilter for that. Its output lags a step by about 2^Shift
+ * samples.
+ *
+ * @tparam Shift Weight of the newest sample as a power of two.
+ */
+template <unsigned Shift>
+class EmaFilter
+{
+    static_assert(Shift < 16, "shift too large");
+
+public:
+    EmaFilter() { reset(); }
+
+    /// Forget every sample.
+    void reset() { _primed = false; }
+
+    /// Add a sample; returns the rounded average.
+    int32_t update(int32_t value)
+    {
+        if (!_primed) {
+            _sum = int64_t(value) << Shift;
+            _primed = true;
+        } else {
+            _sum += value - ((_sum + (1 << Shift >> 1)) >> Shift);
+        }
+        return int32_t((_sum + (1 << Shift >> 1)) >> Shift);
+    }
+
+    /// True once a sample has been added.
+    bool settled() const { return _primed; }
+
+private:
+    int64_t _sum;
+    bool _primed;
+};
+
+/** Passes samples through unchanged; for channels that need no filtering. */
+class NoFilter
+{
+public:
+    void reset() {}
+    int32_t update(int32_t value) { return value; }
+    bool settled() const { return true; }
+};
+
+#endif
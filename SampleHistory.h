@@ -0,0 +1,276 @@
+#ifndef SAMPLE_HISTORY_H
+#define SAMPLE_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Temperature.h"
+
+// RAM kept for the reading history of the firmware; about 6 hours of steady readings at 1.1 s
+// fit in 8 KB
+#ifndef HISTORY_BYTES
+#define HISTORY_BYTES (8 * 1024)
+#endif
+
+/** One reading as kept by SampleHistory. */
+struct HistorySample {
+    /// Kernel clock time, to the nearest sample period after the first of its block
+    uint32_t time_ms;
+    /// Temperature in tenths of a degree celsius
+    Tenths celsius;
+    /// Humidity in percent
+    uint8_t humidity;
+};
+
+/** Hours of readings in a fixed amount of RAM.
+ *
+ * Readings are packed into blocks. The first reading of a block is kept whole
+ * in its header, as a keyframe. Every later one is three exponential-Golomb
+ * codes: the sample periods since the previous reading less one, and the
+ * zig-zag changes of temperature and humidity. A DHT-11 reading seldom
+ * changes, so a sample usually takes 3 bits, against 8 bytes for a
+ * HistorySample.
+ *
+ * append() is O(1): it adds bits to the newest block, or starts a new block,
+ * evicting the oldest one once every block is in use. Queries only decode
+ * the blocks whose time span overlaps the range asked for.
+ *
+ * Not thread safe: append and query from one thread.
+ *
+ * @tparam Bytes Memory budget, a whole number of blocks.
+ * @tparam BlockBytes Size of a block, its header included.
+ */
+template <size_t Bytes, size_t BlockBytes = 128>
+class SampleHistory
+{
+    static_assert(BlockBytes >= 32 && BlockBytes <= 4096, "blocks must be 32 to 4096 bytes");
+    static_assert(Bytes % BlockBytes == 0 && Bytes / BlockBytes >= 2, "budget must be two or more whole blocks");
+
+public:
+    /// Blocks in the budget.
+    static const size_t BLOCKS = Bytes / BlockBytes;
+
+    /// @param period_ms Nominal time between readings, the unit of the time codes.
+    explicit SampleHistory(uint32_t period_ms) : _period_ms(period_ms) { clear(); }
+
+    /// Forget every reading.
+    void clear()
+    {
+        _first = 0;
+        _count = 0;
+        _samples = 0;
+        _evicted = 0;
+    }
+
+    /// Add a reading made at @p time_ms, later than the previous one.
+    void append(uint32_t time_ms, Tenths celsius, int humidity)
+    {
+        if (_count > 0) {
+            Block &b = _blocks[(_first + _count - 1) % BLOCKS];
+
+            // Times are kept in whole periods from the previous reading as decoded, so the
+            // error never grows beyond half a period
+            uint32_t steps = (time_ms - _last_ms + _period_ms / 2) / _period_ms;
+            if (steps == 0) {
+                steps = 1;
+            }
+            uint32_t dt = zigzag(int32_t(celsius) - _last_celsius);
+            uint32_t dh = zigzag(humidity - _last_humidity);
+            unsigned bits = code_bits(steps - 1) + code_bits(dt) + code_bits(dh);
+            if (steps <= CODE_MAX && dt <= CODE_MAX && dh <= CODE_MAX &&
+                b.bits + bits <= DATA_BITS) {
+                put_code(b, steps - 1);
+                put_code(b, dt);
+                put_code(b, dh);
+                b.count++;
+                _last_ms += steps * _period_ms;
+                b.last_ms = _last_ms;
+                _last_celsius = celsius;
+                _last_humidity = humidity;
+                _samples++;
+                return;
+            }
+        }
+
+        // The newest block is full, or the change is too large to code: start a keyframe
+        if (_count == BLOCKS) {
+            _samples -= _blocks[_first % BLOCKS].count;
+            _evicted++;
+            _first++;
+            _count--;
+        }
+        Block &b = _blocks[(_first + _count) % BLOCKS];
+        _count++;
+        b.first_ms = b.last_ms = time_ms;
+        b.celsius = celsius;
+        b.humidity = uint8_t(humidity);
+        b.count = 1;
+        b.bits = 0;
+        for (size_t i = 0; i < DATA_BYTES; i++) {
+            b.data[i] = 0;
+        }
+        _last_ms = time_ms;
+        _last_celsius = celsius;
+        _last_humidity = humidity;
+        _samples++;
+    }
+
+    /** Call @p visit with every reading from @p from_ms to @p to_ms, oldest first.
+     *
+     * Times compare as tick counts that may wrap, so the range must be shorter
+     * than half the range of a uint32_t.
+     *
+     * @param visit Called as visit(const HistorySample &).
+     * @returns The number of readings visited.
+     */
+    template <typename F>
+    size_t query(uint32_t from_ms, uint32_t to_ms, F &&visit) const
+    {
+        size_t visited = 0;
+        uint32_t span = to_ms - from_ms;
+        for (uint32_t block = first_block(); block != end_block(); block++) {
+            const Block &b = _blocks[block % BLOCKS];
+            if (int32_t(b.last_ms - from_ms) < 0 || int32_t(b.first_ms - to_ms) > 0) {
+                continue;
+            }
+            decode(b, 0, b.count, [&](const HistorySample &sample) {
+                if (sample.time_ms - from_ms <= span) {
+                    visit(sample);
+                    visited++;
+                }
+            });
+        }
+        return visited;
+    }
+
+    /** Call @p visit with up to @p max readings of @p block, starting after @p skip of them.
+     *
+     * Blocks are numbered from 0 at the first one ever started, so a number stays
+     * valid, or falls below first_block(), as blocks are added and evicted.
+     *
+     * @returns The number of readings visited; 0 past the end or for an evicted block.
+     */
+    template <typename F>
+    unsigned read_block(uint32_t block, unsigned skip, unsigned max, F &&visit) const
+    {
+        if (block - first_block() >= _count) {
+            return 0;
+        }
+        return decode(_blocks[block % BLOCKS], skip, max, visit);
+    }
+
+    /// Number of the oldest block held.
+    uint32_t first_block() const { return _first; }
+
+    /// One more than the number of the newest block.
+    uint32_t end_block() const { return _first + _count; }
+
+    /// Readings held.
+    uint32_t samples() const { return _samples; }
+
+    /// Bytes of the budget in use.
+    size_t bytes() const { return _count * BlockBytes; }
+
+    /// Blocks evicted to make room so far.
+    uint32_t evicted() const { return _evicted; }
+
+    /// Time of the oldest reading held; 0 if none.
+    uint32_t oldest_ms() const { return _count ? _blocks[_first % BLOCKS].first_ms : 0; }
+
+    /// Time of the newest reading held; 0 if none.
+    uint32_t newest_ms() const { return _count ? _last_ms : 0; }
+
+private:
+    struct Block {
+        uint32_t first_ms; // Keyframe time
+        uint32_t last_ms; // Time of the last reading coded
+        int16_t celsius; // Keyframe readings
+        uint8_t humidity;
+        uint8_t reserved;
+        uint16_t count; // Readings, the keyframe included
+        uint16_t bits; // Bits of data used
+        uint8_t data[BlockBytes - 16];
+    };
+
+    static_assert(sizeof(Block) == BlockBytes, "blocks must have no padding");
+
+    static const size_t DATA_BYTES = BlockBytes - 16;
+    static const unsigned DATA_BITS = DATA_BYTES * 8;
+
+    // Largest value coded; anything larger starts a keyframe
+    static const uint32_t CODE_MAX = 0xFFFF;
+
+    static uint32_t zigzag(int32_t value) { return (uint32_t(value) << 1) ^ uint32_t(value >> 31); }
+    static int32_t unzigzag(uint32_t value) { return int32_t(value >> 1) ^ -int32_t(value & 1); }
+
+    // Length of the exponential-Golomb code of @p value: n zeros and the n + 1 bits of value + 1
+    static unsigned code_bits(uint32_t value)
+    {
+        unsigned n = 0;
+        while ((value + 1) >> (n + 1)) {
+            n++;
+        }
+        return 2 * n + 1;
+    }
+
+    static void put_code(Block &b, uint32_t value)
+    {
+        uint32_t v = value + 1;
+        unsigned n = code_bits(value) / 2;
+        b.bits += n; // Leading zeros, already clear
+        for (int i = int(n); i >= 0; i--) {
+            if ((v >> i) & 1) {
+                b.data[b.bits / 8] |= uint8_t(1u << (b.bits % 8));
+            }
+            b.bits++;
+        }
+    }
+
+    static uint32_t get_code(const Block &b, unsigned &at)
+    {
+        unsigned n = 0;
+        while (!((b.data[at / 8] >> (at % 8)) & 1)) {
+            n++;
+            at++;
+        }
+        uint32_t v = 0;
+        for (unsigned i = 0; i <= n; i++, at++) {
+            v = (v << 1) | ((b.data[at / 8] >> (at % 8)) & 1);
+        }
+        return v - 1;
+    }
+
+    // Decode readings of @p b after the first @p skip, up to @p max of them
+    template <typename F>
+    unsigned decode(const Block &b, unsigned skip, unsigned max, F &&visit) const
+    {
+        HistorySample sample = { b.first_ms, b.celsius, b.humidity };
+        unsigned at = 0;
+        unsigned visited = 0;
+        for (unsigned i = 0; i < b.count && visited < max; i++) {
+            if (i > 0) {
+                sample.time_ms += (get_code(b, at) + 1) * _period_ms;
+                sample.celsius = Tenths(sample.celsius + unzigzag(get_code(b, at)));
+                sample.humidity = uint8_t(sample.humidity + unzigzag(get_code(b, at)));
+            }
+            if (i >= skip) {
+                visit(sample);
+                visited++;
+            }
+        }
+        return visited;
+    }
+
+    uint32_t _period_ms;
+    Block _blocks[BLOCKS];
+    uint32_t _first; // Number of the oldest block
+    uint32_t _count; // Blocks in use, the newest one open
+    uint32_t _samples;
+    uint32_t _evicted;
+
+    // Last reading appended, as decoded
+    uint32_t _last_ms;
+    int32_t _last_celsius;
+    int _last_humidity;
+};
+
+#endif
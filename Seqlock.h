@@ -0,0 +1,60 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include "mbed.h"
+
+/** Latest value of a variable, published by one writer to any number of readers.
+ *
+ * The writer never waits and readers never lock: a reader copies the value
+ * and retries if the sequence number shows that a write overlapped the copy.
+ * Suited to small values that are written far more rarely than they are read.
+ *
+ * @tparam T Value type, copied in and out.
+ */
+template <typename T>
+class Seqlock
+{
+public:
+    Seqlock() : _sequence(0), _value() {}
+
+    /// Start with @p value, which is not counted as a write.
+    explicit Seqlock(const T &value) : _sequence(0), _value(value) {}
+
+    /// Publish a new value; one writer only.
+    void write(const T &value)
+    {
+        unsigned sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _value = value;
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /// A consistent copy of the latest value.
+    T read() const
+    {
+        for (;;) {
+            unsigned before = _sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                // The writer was preempted mid-write; let it finish
+                ThisThread::yield();
+                continue;
+            }
+            T value = _value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_sequence.load(std::memory_order_relaxed) == before) {
+                return value;
+            }
+        }
+    }
+
+    /// Number of values written so far.
+    unsigned writes() const { return _sequence.load(std::memory_order_acquire) / 2; }
+
+private:
+    std::atomic<unsigned> _sequence;
+    T _value;
+};
+
+#endif
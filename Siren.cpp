@@ -0,0 +1,48 @@
+#include "Siren.h"
+#include "Trace.h"
+
+Siren::Siren(PinName buzzer, PinName led) : _buzzer(buzzer), _led(led), _pattern(nullptr), _step(0), _period_us(0)
+{
+    _buzzer.write(0.0f);
+}
+
+void Siren::play(const TonePattern &pattern, bool led)
+{
+    core_util_critical_section_enter();
+    if (_pattern != &pattern) {
+        _next.detach();
+        _pattern = &pattern;
+        _step = 0;
+        step();
+    }
+    _led = led;
+    core_util_critical_section_exit();
+}
+
+void Siren::stop()
+{
+    core_util_critical_section_enter();
+    if (_pattern) {
+        _pattern = nullptr;
+        _next.detach();
+        _buzzer.pulsewidth_us(0);
+        _led = 0;
+    }
+    core_util_critical_section_exit();
+}
+
+// Plays one step of the pattern and schedules the next; runs from the Timeout
+void Siren::step()
+{
+    TRACE_SCOPE(TRACE_SIREN_STEP);
+    const ToneStep &step = _pattern->steps[_step];
+    _step = (_step + 1) % _pattern->count;
+
+    // The PWM period is only reprogrammed when the pitch changes
+    if (step.period_us && step.period_us != _period_us) {
+        _period_us = step.period_us;
+        _buzzer.period_us(step.period_us);
+    }
+    _buzzer.pulsewidth_us(step.pulse_us);
+    _next.attach(callback(this, &Siren::step), std::chrono::microseconds(step.duration_us));
+}
@@ -0,0 +1,59 @@
+#ifndef SIREN_H
+#define SIREN_H
+
+#include "mbed.h"
+#include "TonePatterns.h"
+
+/** Alarm sound on a PWM buzzer and an LED, played in the background.
+ *
+ * Plays a TonePattern over and over until stop(). Every step runs from a
+ * Timeout and only copies precomputed integer periods into the PWM, so play()
+ * and stop() return at once and nothing on the alarm path does floating-point
+ * work.
+ *
+ * Example:
+ * @code
+ * Siren siren(PD_14, PD_7);
+ *
+ * if (alarm) {
+ *     siren.play(tones::TEMPORAL_3, true);
+ * } else {
+ *     siren.stop();
+ * }
+ * @endcode
+ */
+class Siren
+{
+public:
+    /** Create a silent siren.
+     *
+     * @param buzzer PWM pin of the buzzer.
+     * @param led Pin of the alarm LED.
+     */
+    Siren(PinName buzzer, PinName led);
+
+    /** Start playing @p pattern; does nothing if it is already playing.
+     *
+     * @param pattern Pattern to repeat, kept by reference.
+     * @param led True to light the LED while it plays.
+     */
+    void play(const TonePattern &pattern, bool led);
+
+    /// Silence the buzzer and turn the LED off.
+    void stop();
+
+    /// True between play() and stop().
+    bool sounding() const { return _pattern != nullptr; }
+
+private:
+    void step();
+
+    PwmOut _buzzer;
+    DigitalOut _led;
+    Timeout _next;
+    const TonePattern *volatile _pattern;
+    unsigned _step;
+    uint16_t _period_us;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+
+/** Lock-free ring buffer for one producer and one consumer.
+ *
+ * The producer is typically an interrupt handler and the consumer a thread.
+ * Neither side allocates, blocks or disables interrupts: each index is written
+ * by one side only, and the release/acquire pair on it publishes the slot.
+ *
+ * @tparam T Element type, copied in and out.
+ * @tparam N Capacity, a power of two.
+ */
+template <typename T, unsigned N>
+class SpscRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    SpscRing() : _head(0), _tail(0), _dropped(0) {}
+
+    /** Add an element; producer side only.
+     *
+     * @returns false, counting the element as dropped, if the ring is full.
+     */
+    bool push(const T &value)
+    {
+        unsigned tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == N) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _items[tail % N] = value;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Take the oldest element; consumer side only.
+     *
+     * @returns false if the ring is empty.
+     */
+    bool pop(T &value)
+    {
+        unsigned head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = _items[head % N];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// True if there is nothing to pop.
+    bool empty() const
+    {
+        return _head.load(std::memory_order_acquire) ==
+               _tail.load(std::memory_order_acquire);
+    }
+
+    /// Elements push() had to drop because the ring was full.
+    unsigned dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    T _items[N];
+    std::atomic<unsigned> _head;
+    std::atomic<unsigned> _tail;
+    std::atomic<unsigned> _dropped;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "Telemetry.h"
+
+static_assert((TELEMETRY_QUEUE & (TELEMETRY_QUEUE - 1)) == 0, "TELEMETRY_QUEUE must be a power of two");
+static_assert(TELEMETRY_BATCH >= 1 && TELEMETRY_BATCH <= 255, "a frame counts its readings in one byte");
+
+static uint8_t *put16(uint8_t *p, uint16_t value)
+{
+    p[0] = uint8_t(value);
+    p[1] = uint8_t(value >> 8);
+    return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value)
+{
+    return put16(put16(p, uint16_t(value)), uint16_t(value >> 16));
+}
+
+TelemetryLink::TelemetryLink(FileHandle &out)
+    : _out(out), _batched(0), _urgent(false), _last_level(0), _length(0), _sent(0),
+      _frame_samples(0), _sequence(0), _reported_lost(0), _frames(0), _samples(0)
+{
+}
+
+bool TelemetryLink::post(const TelemetrySample &sample)
+{
+    return _queue.push(sample);
+}
+
+void TelemetryLink::poll()
+{
+    for (;;) {
+        // Finish the frame in progress first; what does not fit waits for the next call
+        if (_sent < _length) {
+            ssize_t n = _out.write(_frame + _sent, _length - _sent);
+            if (n <= 0) {
+                return;
+            }
+            _sent += size_t(n);
+            if (_sent < _length) {
+                return;
+            }
+            _frames++;
+            _samples += _frame_samples;
+        }
+
+        TelemetrySample sample;
+        while (_batched < TELEMETRY_BATCH && _queue.pop(sample)) {
+            if (sample.level != _last_level) {
+                _urgent = true;
+                _last_level = sample.level;
+            }
+            _batch[_batched++] = sample;
+        }
+        if (_batched == 0) {
+            return;
+        }
+        uint32_t now = uint32_t(Kernel::Clock::now().time_since_epoch().count());
+        if (_batched < TELEMETRY_BATCH && !_urgent && now - _batch[0].time_ms < TELEMETRY_MAX_AGE_MS) {
+            return;
+        }
+        build();
+    }
+}
+
+void TelemetryLink::build()
+{
+    unsigned total = lost();
+    unsigned since = total - _reported_lost;
+    _reported_lost = total;
+
+    uint8_t *p = _frame;
+    *p++ = TELEMETRY_SYNC0;
+    *p++ = TELEMETRY_SYNC1;
+    *p++ = TELEMETRY_VERSION;
+    *p++ = uint8_t(_batched);
+    p = put16(p, _sequence++);
+    p = put16(p, uint16_t(since > 0xFFFF ? 0xFFFF : since));
+    for (unsigned i = 0; i < _batched; i++) {
+        const TelemetrySample &s = _batch[i];
+        p = put32(p, s.time_ms);
+        p = put16(p, uint16_t(s.celsius));
+        p = put16(p, uint16_t(s.rise));
+        *p++ = s.humidity;
+        *p++ = s.level;
+        *p++ = uint8_t(s.status);
+        *p++ = s.failures;
+    }
+
+    // The sync bytes are left out of the CRC
+    MbedCRC<POLY_32BIT_ANSI, 32> engine;
+    uint32_t crc = 0;
+    engine.compute(_frame + 2, size_t(p - _frame - 2), &crc);
+    p = put32(p, crc);
+
+    _length = size_t(p - _frame);
+    _sent = 0;
+    _frame_samples = _batched;
+    _batched = 0;
+    _urgent = false;
+}
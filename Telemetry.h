@@ -0,0 +1,130 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "mbed.h"
+#include "SpscRing.h"
+#include "Temperature.h"
+
+// Readings sent in one frame at most
+#define TELEMETRY_BATCH 8
+
+// Readings that can wait for the sender, a power of two
+#define TELEMETRY_QUEUE 32
+
+// Longest a reading waits for the rest of its batch
+#define TELEMETRY_MAX_AGE_MS 10000
+
+// First two bytes of every frame
+#define TELEMETRY_SYNC0 0xA5
+#define TELEMETRY_SYNC1 0x5A
+
+// Frame layout; a receiver drops any other version
+#define TELEMETRY_VERSION 1
+
+// Bytes of the frame header: sync, version, count, sequence and lost
+#define TELEMETRY_HEADER_SIZE 8
+
+// Bytes of one reading in a frame
+#define TELEMETRY_SAMPLE_SIZE 12
+
+// Bytes of the CRC that ends a frame
+#define TELEMETRY_CRC_SIZE 4
+
+#define TELEMETRY_FRAME_MAX (TELEMETRY_HEADER_SIZE + TELEMETRY_BATCH * TELEMETRY_SAMPLE_SIZE + TELEMETRY_CRC_SIZE)
+
+/** One reading with the alarm state it led to. */
+struct TelemetrySample {
+    /// Kernel clock time of the read
+    uint32_t time_ms;
+    /// Temperature in tenths of a degree celsius
+    Tenths celsius;
+    /// Rate of rise in tenths of a degree celsius per minute
+    int16_t rise;
+    /// Humidity in percent
+    uint8_t humidity;
+    /// AlarmLevel
+    uint8_t level;
+    /// DHTLIB status of the read
+    int8_t status;
+    /// Failed reads in a row
+    uint8_t failures;
+};
+
+/** Readings and alarm state sent as framed binary over a UART.
+ *
+ * A frame carries 1 to TELEMETRY_BATCH readings, all little-endian:
+ *
+ *     offset  size  field
+ *     0       2     TELEMETRY_SYNC0, TELEMETRY_SYNC1
+ *     2       1     TELEMETRY_VERSION
+ *     3       1     readings in the frame, n
+ *     4       2     sequence number, one more than the frame before
+ *     6       2     readings lost to a full queue since the frame before
+ *     8       12n   readings: u32 time_ms, i16 celsius tenths, i16 rise,
+ *                   u8 humidity, u8 level, i8 status, u8 failures
+ *     8+12n   4     CRC-32 of bytes 2 to 8+12n, as MbedCRC<POLY_32BIT_ANSI, 32>
+ *
+ * A receiver finds frames by the sync bytes and the CRC, and detects lost
+ * frames from gaps in the sequence numbers.
+ *
+ * The header and CRC of a frame take as many bytes as a reading, so readings
+ * wait in a bounded SpscRing until a batch is due: when it is full, when the
+ * alarm level changes, or when its first reading is TELEMETRY_MAX_AGE_MS old.
+ * A full ring drops the reading and counts it, and the next frame reports the
+ * count, so the controller learns of the gap instead of the detector waiting
+ * on the UART.
+ *
+ * poll() owns the port. The port is non-blocking, so a frame that does not
+ * fit in the transmit buffer is kept and its tail written on later calls;
+ * a new frame is only built once the last one is out.
+ *
+ * Only the check thread posts, and only the print thread polls.
+ */
+class TelemetryLink
+{
+public:
+    /// @param out Serial port in non-blocking mode.
+    explicit TelemetryLink(FileHandle &out);
+
+    /** Queue a reading; never blocks.
+     *
+     * @returns false, counting it as lost, if the queue is full.
+     */
+    bool post(const TelemetrySample &sample);
+
+    /// Send what is due; never blocks.
+    void poll();
+
+    /// Frames sent in full.
+    uint32_t frames() const { return _frames; }
+
+    /// Readings sent in full frames.
+    uint32_t samples() const { return _samples; }
+
+    /// Readings lost because the queue was full.
+    uint32_t lost() const { return _queue.dropped(); }
+
+private:
+    // Encode the batch as the next frame and empty it
+    void build();
+
+    FileHandle &_out;
+    SpscRing<TelemetrySample, TELEMETRY_QUEUE> _queue;
+    TelemetrySample _batch[TELEMETRY_BATCH];
+    unsigned _batched;
+    bool _urgent;
+    uint8_t _last_level; // Level of the last reading batched
+
+    // Frame being sent
+    uint8_t _frame[TELEMETRY_FRAME_MAX];
+    size_t _length;
+    size_t _sent;
+    unsigned _frame_samples;
+
+    uint16_t _sequence;
+    unsigned _reported_lost; // lost() when the last frame was built
+    uint32_t _frames;
+    uint32_t _samples;
+};
+
+#endif
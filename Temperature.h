@@ -0,0 +1,56 @@
+#ifndef TEMPERATURE_H
+#define TEMPERATURE_H
+
+#include <stdint.h>
+
+/** Temperature in tenths of a degree, in whichever unit the name says.
+ *
+ * Covers -3276.8 to 3276.7 degrees, far beyond any sensor used here, and
+ * keeps every conversion in integer math.
+ */
+typedef int16_t Tenths;
+
+namespace temperature {
+
+/// @p num / @p den rounded down, also for negative numerators.
+constexpr int32_t floor_div(int32_t num, int32_t den)
+{
+    return num >= 0 ? num / den : -((-num + den - 1) / den);
+}
+
+/// @p num / @p den rounded to the nearest integer, halves away from zero.
+constexpr int32_t round_div(int32_t num, int32_t den)
+{
+    return num >= 0 ? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+/// Whole degrees to tenths.
+constexpr Tenths from_whole(int32_t degrees)
+{
+    return Tenths(degrees * 10);
+}
+
+/// Celsius to fahrenheit, rounded to the nearest tenth.
+constexpr Tenths to_fahrenheit(Tenths celsius)
+{
+    return Tenths(round_div(int32_t(celsius) * 9, 5) + 320);
+}
+
+/** Fahrenheit in hundredths to celsius tenths, rounded down.
+ *
+ * Rounding down keeps comparisons exact: a reading r in tenths is above the
+ * fahrenheit threshold exactly when it is above the result.
+ */
+constexpr Tenths from_fahrenheit_hundredths(int32_t fahrenheit)
+{
+    return Tenths(floor_div(fahrenheit - 3200, 18));
+}
+
+static_assert(to_fahrenheit(220) == 716, "22.0 C is 71.6 F");
+static_assert(to_fahrenheit(-400) == -400, "-40 C is -40 F");
+static_assert(from_fahrenheit_hundredths(8550) == 297, "85.5 F is above 29.7 C");
+static_assert(from_fahrenheit_hundredths(3200) == 0, "32 F is 0 C");
+
+} // namespace temperature
+
+#endif
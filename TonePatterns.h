@@ -0,0 +1,95 @@
+#ifndef TONE_PATTERNS_H
+#define TONE_PATTERNS_H
+
+#include <stdint.h>
+
+/** One step of a tone pattern: a PWM setting held for a while. */
+struct ToneStep {
+    /// PWM period in microseconds, or 0 for silence
+    uint16_t period_us;
+    /// PWM pulse width in microseconds
+    uint16_t pulse_us;
+    /// Time the step is held
+    uint32_t duration_us;
+};
+
+/** A repeating tone pattern: a table of steps in flash. */
+struct TonePattern {
+    const ToneStep *steps;
+    uint16_t count;
+};
+
+/** Fixed-size step table, filled in at compile time by the generators below. */
+template <unsigned N>
+struct ToneTable {
+    static constexpr unsigned size = N;
+    ToneStep steps[N];
+
+    constexpr TonePattern pattern() const { return TonePattern{steps, N}; }
+};
+
+namespace tones {
+
+/// Square wave at @p hz held for @p duration_us.
+constexpr ToneStep tone(uint32_t hz, uint32_t duration_us)
+{
+    return ToneStep{uint16_t(1000000 / hz), uint16_t(1000000 / hz / 2), duration_us};
+}
+
+/// Silence held for @p duration_us.
+constexpr ToneStep rest(uint32_t duration_us)
+{
+    return ToneStep{0, 0, duration_us};
+}
+
+/** Beeps tones of @p hz, @p on_us long and @p off_us apart. The last beep is
+ * followed by @p gap_us of silence before the pattern repeats.
+ */
+template <unsigned Beeps>
+constexpr ToneTable<2 * Beeps> beeps(uint32_t hz, uint32_t on_us, uint32_t off_us, uint32_t gap_us)
+{
+    ToneTable<2 * Beeps> table{};
+    for (unsigned i = 0; i < Beeps; i++) {
+        table.steps[2 * i] = tone(hz, on_us);
+        table.steps[2 * i + 1] = rest(i + 1 < Beeps ? off_us : gap_us);
+    }
+    return table;
+}
+
+/** Sweeps from @p Low up to @p High hertz and back down, one hertz every
+ * @p step_us, holding the top tone for another @p hold_us.
+ */
+template <unsigned Low, unsigned High>
+constexpr ToneTable<2 * (High - Low)> sweep(uint32_t step_us, uint32_t hold_us)
+{
+    ToneTable<2 * (High - Low)> table{};
+    for (unsigned i = 0; i < High - Low; i++) {
+        table.steps[i] = tone(Low + i, i + 1 < High - Low ? step_us : step_us + hold_us);
+        table.steps[High - Low + i] = tone(High - i, step_us);
+    }
+    return table;
+}
+
+/// Fire evacuation: three 0.5 s beeps, 0.5 s apart, then 1.5 s off (ISO 8201 / NFPA 72 temporal-3)
+constexpr ToneTable<6> TEMPORAL_3_TABLE = beeps<3>(520, 500000, 500000, 1500000);
+
+/// Pre-alarm: a short chirp every 5 s while the reading nears the threshold
+constexpr ToneTable<2> PRE_ALARM_CHIRP_TABLE = beeps<1>(600, 100000, 0, 4900000);
+
+/// Sensor fault: a double beep every 10 s
+constexpr ToneTable<4> FAULT_BEEP_TABLE = beeps<2>(400, 100000, 100000, 9700000);
+
+/// Siren: 400 to 600 Hz and back, 10 ms per hertz, 2 s at the top
+constexpr ToneTable<400> SWEEP_TABLE = sweep<400, 600>(10000, 2000000);
+
+constexpr TonePattern TEMPORAL_3 = TEMPORAL_3_TABLE.pattern();
+constexpr TonePattern PRE_ALARM_CHIRP = PRE_ALARM_CHIRP_TABLE.pattern();
+constexpr TonePattern FAULT_BEEP = FAULT_BEEP_TABLE.pattern();
+constexpr TonePattern SWEEP = SWEEP_TABLE.pattern();
+
+static_assert(SWEEP_TABLE.steps[0].period_us == 2500, "sweep starts at 400 Hz");
+static_assert(SWEEP_TABLE.steps[199].duration_us == 2010000, "sweep holds its top tone");
+
+} // namespace tones
+
+#endif
@@ -0,0 +1,138 @@
+#include "Trace.h"
+
+#include <string.h>
+
+#if TRACE_ENABLED && defined(__arm__)
+#include "rtx_os.h"
+#endif
+
+// Version of the dump format below
+#define TRACE_FORMAT_VERSION 1
+
+// Bytes of a name in the dump, zero padded
+#define TRACE_NAME_SIZE 16
+
+// Threads listed in a dump
+#define TRACE_MAX_THREADS 8
+
+const char *trace_point_name(TracePoint point)
+{
+    static const char *const names[TRACE_POINT_COUNT] = {
+        "acquire", "dht edge", "dht decode", "filter", "evaluate", "render",
+        "lcd print", "lcd update", "lcd i2c done", "lcd fade", "keypad scan", "siren step",
+    };
+    return point < TRACE_POINT_COUNT ? names[point] : "?";
+}
+
+#if TRACE_ENABLED
+
+TraceRecord trace_ring[TRACE_DEPTH];
+std::atomic<uint32_t> trace_head(0);
+volatile bool trace_paused = false;
+
+static_assert((TRACE_DEPTH & (TRACE_DEPTH - 1)) == 0, "TRACE_DEPTH must be a power of two");
+
+uint32_t trace_context()
+{
+    uint32_t exception = __get_IPSR();
+    if (exception) {
+        return exception;
+    }
+#if defined(__arm__)
+    // osThreadGetId() would be a supervisor call
+    return uint32_t(uintptr_t(osRtxInfo.thread.run.curr));
+#else
+    return uint32_t(uintptr_t(osThreadGetId()));
+#endif
+}
+
+void trace_start()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+// Little-endian writers into a dump buffer
+static char *put16(char *p, uint32_t value)
+{
+    p[0] = char(value);
+    p[1] = char(value >> 8);
+    return p + 2;
+}
+
+static char *put32(char *p, uint32_t value)
+{
+    p = put16(p, value);
+    return put16(p, value >> 16);
+}
+
+static char *put_name(char *p, const char *name)
+{
+    memset(p, 0, TRACE_NAME_SIZE);
+    if (name) {
+        strncpy(p, name, TRACE_NAME_SIZE - 1);
+    }
+    return p + TRACE_NAME_SIZE;
+}
+
+/* Dump format, little-endian:
+ *
+ *   "FATR", u16 version, u16 record size, u32 cycles per second,
+ *   u32 records ever written, u16 records, u16 threads, u16 points, u16 0
+ *   threads: u32 id, char name[16]
+ *   points:  char name[16], in TracePoint order
+ *   records: u32 cycles, u32 context, u16 point, u16 phase, oldest first
+ */
+void trace_dump(FileHandle &out)
+{
+    trace_paused = true;
+    uint32_t head = trace_head.load(std::memory_order_acquire);
+    uint32_t records = head < TRACE_DEPTH ? head : TRACE_DEPTH;
+
+    osThreadId_t ids[TRACE_MAX_THREADS];
+    uint32_t threads = osThreadEnumerate(ids, TRACE_MAX_THREADS);
+
+    char buffer[64];
+    char *p = buffer;
+    memcpy(p, "FATR", 4);
+    p = put16(p + 4, TRACE_FORMAT_VERSION);
+    p = put16(p, 12);
+    p = put32(p, SystemCoreClock);
+    p = put32(p, head);
+    p = put16(p, records);
+    p = put16(p, threads);
+    p = put16(p, TRACE_POINT_COUNT);
+    p = put16(p, 0);
+    out.write(buffer, p - buffer);
+
+    for (uint32_t i = 0; i < threads; i++) {
+        p = put32(buffer, uint32_t(uintptr_t(ids[i])));
+        p = put_name(p, osThreadGetName(ids[i]));
+        out.write(buffer, p - buffer);
+    }
+    for (int i = 0; i < TRACE_POINT_COUNT; i++) {
+        p = put_name(buffer, trace_point_name(TracePoint(i)));
+        out.write(buffer, p - buffer);
+    }
+
+    // Several records per write
+    p = buffer;
+    for (uint32_t i = head - records; i != head; i++) {
+        const TraceRecord &r = trace_ring[i % TRACE_DEPTH];
+        p = put32(p, r.cycles);
+        p = put32(p, r.context);
+        p = put16(p, r.point);
+        p = put16(p, r.phase);
+        if (p + 12 > buffer + sizeof(buffer)) {
+            out.write(buffer, p - buffer);
+            p = buffer;
+        }
+    }
+    if (p != buffer) {
+        out.write(buffer, p - buffer);
+    }
+    trace_paused = false;
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include "mbed.h"
+
+// 1 to record trace points; 0 compiles every TRACE_SCOPE out
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+// Records kept in the ring, a power of two
+#ifndef TRACE_DEPTH
+#define TRACE_DEPTH 512
+#endif
+
+/** Code regions that can be traced. */
+enum TracePoint {
+    /// acquire_sample(): start of a sensor read
+    TRACE_ACQUIRE,
+    /// DHT-11 edge interrupt, 42 per frame
+    TRACE_DHT_EDGE,
+    /// DHT11::finish(): frame decode and callback
+    TRACE_DHT_DECODE,
+    /// filter_sample()
+    TRACE_FILTER,
+    /// evaluate_reading()
+    TRACE_EVALUATE,
+    /// render_reading()
+    TRACE_RENDER,
+    /// CSE321_LCD::print()
+    TRACE_LCD_PRINT,
+    /// CSE321_LCD::update()
+    TRACE_LCD_UPDATE,
+    /// I2C completion interrupt of the LCD driver
+    TRACE_LCD_I2C_DONE,
+    /// Backlight fade step, every 20 ms while fading
+    TRACE_LCD_FADE,
+    /// Keypad row scan, every 500 us
+    TRACE_KEYPAD_SCAN,
+    /// Siren tone step
+    TRACE_SIREN_STEP,
+    TRACE_POINT_COUNT
+};
+
+// Trace points recorded, one bit per TracePoint. The interrupts that fire hundreds of times
+// a second are left out by default, or they would push everything else out of the ring.
+#ifndef TRACE_MASK
+#define TRACE_MASK (((1u << TRACE_POINT_COUNT) - 1) & \
+                    ~((1u << TRACE_DHT_EDGE) | (1u << TRACE_KEYPAD_SCAN) | (1u << TRACE_SIREN_STEP)))
+#endif
+
+/** Which end of a traced region a record marks. */
+enum TracePhase { TRACE_BEGIN, TRACE_END };
+
+/** One marker, as kept in the ring and dumped. */
+struct TraceRecord {
+    /// DWT->CYCCNT when the marker was recorded
+    uint32_t cycles;
+    /// Thread id, or the exception number inside a handler
+    uint32_t context;
+    /// TracePoint
+    uint16_t point;
+    /// TracePhase
+    uint16_t phase;
+};
+
+/// Short name of @p point.
+const char *trace_point_name(TracePoint point);
+
+#if TRACE_ENABLED
+
+extern TraceRecord trace_ring[TRACE_DEPTH];
+extern std::atomic<uint32_t> trace_head;
+extern volatile bool trace_paused;
+
+/// Current thread, or the exception number in a handler, without a supervisor call.
+uint32_t trace_context();
+
+/// Start the DWT cycle counter; call once before the first trace point.
+void trace_start();
+
+/** Record a marker of @p point.
+ *
+ * Claims a slot with one atomic increment, so threads and interrupts can
+ * record at any time without locking; the oldest records are overwritten.
+ */
+inline void trace_record(TracePoint point, TracePhase phase)
+{
+    if (!(TRACE_MASK & (1u << point)) || trace_paused) {
+        return;
+    }
+    uint32_t cycles = DWT->CYCCNT;
+    TraceRecord &r = trace_ring[trace_head.fetch_add(1, std::memory_order_relaxed) % TRACE_DEPTH];
+    r.cycles = cycles;
+    r.context = trace_context();
+    r.point = uint16_t(point);
+    r.phase = uint16_t(phase);
+}
+
+/** Write the ring to @p out in the binary format trace_json decodes.
+ *
+ * Recording pauses while the dump is written.
+ */
+void trace_dump(FileHandle &out);
+
+/** Records the begin marker of a point on construction and the end marker on destruction. */
+class TraceScope
+{
+public:
+    explicit TraceScope(TracePoint point) : _point(point) { trace_record(point, TRACE_BEGIN); }
+    ~TraceScope() { trace_record(_point, TRACE_END); }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    TracePoint _point;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/// Trace the rest of the enclosing block as @p point.
+#define TRACE_SCOPE(point) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(point)
+
+#else
+
+inline void trace_start() {}
+inline void trace_dump(FileHandle &) {}
+#define TRACE_SCOPE(point) do {} while (0)
+
+#endif
+
+#endif
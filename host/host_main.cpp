@@ -0,0 +1,646 @@
+/*
+ * Host simulation harness.
+ *
+ * Runs the unmodified firmware (main.cpp, DHT11.cpp, 1802.cpp) against the
+ * simulated board: types the thresholds on the virtual keypad, lets a fire
+ * develop in the simulated room and reports alarm latency, bus traffic and
+ * per-thread timing at the end of the run.
+ *
+ *   fire_alarm_sim [--hours H] [--fire-at H] [--fire-minutes M]
+ *                  [--ramp C_PER_MIN] [--ambient C] [--humidity RH]
+ *                  [--unit C|F] [--temp-threshold T] [--humidity-threshold H]
+ *                  [--glitch-every N] [--dht-tenths] [--diag-page N] [--dump-at H]
+ *                  [--trace-at H] [--log-at H] [--history-at H] [--console FILE]
+ *                  [--flash FILE] [--reset-reason R] [--telemetry FILE] [--lcd]
+ */
+
+#include "mbed.h"
+#include "1802.h"
+#include "Boot.h"
+#include "DHT11.h"
+#include "FlightRecorder.h"
+#include "Pipeline.h"
+#include "SampleHistory.h"
+#include "Telemetry.h"
+#include "sim_devices.h"
+#include "telemetry_frame.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+int app_main();
+
+// Firmware objects the report reads back
+extern CSE321_LCD lcd;
+extern DHT11 sensor;
+extern BootSequencer boot;
+extern FlightRecorder recorder;
+extern SampleHistory<HISTORY_BYTES> history;
+extern TelemetryLink telemetry;
+
+namespace {
+
+struct Options {
+    double hours = 1.0;
+    double fire_at_hours = 0.5;
+    double fire_minutes = 20.0;
+    double ramp = 5.0;
+    double ambient = 22.0;
+    double humidity = 45.0;
+    char unit = 'C';
+    double temp_threshold = 30.0;
+    int humidity_threshold = 20;
+    int glitch_every = 0;
+    bool dht_tenths = false;
+    int diag_page = 0;
+    double dump_at_hours = -1.0;
+    double trace_at_hours = -1.0;
+    double log_at_hours = -1.0;
+    double history_at_hours = -1.0;
+    reset_reason_t reset_reason = RESET_REASON_POWER_ON;
+    const char *console_file = nullptr;
+    const char *flash_file = nullptr;
+    const char *telemetry_file = nullptr;
+    bool lcd_trace = false;
+};
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: fire_alarm_sim [--hours H] [--fire-at H] "
+                 "[--fire-minutes M] [--ramp C_PER_MIN]\n"
+                 "                      [--ambient C] [--humidity RH] "
+                 "[--unit C|F] [--temp-threshold T]\n"
+                 "                      [--humidity-threshold H] "
+                 "[--glitch-every N] [--dht-tenths] [--diag-page N]\n"
+                 "                      [--dump-at H] [--trace-at H] "
+                 "[--log-at H] [--history-at H] [--console FILE]\n"
+                 "                      [--flash FILE] "
+                 "[--reset-reason power|pin|watchdog|software]\n"
+                 "                      [--telemetry FILE] [--lcd]\n");
+    std::exit(2);
+}
+
+Options parse(int argc, char **argv)
+{
+    Options o;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char * {
+            if (i + 1 >= argc) {
+                usage();
+            }
+            return argv[++i];
+        };
+        if (arg == "--hours") {
+            o.hours = std::atof(value());
+        } else if (arg == "--fire-at") {
+            o.fire_at_hours = std::atof(value());
+        } else if (arg == "--fire-minutes") {
+            o.fire_minutes = std::atof(value());
+        } else if (arg == "--ramp") {
+            o.ramp = std::atof(value());
+        } else if (arg == "--ambient") {
+            o.ambient = std::atof(value());
+        } else if (arg == "--humidity") {
+            o.humidity = std::atof(value());
+        } else if (arg == "--unit") {
+            o.unit = value()[0] == 'F' ? 'F' : 'C';
+        } else if (arg == "--temp-threshold") {
+            o.temp_threshold = std::atof(value());
+        } else if (arg == "--humidity-threshold") {
+            o.humidity_threshold = std::atoi(value());
+        } else if (arg == "--glitch-every") {
+            o.glitch_every = std::atoi(value());
+        } else if (arg == "--diag-page") {
+            o.diag_page = std::atoi(value());
+        } else if (arg == "--dump-at") {
+            o.dump_at_hours = std::atof(value());
+        } else if (arg == "--trace-at") {
+            o.trace_at_hours = std::atof(value());
+        } else if (arg == "--log-at") {
+            o.log_at_hours = std::atof(value());
+        } else if (arg == "--history-at") {
+            o.history_at_hours = std::atof(value());
+        } else if (arg == "--reset-reason") {
+            std::string reason = value();
+            if (reason == "power") {
+                o.reset_reason = RESET_REASON_POWER_ON;
+            } else if (reason == "pin") {
+                o.reset_reason = RESET_REASON_PIN_RESET;
+            } else if (reason == "watchdog") {
+                o.reset_reason = RESET_REASON_WATCHDOG;
+            } else if (reason == "software") {
+                o.reset_reason = RESET_REASON_SOFTWARE;
+            } else {
+                usage();
+            }
+        } else if (arg == "--console") {
+            o.console_file = value();
+        } else if (arg == "--flash") {
+            o.flash_file = value();
+        } else if (arg == "--telemetry") {
+            o.telemetry_file = value();
+        } else if (arg == "--dht-tenths") {
+            o.dht_tenths = true;
+        } else if (arg == "--lcd") {
+            o.lcd_trace = true;
+        } else {
+            usage();
+        }
+    }
+    return o;
+}
+
+// Keys a user types to configure the given thresholds, or only the diagnostic
+// page taps when the firmware restores them from flash
+std::string key_script(const Options &o, bool restored)
+{
+    char buf[32];
+    std::string keys;
+    if (restored) {
+        keys.append(size_t(o.diag_page), 'A');
+        return keys;
+    }
+    keys = "D";
+    if (o.unit == 'C') {
+        std::snprintf(buf, sizeof(buf), "C%02d", int(o.temp_threshold));
+    } else {
+        int whole = int(o.temp_threshold);
+        int frac = int(std::lround((o.temp_threshold - whole) * 100)) % 100;
+        std::snprintf(buf, sizeof(buf), "B%02d*%02d", whole, frac);
+    }
+    keys += buf;
+    std::snprintf(buf, sizeof(buf), "%02d", o.humidity_threshold);
+    keys += buf;
+    // A steps through the diagnostic pages once the thresholds are set
+    keys.append(size_t(o.diag_page), 'A');
+    return keys;
+}
+
+// The firmware's alarm rule on sensor readings
+bool alarming(const Options &o, double celsius, int humidity)
+{
+    double temp = o.unit == 'C' ? celsius : celsius * 1.8 + 32;
+    return temp > o.temp_threshold || humidity < o.humidity_threshold;
+}
+
+// First time the sensor would report an alarming reading during the fire
+sim::time_ns crossing_time(const Options &o, const sim::Environment &env)
+{
+    int humidity = int(std::lround(env.humidity));
+    // Every reading the sensor can send, in tenths, lowest first
+    int step = env.tenths ? 1 : 10;
+    for (int tenths = int(env.sensed_c(-100) * 10); tenths <= 600; tenths += step) {
+        double c = tenths / 10.0;
+        if (!alarming(o, c, humidity)) {
+            continue;
+        }
+        if (c <= env.ambient_c) {
+            return 0;
+        }
+        if (env.fire_start == sim::FOREVER || c > env.peak_c) {
+            return sim::FOREVER;
+        }
+        // Whole degrees are rounded down and tenths to the nearest
+        double reached = env.tenths ? c - 0.05 : c;
+        double minutes = (reached - env.ambient_c) / env.ramp_c_per_min;
+        sim::time_ns t = env.fire_start +
+                         sim::time_ns(minutes * 60.0 * sim::NS_PER_S);
+        return t < env.fire_start + env.fire_length ? t : sim::FOREVER;
+    }
+    return sim::FOREVER;
+}
+
+// First time the reading is back to normal after the fire
+sim::time_ns clearing_time(const Options &o, const sim::Environment &env,
+                           sim::time_ns crossing)
+{
+    if (crossing == sim::FOREVER || crossing == 0) {
+        return sim::FOREVER;
+    }
+    int humidity = int(std::lround(env.humidity));
+    sim::time_ns step = 100 * sim::NS_PER_MS;
+    for (sim::time_ns t = env.fire_start + env.fire_length;
+         t < env.fire_start + env.fire_length + 24 * 3600 * sim::NS_PER_S;
+         t += step) {
+        double c = env.sensed_c(env.temperature_c(t));
+        if (!alarming(o, c, humidity)) {
+            // Narrow it down: the firmware may react within one step
+            sim::time_ns lo = t - step;
+            while (t - lo > sim::NS_PER_US) {
+                sim::time_ns mid = lo + (t - lo) / 2;
+                c = env.sensed_c(env.temperature_c(mid));
+                (alarming(o, c, humidity) ? lo : t) = mid;
+            }
+            return t;
+        }
+    }
+    return sim::FOREVER;
+}
+
+double seconds(sim::time_ns t)
+{
+    return double(t) / sim::NS_PER_S;
+}
+
+Options options;
+sim::Environment environment;
+sim::Lcd1802 *lcd_model;
+sim::RgbBacklight *rgb_model;
+sim::Dht11Sensor *dht_model;
+sim::Keypad4x4 *keypad_model;
+sim::AlarmMonitor *alarm_model;
+std::chrono::steady_clock::time_point wall_start;
+bool steady = false;
+uint64_t steady_allocations; // sim::thread_allocations() at the first render
+bool restored = false; // The firmware booted with thresholds already in flash
+telemetry_frame::Parser telemetry_parser; // Decodes the telemetry UART as the building controller would
+
+// AlarmLevel values of main.cpp, as the telemetry readings carry them
+const uint8_t LEVEL_ALARM = 3;
+const uint8_t LEVEL_RISE = 4;
+int first_alarm_level = -1; // Level of the first alarming reading on the telemetry line
+
+// TX pin of the telemetry UART, TELEMETRY_TX in main.cpp
+const PinName TELEMETRY_LINE_TX = PA_0;
+sim::time_ns first_reading = sim::FOREVER;
+
+// Boot with thresholds in flash to the first sample on the check thread, less
+// the time the DHT-11 must settle after power-up before it can be read
+const sim::time_ns RESTORED_BOOT_LIMIT = 500 * sim::NS_PER_MS;
+
+// Boot with thresholds in flash to the first alarm decision: the sensor's
+// settle time, the three frames 1.1 s apart that fill the median filters, and
+// some margin
+const sim::time_ns RESTORED_DECISION_LIMIT =
+    (DHT11_SETTLE_MS + 2 * 1100 + 200) * sim::NS_PER_MS;
+
+// Steady state starts once the first reading is on the LCD: from then on
+// the firmware should not touch the heap
+void stage_finished(Stage stage, uint32_t, uint32_t)
+{
+    if (stage == STAGE_FILTER && first_reading == sim::FOREVER) {
+        first_reading = sim::now();
+    }
+    if (stage == STAGE_RENDER && !steady) {
+        steady = true;
+        steady_allocations = sim::thread_allocations();
+    }
+}
+
+int report()
+{
+    int status = 0;
+    double wall = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - wall_start)
+                      .count();
+    double hours = seconds(sim::now()) / 3600.0;
+    std::printf("\n== host simulation report ==\n");
+    std::printf("simulated    : %.2f h in %.2f s wall (%.0f simulated h/min)\n",
+                hours, wall, wall > 0 ? hours * 60.0 / wall : 0.0);
+
+    std::printf("keypad       : %llu taps typed, %zu never scanned\n",
+                (unsigned long long)keypad_model->taps_done(),
+                keypad_model->taps_pending());
+    std::printf("dht11        : %llu frames, %llu requested early, "
+                "%llu glitches injected, %u completions lost\n",
+                (unsigned long long)dht_model->frames(),
+                (unsigned long long)dht_model->early_requests(),
+                (unsigned long long)dht_model->glitches(),
+                ::sensor.lost_completions());
+
+    // The driver holds the last frame, or the one before while a read is in
+    // progress
+    int held = ::sensor.getTemperature();
+    if (dht_model->frames() && held != dht_model->last_tenths() &&
+        held != dht_model->previous_tenths()) {
+        std::printf("dht11        : DECODED %.1f C, the sensor sent %.1f C\n",
+                    held / 10.0, dht_model->last_tenths() / 10.0);
+        status = 1;
+    }
+
+    const sim::I2CBus &bus = sim::i2c_bus();
+    const sim::I2CStats &lcd = bus.stats(LCD_ADDRESS_1802);
+    const sim::I2CStats &rgb = bus.stats(RGB_ADDRESS);
+    double per_hour = hours > 0 ? 1.0 / hours : 0.0;
+    std::printf("i2c lcd      : %llu transactions, %llu bytes "
+                "(%.0f / %.0f per h), %llu timing violations\n",
+                (unsigned long long)lcd.transactions,
+                (unsigned long long)lcd.bytes, lcd.transactions * per_hour,
+                lcd.bytes * per_hour,
+                (unsigned long long)lcd_model->timing_violations());
+    std::printf("lcd driver   : %u transactions, %u bytes, %u errors "
+                "counted by CSE321_LCD\n",
+                ::lcd.transactions(), ::lcd.bytesSent(), ::lcd.errors());
+    std::printf("i2c rgb      : %llu transactions, %llu bytes, "
+                "%llu colour changes\n",
+                (unsigned long long)rgb.transactions,
+                (unsigned long long)rgb.bytes,
+                (unsigned long long)rgb_model->colour_changes());
+    std::printf("i2c bus      : %.3f%% busy, %llu nacks\n",
+                sim::now() ? 100.0 * bus.total().busy / sim::now() : 0.0,
+                (unsigned long long)bus.total().nacks);
+    std::printf("lcd          : |%s|\n", lcd_model->row(0).c_str());
+    std::printf("               |%s|\n", lcd_model->row(1).c_str());
+
+    sim::time_ns crossing = crossing_time(options, environment);
+    sim::time_ns clearing = clearing_time(options, environment, crossing);
+    std::printf("alarm        : %llu activations, buzzer on %.1f s, "
+                "%llu tone changes\n",
+                (unsigned long long)alarm_model->led_on_count(),
+                seconds(alarm_model->buzzer_on_time()),
+                (unsigned long long)alarm_model->tone_changes());
+    if (crossing != sim::FOREVER && crossing < sim::now()) {
+        sim::time_ns on = alarm_model->first_on_after(crossing);
+        sim::time_ns first = alarm_model->first_on_after(0);
+        if (first < crossing && first >= environment.fire_start) {
+            // Early during the fire: only the rate of rise may have tripped it
+            if (first_alarm_level == LEVEL_RISE) {
+                std::printf("alarm        : rate of rise, %.3f s before the "
+                            "reading crossed the threshold\n",
+                            seconds(crossing - first));
+            } else {
+                std::printf("alarm        : %.3f s before the reading crossed "
+                            "the threshold, NOT BY THE RATE OF RISE (level %d)\n",
+                            seconds(crossing - first), first_alarm_level);
+                status = 1;
+            }
+            on = first;
+        } else if (first < crossing) {
+            std::printf("alarm        : FALSE ALARM at %.3f s\n",
+                        seconds(first));
+            status = 1;
+        }
+        if (on < crossing) {
+            // Already reported above
+        } else if (on == sim::FOREVER) {
+            std::printf("alarm        : MISSED (reading alarming from "
+                        "%.3f s)\n",
+                        seconds(crossing));
+            status = 1;
+        } else {
+            std::printf("alarm latency: %.3f s (reading alarming at %.3f s, "
+                        "siren at %.3f s)\n",
+                        seconds(on - crossing), seconds(crossing),
+                        seconds(on));
+        }
+        if (clearing < sim::now()) {
+            sim::time_ns off = alarm_model->first_off_after(clearing);
+            if (off == sim::FOREVER) {
+                std::printf("alarm clear  : STUCK (reading normal from "
+                            "%.3f s)\n",
+                            seconds(clearing));
+                status = 1;
+            } else {
+                std::printf("alarm clear  : %.3f s after the reading "
+                            "returned to normal\n",
+                            seconds(off - clearing));
+            }
+        }
+    }
+
+    // Monitoring starts when the first sample reaches the check thread, see
+    // BOOT_SENSOR. No firmware can take it before the sensor has settled, so
+    // that much is not counted: what is left is the firmware's own delay.
+    BootPhaseTimes sensing = ::boot.phase(BOOT_SENSOR);
+    sim::time_ns monitoring_start =
+        sensing.finished ? sim::time_ns(sensing.end_us) * sim::NS_PER_US -
+                               DHT11_SETTLE_MS * sim::NS_PER_MS
+                         : sim::FOREVER;
+    bool slow_boot = restored && monitoring_start > RESTORED_BOOT_LIMIT;
+    std::printf("boot         : thresholds %s, monitoring from %.3f s after "
+                "the sensor settled%s, first reading at %.3f s, %llu flash writes\n",
+                restored ? "restored from flash" : "typed on the keypad",
+                seconds(monitoring_start),
+                slow_boot ? " (expected under 0.5 s)" : "",
+                seconds(first_reading),
+                (unsigned long long)sim::flash().writes());
+    if (slow_boot) {
+        status = 1;
+    }
+    std::printf("boot phases  : %-10s %10s %10s %10s\n", "name", "start",
+                "deadline", "end");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        BootPhaseTimes p = ::boot.phase(BootPhase(i));
+        if (!p.started) {
+            continue;
+        }
+        char deadline[16] = "-", end[16] = "-";
+        if (p.deadline_us) {
+            std::snprintf(deadline, sizeof(deadline), "%.3fs", p.deadline_us / 1e6);
+        }
+        if (p.finished) {
+            std::snprintf(end, sizeof(end), "%.3fs", p.end_us / 1e6);
+        }
+        std::printf("               %-10s %9.3fs %10s %10s\n",
+                    boot_phase_name(BootPhase(i)), p.start_us / 1e6, deadline,
+                    end);
+    }
+    BootPhaseTimes decision = ::boot.phase(BOOT_DECISION);
+    sim::time_ns decided = decision.finished
+                               ? sim::time_ns(decision.end_us) * sim::NS_PER_US
+                               : sim::FOREVER;
+    if (restored && decided > RESTORED_DECISION_LIMIT) {
+        std::printf("boot         : first alarm decision later than %.3f s "
+                    "after reset\n",
+                    seconds(RESTORED_DECISION_LIMIT));
+        status = 1;
+    }
+
+    if (steady) {
+        uint64_t allocations = sim::thread_allocations() - steady_allocations;
+        std::printf("heap         : %llu allocations after the first reading%s\n",
+                    (unsigned long long)allocations,
+                    allocations ? " (expected none)" : "");
+        if (allocations) {
+            status = 1;
+        }
+    }
+
+    // Only sectors of the log region count; the KVStore items are kept apart
+    const uint32_t log_base =
+        sim::FlashStore::START + sim::FlashStore::SIZE - RECORDER_SIZE;
+    uint32_t erases_min = UINT32_MAX, erases_max = 0;
+    for (uint32_t a = log_base; a < sim::FlashStore::START + sim::FlashStore::SIZE;
+         a += sim::FlashStore::SECTOR_SIZE) {
+        uint32_t n = sim::flash().erase_count(a);
+        erases_min = std::min(erases_min, n);
+        erases_max = std::max(erases_max, n);
+    }
+    std::printf("recorder     : boot %u, %u records written, %u dropped, "
+                "sector erases %u to %u, %llu flash errors\n",
+                ::recorder.boot(), ::recorder.written(), ::recorder.dropped(),
+                erases_min, erases_max,
+                (unsigned long long)sim::flash().errors());
+    if (::recorder.dropped() || sim::flash().errors()) {
+        status = 1;
+    }
+
+    // Every reading held must decode again, and take far less room than an array of them
+    size_t decoded = ::history.query(::history.oldest_ms(), ::history.newest_ms(),
+                                     [](const HistorySample &) {});
+    double per_kb = ::history.bytes() ? ::history.samples() * 1024.0 / ::history.bytes() : 0.0;
+    double naive_per_kb = 1024.0 / sizeof(HistorySample);
+    std::printf("history      : %u readings over %.2f h in %u bytes, %.0f per KB "
+                "(%.1fx an array), %u blocks evicted%s\n",
+                ::history.samples(),
+                (::history.newest_ms() - ::history.oldest_ms()) / 3600e3,
+                unsigned(::history.bytes()), per_kb, per_kb / naive_per_kb,
+                ::history.evicted(),
+                decoded != ::history.samples() ? " (DECODE MISMATCH)" : "");
+    if (decoded != ::history.samples()) {
+        status = 1;
+    }
+
+    // What the building controller decoded must be what the firmware sent
+    const telemetry_frame::Parser::Stats &tm = telemetry_parser.stats();
+    const sim::Console &telemetry_line = sim::uart(TELEMETRY_LINE_TX);
+    bool telemetry_bad = tm.crc_errors || tm.gaps || tm.lost ||
+                         tm.frames != ::telemetry.frames() ||
+                         tm.samples != ::telemetry.samples();
+    std::printf("telemetry    : %u frames, %u readings sent, %llu bytes "
+                "(%.1f per reading), %u lost; decoded %llu frames, %llu "
+                "readings, %llu crc errors, %llu missing%s\n",
+                ::telemetry.frames(), ::telemetry.samples(),
+                (unsigned long long)telemetry_line.transmitted(),
+                ::telemetry.samples()
+                    ? double(telemetry_line.transmitted()) / ::telemetry.samples()
+                    : 0.0,
+                ::telemetry.lost(), (unsigned long long)tm.frames,
+                (unsigned long long)tm.samples,
+                (unsigned long long)tm.crc_errors, (unsigned long long)tm.gaps,
+                telemetry_bad ? " (MISMATCH)" : "");
+    if (telemetry_bad) {
+        status = 1;
+    }
+
+    uint32_t resets = Watchdog::get_instance().sim_resets();
+    std::printf("watchdog     : %u expiries\n", resets);
+    if (resets) {
+        status = 1;
+    }
+
+    std::printf("threads      : %-18s %4s %10s %9s %11s %11s %11s\n", "name",
+                "prio", "cpu", "cpu %", "avg busy", "max busy", "stack");
+    for (const sim::TaskStats &t : sim::task_stats()) {
+        double avg = t.activations ? double(t.busy_total) / t.activations
+                                   : 0.0;
+        std::printf("               %-18s %4d %9.2fs %8.3f%% %9.3fms "
+                    "%9.3fms %5u/%-5u\n",
+                    t.name.c_str(), t.priority, seconds(t.cpu),
+                    sim::now() ? 100.0 * t.cpu / sim::now() : 0.0,
+                    avg / sim::NS_PER_MS,
+                    double(t.busy_max) / sim::NS_PER_MS, t.stack_peak,
+                    t.stack_size);
+    }
+
+    std::printf("stages       : %-10s %8s %11s %11s\n", "name", "runs",
+                "avg", "max");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const StageStats &st = stage_stats[i];
+        std::printf("               %-10s %8u %9.3fms %9.3fms\n",
+                    stage_name(Stage(i)), st.runs,
+                    st.runs ? st.total_us / 1000.0 / st.runs : 0.0,
+                    st.max_us / 1000.0);
+    }
+    return status;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    options = parse(argc, argv);
+
+    environment.ambient_c = options.ambient;
+    environment.humidity = options.humidity;
+    environment.ramp_c_per_min = options.ramp;
+    environment.glitch_every = options.glitch_every;
+    environment.tenths = options.dht_tenths;
+    environment.fire_length =
+        sim::time_ns(options.fire_minutes * 60.0 * sim::NS_PER_S);
+    if (options.fire_at_hours >= 0) {
+        environment.fire_start =
+            sim::time_ns(options.fire_at_hours * 3600.0 * sim::NS_PER_S);
+    }
+
+    lcd_model = new sim::Lcd1802;
+    lcd_model->set_trace(options.lcd_trace);
+    rgb_model = new sim::RgbBacklight;
+    sim::i2c_bus().attach(LCD_ADDRESS_1802, lcd_model);
+    sim::i2c_bus().attach(RGB_ADDRESS, rgb_model);
+    dht_model = new sim::Dht11Sensor(PF_13, environment);
+    keypad_model = new sim::Keypad4x4;
+    alarm_model = new sim::AlarmMonitor(PD_7, PD_14);
+
+    if (options.flash_file && !sim::flash().open(options.flash_file)) {
+        std::fprintf(stderr, "%s: not a flash image\n", options.flash_file);
+        return 1;
+    }
+    restored = !sim::flash().empty();
+    std::string keys = key_script(options, restored);
+    for (char key : keys) {
+        keypad_model->tap(key, sim::NS_PER_S);
+    }
+    if (options.dump_at_hours >= 0) {
+        // Ask for a diagnostics dump on the serial console
+        sim::at(sim::time_ns(options.dump_at_hours * 3600.0 * sim::NS_PER_S),
+                [] { sim::console().receive('d'); });
+    }
+    if (options.trace_at_hours >= 0) {
+        // Ask for a trace dump; it is binary, so best sent to --console
+        sim::at(sim::time_ns(options.trace_at_hours * 3600.0 * sim::NS_PER_S),
+                [] { sim::console().receive('t'); });
+    }
+    if (options.log_at_hours >= 0) {
+        // Ask for the flight log, as CSV
+        sim::at(sim::time_ns(options.log_at_hours * 3600.0 * sim::NS_PER_S),
+                [] { sim::console().receive('l'); });
+    }
+    if (options.history_at_hours >= 0) {
+        // Ask for the reading history, as CSV
+        sim::at(sim::time_ns(options.history_at_hours * 3600.0 * sim::NS_PER_S),
+                [] { sim::console().receive('h'); });
+    }
+    ResetReason::sim_set(options.reset_reason);
+    sim::Console &telemetry_line = sim::uart(TELEMETRY_LINE_TX);
+    telemetry_line.on_transmit([](const char *data, size_t length) {
+        telemetry_parser.feed(reinterpret_cast<const uint8_t *>(data), length,
+                              [](const telemetry_frame::Frame &frame) {
+                                  for (const telemetry_frame::Sample &s : frame.samples) {
+                                      if (first_alarm_level < 0 && s.level >= LEVEL_ALARM) {
+                                          first_alarm_level = s.level;
+                                      }
+                                  }
+                              });
+    });
+    if (options.telemetry_file) {
+        std::FILE *telemetry_out = std::fopen(options.telemetry_file, "wb");
+        if (!telemetry_out) {
+            std::perror(options.telemetry_file);
+            return 1;
+        }
+        telemetry_line.capture(telemetry_out);
+    }
+    if (options.console_file) {
+        std::FILE *console_out = std::fopen(options.console_file, "wb");
+        if (!console_out) {
+            std::perror(options.console_file);
+            return 1;
+        }
+        sim::console().capture(console_out);
+    }
+    std::printf("host simulation: %.2f h, keys \"%s\", fire at %.2f h\n",
+                options.hours, keys.c_str(), options.fire_at_hours);
+
+    stage_hook = stage_finished;
+    wall_start = std::chrono::steady_clock::now();
+    sim::run([] { app_main(); },
+             sim::time_ns(options.hours * 3600.0 * sim::NS_PER_S), report);
+}
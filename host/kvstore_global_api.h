@@ -0,0 +1,19 @@
+/*
+ * KVStore global API of Mbed OS on the simulated internal flash
+ * (sim::flash()). Only what the firmware uses.
+ */
+
+#ifndef KVSTORE_GLOBAL_API_H
+#define KVSTORE_GLOBAL_API_H
+
+#include "mbed.h"
+
+#define KV_WRITE_ONCE_FLAG (1 << 0)
+
+/// Store @p size bytes under @p full_name_key, such as "/kv/name".
+int kv_set(const char *full_name_key, const void *buffer, size_t size, uint32_t create_flags);
+
+/// Read the value of @p full_name_key into @p buffer.
+int kv_get(const char *full_name_key, void *buffer, size_t buffer_size, size_t *actual_size);
+
+#endif
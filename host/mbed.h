@@ -0,0 +1,946 @@
+/*
+ * Host stand-in for the subset of Mbed OS 6 the firmware uses.
+ *
+ * The application sources compile against this header instead of the real
+ * mbed-os tree. Every class keeps the Mbed signature, but its behaviour is
+ * provided by the virtual-time kernel (sim_kernel.h) and the simulated
+ * peripherals (sim_io.h), so the firmware runs on Linux with a virtual
+ * clock.
+ */
+
+#ifndef MBED_H
+#define MBED_H
+
+#include "sim_io.h"
+#include "sim_kernel.h"
+
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <sys/types.h>
+
+#define MBED_ASSERT(expr) assert(expr)
+#define MBED_UNUSED __attribute__((unused))
+#define MBED_FORCEINLINE inline __attribute__((always_inline))
+
+#define TARGET_NUCLEO_L4R5ZI 1
+#define TARGET_STM32L4 1
+#define DEVICE_I2C 1
+#define DEVICE_I2C_ASYNCH 1
+#define DEVICE_INTERRUPTIN 1
+#define DEVICE_PWMOUT 1
+#define DEVICE_WATCHDOG 1
+#define DEVICE_SERIAL 1
+
+// Size of the transmit buffer of BufferedSerial, as in drivers/mbed_lib.json
+#define MBED_CONF_DRIVERS_UART_SERIAL_TXBUF_SIZE 256
+
+// Internal flash of the default KVStore, as mbed_app.json sets it
+#define MBED_CONF_STORAGE_TDB_INTERNAL_INTERNAL_BASE_ADDRESS 0x081F0000
+#define MBED_CONF_STORAGE_TDB_INTERNAL_INTERNAL_SIZE 0x8000
+
+// Pin names use the STM32 encoding: (port << 4) | pin
+#define SIM_PORT_PINS(P, n)                                                   \
+    P##_0 = (n << 4) | 0, P##_1, P##_2, P##_3, P##_4, P##_5, P##_6, P##_7,    \
+    P##_8, P##_9, P##_10, P##_11, P##_12, P##_13, P##_14, P##_15
+
+typedef enum {
+    SIM_PORT_PINS(PA, 0),
+    SIM_PORT_PINS(PB, 1),
+    SIM_PORT_PINS(PC, 2),
+    SIM_PORT_PINS(PD, 3),
+    SIM_PORT_PINS(PE, 4),
+    SIM_PORT_PINS(PF, 5),
+    SIM_PORT_PINS(PG, 6),
+    SIM_PORT_PINS(PH, 7),
+
+    // NUCLEO_L4R5ZI aliases
+    USBTX = PG_7,
+    USBRX = PG_8,
+    LED1 = PC_7,
+    LED2 = PB_7,
+    LED3 = PA_14,
+    BUTTON1 = PC_13,
+    CONSOLE_TX = USBTX,
+    CONSOLE_RX = USBRX,
+
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+#undef SIM_PORT_PINS
+
+typedef enum {
+    PullNone = 0,
+    PullUp = 1,
+    PullDown = 2,
+    OpenDrain = 3,
+    PullDefault = PullNone
+} PinMode;
+
+// Memory-mapped register blocks
+typedef sim::GpioPort GPIO_TypeDef;
+typedef sim::RccBlock RCC_TypeDef;
+#define GPIOA (&sim::gpio_port(0))
+#define GPIOB (&sim::gpio_port(1))
+#define GPIOC (&sim::gpio_port(2))
+#define GPIOD (&sim::gpio_port(3))
+#define GPIOE (&sim::gpio_port(4))
+#define GPIOF (&sim::gpio_port(5))
+#define GPIOG (&sim::gpio_port(6))
+#define GPIOH (&sim::gpio_port(7))
+#define RCC (&sim::rcc())
+
+// Cortex-M4 core registers
+typedef sim::DwtBlock DWT_Type;
+typedef sim::CoreDebugBlock CoreDebug_Type;
+#define DWT (&sim::dwt())
+#define CoreDebug (&sim::core_debug())
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+/// Core clock in Hz, as in CMSIS system_stm32l4xx.c.
+extern uint32_t SystemCoreClock;
+
+/// Active exception number: 0 in thread mode, 16 for any simulated interrupt.
+inline uint32_t __get_IPSR()
+{
+    return sim::in_isr() ? 16 : 0;
+}
+
+// CMSIS-RTOS2 subset
+typedef enum {
+    osPriorityNone = 0,
+    osPriorityIdle = 1,
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40,
+    osPriorityRealtime = 48,
+    osPriorityISR = 56,
+    osPriorityError = -1
+} osPriority;
+
+typedef int32_t osStatus;
+#define osOK 0
+#define osError -1
+#define osErrorParameter -4
+
+typedef void *osThreadId_t;
+typedef osPriority osPriority_t;
+
+osThreadId_t osThreadGetId();
+
+/// Store up to @p array_items thread ids; returns how many were stored.
+uint32_t osThreadEnumerate(osThreadId_t *thread_array, uint32_t array_items);
+const char *osThreadGetName(osThreadId_t thread_id);
+osPriority_t osThreadGetPriority(osThreadId_t thread_id);
+uint32_t osThreadGetStackSize(osThreadId_t thread_id);
+
+/// Stack never used so far. The host measures the depth of its own stack
+/// at kernel calls, which is only a rough stand-in for the target's.
+uint32_t osThreadGetStackSpace(osThreadId_t thread_id);
+
+// mbed_stats subset. Only the firmware's own allocations count as heap.
+typedef uint64_t us_timestamp_t;
+
+typedef struct {
+    uint32_t current_size;
+    uint32_t max_size;
+    uint32_t total_size;
+    uint32_t reserved_size;
+    uint32_t alloc_cnt;
+    uint32_t alloc_fail_cnt;
+    uint32_t overhead_size;
+} mbed_stats_heap_t;
+
+typedef struct {
+    us_timestamp_t uptime;
+    us_timestamp_t idle_time;
+    us_timestamp_t sleep_time;
+    us_timestamp_t deep_sleep_time;
+} mbed_stats_cpu_t;
+
+void mbed_stats_heap_get(mbed_stats_heap_t *stats);
+void mbed_stats_cpu_get(mbed_stats_cpu_t *stats);
+
+#ifndef OS_STACK_SIZE
+#define OS_STACK_SIZE 4096
+#endif
+
+/// Host cost model of common operations, in nanoseconds of CPU time.
+namespace sim {
+const time_ns COST_GPIO = 150;
+const time_ns COST_TIMER = 100;
+const time_ns COST_PWM_CONFIG = 1000;
+const time_ns COST_ISR = 500; // exception entry, dispatch and return
+const time_ns COST_I2C_START = 2000; // DMA and peripheral setup of a transfer
+} // namespace sim
+
+inline void core_util_critical_section_enter()
+{
+    sim::irq_disable();
+}
+
+inline void core_util_critical_section_exit()
+{
+    sim::irq_enable();
+}
+
+inline bool core_util_is_isr_active()
+{
+    return sim::in_isr();
+}
+
+inline void wait_us(int us)
+{
+    sim::cpu(sim::time_ns(us) * sim::NS_PER_US);
+}
+
+inline void wait_ns(unsigned int ns)
+{
+    sim::cpu(ns);
+}
+
+inline void thread_sleep_for(uint32_t millisec)
+{
+    sim::sleep_until(sim::now() + millisec * sim::NS_PER_MS);
+}
+
+inline uint32_t us_ticker_read()
+{
+    return uint32_t(sim::now() / sim::NS_PER_US);
+}
+
+/** Causes of a reset, as in hal/reset_reason_api.h. */
+typedef enum {
+    RESET_REASON_POWER_ON,
+    RESET_REASON_PIN_RESET,
+    RESET_REASON_BROWN_OUT,
+    RESET_REASON_SOFTWARE,
+    RESET_REASON_WATCHDOG,
+    RESET_REASON_LOCKUP,
+    RESET_REASON_WAKE_LOW_POWER,
+    RESET_REASON_ACCESS_ERROR,
+    RESET_REASON_BOOT_ERROR,
+    RESET_REASON_MULTIPLE,
+    RESET_REASON_PLATFORM,
+    RESET_REASON_UNKNOWN
+} reset_reason_t;
+
+namespace mbed {
+
+template <typename F>
+class Callback;
+
+/** Fixed-storage callable, as mbed::Callback: a function pointer, an object
+ * plus member function, or a small trivially copyable functor.
+ */
+template <typename R, typename... ArgTs>
+class Callback<R(ArgTs...)> {
+public:
+    Callback() = default;
+
+    Callback(std::nullptr_t) {}
+
+    Callback(R (*func)(ArgTs...))
+    {
+        if (func) {
+            emplace([func](ArgTs... args) { return func(args...); });
+        }
+    }
+
+    template <typename T, typename U>
+    Callback(U *obj, R (T::*method)(ArgTs...))
+    {
+        T *target = obj;
+        emplace([target, method](ArgTs... args) {
+            return (target->*method)(args...);
+        });
+    }
+
+    template <typename T, typename U>
+    Callback(const U *obj, R (T::*method)(ArgTs...) const)
+    {
+        const T *target = obj;
+        emplace([target, method](ArgTs... args) {
+            return (target->*method)(args...);
+        });
+    }
+
+    template <typename F,
+              typename = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type,
+                                Callback>::value &&
+                  !std::is_pointer<typename std::decay<F>::type>::value>::type>
+    Callback(F f)
+    {
+        emplace(f);
+    }
+
+    R operator()(ArgTs... args) const
+    {
+        MBED_ASSERT(_thunk);
+        return _thunk(_storage, args...);
+    }
+
+    R call(ArgTs... args) const { return operator()(args...); }
+
+    explicit operator bool() const { return _thunk != nullptr; }
+
+    friend bool operator==(const Callback &f, std::nullptr_t)
+    {
+        return !f._thunk;
+    }
+
+    friend bool operator!=(const Callback &f, std::nullptr_t)
+    {
+        return f._thunk != nullptr;
+    }
+
+private:
+    template <typename F>
+    void emplace(const F &f)
+    {
+        static_assert(sizeof(F) <= sizeof(_storage),
+                      "functor too big for Callback");
+        static_assert(std::is_trivially_copyable<F>::value,
+                      "Callback functors must be trivially copyable");
+        new (_storage) F(f);
+        _thunk = [](const void *s, ArgTs... args) -> R {
+            return (*static_cast<const F *>(s))(args...);
+        };
+    }
+
+    alignas(void *) unsigned char _storage[4 * sizeof(void *)] = {};
+    R (*_thunk)(const void *, ArgTs...) = nullptr;
+};
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(R (*func)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(func);
+}
+
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(U *obj, R (T::*method)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(const U *obj, R (T::*method)(ArgTs...) const)
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(const Callback<R(ArgTs...)> &func)
+{
+    return func;
+}
+
+/** Measures elapsed time on the virtual clock. */
+class Timer {
+public:
+    void start();
+    void stop();
+    void reset();
+    std::chrono::microseconds elapsed_time() const;
+    int read_us() const { return int(elapsed_time().count()); }
+    int read_ms() const { return read_us() / 1000; }
+    float read() const { return read_us() / 1000000.0f; }
+
+private:
+    bool _running = false;
+    sim::time_ns _start = 0;
+    sim::time_ns _accumulated = 0;
+};
+
+/** Periodic interrupt on the virtual clock. */
+class Ticker {
+public:
+    Ticker() = default;
+    Ticker(const Ticker &) = delete;
+    Ticker &operator=(const Ticker &) = delete;
+    virtual ~Ticker() { detach(); }
+
+    void attach(Callback<void()> func, std::chrono::microseconds t);
+    void attach_us(Callback<void()> func, uint32_t t)
+    {
+        attach(func, std::chrono::microseconds(t));
+    }
+    void detach();
+
+protected:
+    void schedule(sim::time_ns when);
+    void fire();
+
+    Callback<void()> _function;
+    sim::time_ns _period = 0;
+    sim::time_ns _due = 0;
+    sim::event_id _event = 0;
+    bool _one_shot = false;
+};
+
+/** One-shot interrupt on the virtual clock. */
+class Timeout : public Ticker {
+public:
+    void attach(Callback<void()> func, std::chrono::microseconds t);
+    void attach_us(Callback<void()> func, uint32_t t)
+    {
+        attach(func, std::chrono::microseconds(t));
+    }
+};
+
+class LowPowerTicker : public Ticker {
+};
+
+class LowPowerTimeout : public Timeout {
+};
+
+class DigitalOut {
+public:
+    explicit DigitalOut(PinName pin, int value = 0);
+    void write(int value);
+    int read();
+    int is_connected() { return _pin != NC; }
+    DigitalOut &operator=(int value)
+    {
+        write(value);
+        return *this;
+    }
+    operator int() { return read(); }
+
+private:
+    PinName _pin;
+};
+
+class DigitalIn {
+public:
+    explicit DigitalIn(PinName pin, PinMode mode = PullDefault);
+    int read();
+    void mode(PinMode pull);
+    int is_connected() { return _pin != NC; }
+    operator int() { return read(); }
+
+private:
+    PinName _pin;
+};
+
+class DigitalInOut {
+public:
+    explicit DigitalInOut(PinName pin);
+    void write(int value);
+    int read();
+    void output();
+    void input();
+    void mode(PinMode pull);
+    int is_connected() { return _pin != NC; }
+    DigitalInOut &operator=(int value)
+    {
+        write(value);
+        return *this;
+    }
+    operator int() { return read(); }
+
+private:
+    PinName _pin;
+};
+
+/** Edge interrupts on a simulated GPIO line. */
+class InterruptIn : private sim::PinListener {
+public:
+    explicit InterruptIn(PinName pin, PinMode mode = PullDefault);
+    virtual ~InterruptIn();
+    int read();
+    operator int() { return read(); }
+    void rise(Callback<void()> func);
+    void fall(Callback<void()> func);
+    void mode(PinMode pull);
+    void enable_irq();
+    void disable_irq();
+
+private:
+    void pin_changed(sim::Pin &pin) override;
+
+    PinName _pin;
+    int _last;
+    bool _enabled = true;
+    Callback<void()> _rise;
+    Callback<void()> _fall;
+};
+
+class PwmOut {
+public:
+    explicit PwmOut(PinName pin);
+    void write(float value);
+    float read();
+    void period(float seconds);
+    void period_ms(int ms);
+    void period_us(int us);
+    void pulsewidth(float seconds);
+    void pulsewidth_ms(int ms);
+    void pulsewidth_us(int us);
+    void suspend();
+    void resume();
+    PwmOut &operator=(float value)
+    {
+        write(value);
+        return *this;
+    }
+    operator float() { return read(); }
+
+private:
+    void apply();
+
+    PinName _pin;
+    sim::time_ns _period = 20 * sim::NS_PER_MS;
+    float _duty = 0.0f;
+    bool _suspended = false;
+};
+
+#define I2C_EVENT_ERROR (1 << 1)
+#define I2C_EVENT_ERROR_NO_SLAVE (1 << 2)
+#define I2C_EVENT_TRANSFER_COMPLETE (1 << 3)
+#define I2C_EVENT_TRANSFER_EARLY_NACK (1 << 4)
+#define I2C_EVENT_ALL                                                         \
+    (I2C_EVENT_ERROR | I2C_EVENT_TRANSFER_COMPLETE |                          \
+     I2C_EVENT_ERROR_NO_SLAVE | I2C_EVENT_TRANSFER_EARLY_NACK)
+
+typedef Callback<void(int)> event_callback_t;
+
+/** I2C master on the simulated bus, blocking or interrupt driven. */
+class I2C {
+public:
+    enum Acknowledge { NoACK = 0, ACK = 1 };
+
+    I2C(PinName sda, PinName scl);
+    ~I2C();
+    void frequency(int hz);
+    int write(int address, const char *data, int length,
+              bool repeated = false);
+    int read(int address, char *data, int length, bool repeated = false);
+
+    /// Take the bus. On the target this is a PlatformMutex, and taking it
+    /// in interrupt context is a fatal error; the simulation aborts too.
+    void lock();
+    void unlock() {}
+
+    /// Start a transfer in the background; @p callback runs in interrupt
+    /// context with the events in @p event that occurred.
+    ///
+    /// @returns 0 if started, -1 if a transfer is already in progress.
+    int transfer(int address, const char *tx_buffer, int tx_length,
+                 char *rx_buffer, int rx_length,
+                 const event_callback_t &callback,
+                 int event = I2C_EVENT_TRANSFER_COMPLETE,
+                 bool repeated = false);
+    void abort_transfer();
+
+private:
+    int _hz = 100000;
+    sim::event_id _transfer = 0;
+};
+
+/** Hardware watchdog on the virtual clock; expiries are counted, not fatal. */
+class Watchdog {
+public:
+    static Watchdog &get_instance();
+    bool start(uint32_t timeout);
+    bool start();
+    bool stop();
+    void kick();
+    uint32_t get_timeout() const { return _timeout; }
+    uint32_t get_max_timeout() const { return 32000; }
+    bool is_running() const { return _running; }
+
+    /// Host only: number of expiries so far.
+    uint32_t sim_resets() const { return _resets; }
+
+private:
+    Watchdog() = default;
+    void arm();
+
+    uint32_t _timeout = 0;
+    bool _running = false;
+    uint32_t _resets = 0;
+    sim::event_id _event = 0;
+};
+
+/** Internal flash programmed in place, as mbed::FlashIAP, on sim::flash().
+ *
+ * program() and erase() hold the calling thread for the data sheet times.
+ */
+class FlashIAP {
+public:
+    int init() { return 0; }
+    int deinit() { return 0; }
+    int read(void *buffer, uint32_t addr, uint32_t size);
+    int program(const void *buffer, uint32_t addr, uint32_t size);
+    int erase(uint32_t addr, uint32_t size);
+    uint32_t get_sector_size(uint32_t addr) const;
+    uint32_t get_flash_start() const;
+    uint32_t get_flash_size() const;
+    uint32_t get_page_size() const;
+    uint8_t get_erase_value() const;
+};
+
+/** Cause of the last reset, as mbed::ResetReason. */
+class ResetReason {
+public:
+    static reset_reason_t get();
+    static uint32_t get_raw() { return uint32_t(get()); }
+
+    /// Host only: the reason the next get() reports.
+    static void sim_set(reset_reason_t reason);
+};
+
+/** Byte stream, as mbed::FileHandle. */
+class FileHandle {
+public:
+    virtual ~FileHandle() = default;
+    virtual ssize_t read(void *buffer, size_t size) = 0;
+    virtual ssize_t write(const void *buffer, size_t size) = 0;
+};
+
+/** UART on the port of its TX pin (sim::uart()), as mbed::BufferedSerial.
+ *
+ * write() copies into a transmit buffer of MBED_CONF_DRIVERS_UART_SERIAL_TXBUF_SIZE
+ * bytes that drains at the baud rate. When it is full a blocking write() holds
+ * the calling thread until there is room, and a non-blocking one writes what
+ * fits. sigio() callbacks run in interrupt context when a character arrives.
+ */
+class BufferedSerial : public FileHandle {
+public:
+    BufferedSerial(PinName tx, PinName rx, int baud = 9600);
+    BufferedSerial(const BufferedSerial &) = delete;
+    BufferedSerial &operator=(const BufferedSerial &) = delete;
+
+    /// @returns bytes read, or -EAGAIN if none and not blocking.
+    ssize_t read(void *buffer, size_t size) override;
+    ssize_t write(const void *buffer, size_t size) override;
+    bool readable() const;
+    bool writable() const { return true; }
+    int set_blocking(bool blocking)
+    {
+        _blocking = blocking;
+        return 0;
+    }
+    void set_baud(int baud) { _baud = baud; }
+    void sigio(Callback<void()> func);
+
+private:
+    sim::Console &_port;
+    int _baud;
+    bool _blocking = true;
+    sim::time_ns _tx_done = 0; // When the transmit buffer will be empty
+};
+
+enum crc_polynomial {
+    POLY_32BIT_ANSI = 0x04C11DB7,
+};
+
+/** CRC engine, as mbed::MbedCRC. Only the reflected CRC-32 of
+ * POLY_32BIT_ANSI, which is what MbedCRC<POLY_32BIT_ANSI, 32> computes. */
+template <uint32_t Polynomial = POLY_32BIT_ANSI, int Width = 32>
+class MbedCRC {
+    static_assert(Polynomial == POLY_32BIT_ANSI && Width == 32, "not simulated");
+
+public:
+    int32_t compute(const void *buffer, unsigned long long size, uint32_t *crc)
+    {
+        const uint8_t *data = static_cast<const uint8_t *>(buffer);
+        uint32_t value = 0xFFFFFFFF;
+        while (size--) {
+            value ^= *data++;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value >> 1) ^ (0xEDB88320 & (0u - (value & 1)));
+            }
+        }
+        *crc = ~value;
+        return 0;
+    }
+};
+
+} // namespace mbed
+
+#define MBED_SUCCESS 0
+#define MBED_ERROR_ITEM_NOT_FOUND (-0x117)
+#define MBED_FLASH_INVALID_SIZE 0xFFFFFFFF
+
+namespace rtos {
+
+namespace Kernel {
+
+/** RTOS tick clock (milliseconds). */
+struct Clock {
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<Clock>;
+    using duration_u32 = std::chrono::duration<uint32_t, std::milli>;
+    static const bool is_steady = true;
+    static time_point now()
+    {
+        return time_point(duration(sim::now() / sim::NS_PER_MS));
+    }
+};
+
+inline uint64_t get_ms_count()
+{
+    return sim::now() / sim::NS_PER_MS;
+}
+
+constexpr Clock::duration_u32 wait_for_u32_forever =
+    Clock::duration_u32(0xFFFFFFFFu);
+
+} // namespace Kernel
+
+namespace detail {
+inline sim::time_ns deadline_after(std::chrono::nanoseconds d)
+{
+    if (d.count() < 0) {
+        return sim::now();
+    }
+    return sim::now() + sim::time_ns(d.count());
+}
+} // namespace detail
+
+namespace ThisThread {
+
+template <typename Rep, typename Period>
+void sleep_for(std::chrono::duration<Rep, Period> rel_time)
+{
+    if (std::chrono::duration_cast<std::chrono::milliseconds>(rel_time) ==
+        std::chrono::milliseconds(Kernel::wait_for_u32_forever)) {
+        sim::block(nullptr, sim::FOREVER);
+        return;
+    }
+    sim::sleep_until(detail::deadline_after(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(rel_time)));
+}
+
+inline void sleep_until(Kernel::Clock::time_point abs_time)
+{
+    sim::sleep_until(sim::time_ns(abs_time.time_since_epoch().count()) *
+                     sim::NS_PER_MS);
+}
+
+inline void yield()
+{
+    sim::yield();
+}
+
+inline osThreadId_t get_id()
+{
+    return sim::current();
+}
+
+} // namespace ThisThread
+
+class Mutex {
+public:
+    Mutex() = default;
+    explicit Mutex(const char *) {}
+    Mutex(const Mutex &) = delete;
+    Mutex &operator=(const Mutex &) = delete;
+    void lock();
+    bool trylock();
+    bool trylock_for(Kernel::Clock::duration_u32 rel_time);
+    void unlock();
+    osThreadId_t get_owner() { return _owner; }
+
+private:
+    sim::Task *_owner = nullptr;
+    int _count = 0;
+    sim::WaitQueue _waiters;
+};
+
+class Semaphore {
+public:
+    explicit Semaphore(int32_t count = 0, uint16_t max_count = 0xFFFF)
+        : _count(count), _max(max_count)
+    {
+    }
+    void acquire();
+    bool try_acquire();
+    bool try_acquire_for(Kernel::Clock::duration_u32 rel_time);
+    osStatus release();
+
+private:
+    int32_t _count;
+    uint16_t _max;
+    sim::WaitQueue _waiters;
+};
+
+class Thread {
+public:
+    Thread(osPriority priority = osPriorityNormal,
+           uint32_t stack_size = OS_STACK_SIZE,
+           unsigned char * /*stack_mem*/ = nullptr,
+           const char *name = nullptr)
+        : _priority(priority), _stack_size(stack_size), _name(name)
+    {
+    }
+    Thread(const Thread &) = delete;
+    Thread &operator=(const Thread &) = delete;
+
+    osStatus start(mbed::Callback<void()> task);
+    osStatus join();
+    osPriority get_priority() const { return _priority; }
+    uint32_t stack_size() const { return _stack_size; }
+    const char *get_name() const { return _name; }
+    osThreadId_t get_id() const { return _task; }
+
+private:
+    osPriority _priority;
+    uint32_t _stack_size;
+    const char *_name;
+    sim::Task *_task = nullptr;
+    bool _finished = false;
+    sim::WaitQueue _joiners;
+};
+
+} // namespace rtos
+
+// Size of one event in the EventQueue buffer, as in equeue.
+#define EVENTS_EVENT_SIZE (5 * sizeof(void *) + sizeof(mbed::Callback<void()>))
+#define EVENTS_QUEUE_SIZE (32 * EVENTS_EVENT_SIZE)
+
+namespace events {
+
+/** Dispatch queue of deferred calls, one fixed slot per event. */
+class EventQueue {
+public:
+    using duration = std::chrono::duration<int, std::milli>;
+
+    explicit EventQueue(unsigned size = EVENTS_QUEUE_SIZE,
+                        unsigned char *buffer = nullptr);
+    ~EventQueue();
+    EventQueue(const EventQueue &) = delete;
+    EventQueue &operator=(const EventQueue &) = delete;
+
+    void dispatch_forever();
+    void dispatch_for(duration ms);
+    void dispatch(int ms = -1) { dispatch_for(duration(ms)); }
+    void dispatch_once() { dispatch_for(duration(0)); }
+    void break_dispatch();
+    bool cancel(int id);
+    int time_left(int id);
+
+    template <typename F, typename... ArgTs>
+    int call(F f, ArgTs... args)
+    {
+        return post(0, 0, bind(f, args...));
+    }
+
+    template <typename T, typename R, typename... ArgTs, typename... BoundTs>
+    int call(T *obj, R (T::*method)(ArgTs...), BoundTs... args)
+    {
+        return post(0, 0, bind(mbed::callback(obj, method), args...));
+    }
+
+    template <typename F, typename... ArgTs>
+    int call_in(duration ms, F f, ArgTs... args)
+    {
+        return post(to_ns(ms), 0, bind(f, args...));
+    }
+
+    template <typename F, typename... ArgTs>
+    int call_every(duration ms, F f, ArgTs... args)
+    {
+        return post(to_ns(ms), to_ns(ms), bind(f, args...));
+    }
+
+    /// Host only: most an event ran behind its due time.
+    sim::time_ns sim_max_lateness() const { return _max_lateness; }
+
+    /// Host only: events that were dropped because the queue was full.
+    uint32_t sim_overflows() const { return _overflows; }
+
+private:
+    static const size_t SLOT_STORAGE = 64;
+
+    struct Slot {
+        alignas(void *) unsigned char storage[SLOT_STORAGE];
+        void (*invoke)(void *) = nullptr;
+        void (*destroy)(void *) = nullptr;
+        sim::time_ns due = 0;
+        sim::time_ns period = 0;
+        uint32_t order = 0;
+        uint16_t generation = 0;
+        bool used = false;
+    };
+
+    template <typename F, typename... ArgTs>
+    static auto bind(F f, ArgTs... args)
+    {
+        return [f, args...]() mutable { f(args...); };
+    }
+
+    static sim::time_ns to_ns(duration ms)
+    {
+        return ms.count() > 0 ? sim::time_ns(ms.count()) * sim::NS_PER_MS : 0;
+    }
+
+    template <typename F>
+    int post(sim::time_ns delay, sim::time_ns period, F f)
+    {
+        static_assert(sizeof(F) <= SLOT_STORAGE, "event too large");
+        Slot *slot = allocate();
+        if (!slot) {
+            return 0;
+        }
+        new (slot->storage) F(std::move(f));
+        slot->invoke = [](void *s) { (*static_cast<F *>(s))(); };
+        slot->destroy = [](void *s) { static_cast<F *>(s)->~F(); };
+        return enqueue(slot, delay, period);
+    }
+
+    Slot *allocate();
+    int enqueue(Slot *slot, sim::time_ns delay, sim::time_ns period);
+    void release(Slot *slot);
+    Slot *next_due(sim::time_ns &earliest);
+    bool dispatch_until(sim::time_ns deadline);
+
+    Slot *_slots;
+    size_t _capacity;
+    uint32_t _order = 0;
+    bool _break = false;
+    Slot *_running = nullptr; // Event being dispatched
+    bool _running_cancelled = false;
+    sim::time_ns _max_lateness = 0;
+    uint32_t _overflows = 0;
+    sim::WaitQueue _waiters;
+};
+
+} // namespace events
+
+// Buffer and stack of the shared event queue, as in the events library config
+#define MBED_CONF_EVENTS_SHARED_EVENTSIZE 768
+#define MBED_CONF_EVENTS_SHARED_STACKSIZE 2048
+
+namespace mbed {
+
+/// Queue of the shared event thread, which is started on first use.
+events::EventQueue *mbed_event_queue();
+
+} // namespace mbed
+
+using namespace mbed;
+using namespace rtos;
+using namespace events;
+using namespace std;
+using namespace std::chrono_literals;
+
+#endif
@@ -0,0 +1,950 @@
+#include "mbed.h"
+#include "kvstore_global_api.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mbed {
+
+void Timer::start()
+{
+    sim::cpu(sim::COST_TIMER);
+    if (!_running) {
+        _running = true;
+        _start = sim::now();
+    }
+}
+
+void Timer::stop()
+{
+    sim::cpu(sim::COST_TIMER);
+    if (_running) {
+        _accumulated += sim::now() - _start;
+        _running = false;
+    }
+}
+
+void Timer::reset()
+{
+    _accumulated = 0;
+    _start = sim::now();
+}
+
+std::chrono::microseconds Timer::elapsed_time() const
+{
+    sim::cpu(sim::COST_TIMER);
+    sim::time_ns total = _accumulated;
+    if (_running) {
+        total += sim::now() - _start;
+    }
+    return std::chrono::microseconds(total / sim::NS_PER_US);
+}
+
+void Ticker::attach(Callback<void()> func, std::chrono::microseconds t)
+{
+    detach();
+    _function = func;
+    _one_shot = false;
+    _period = sim::time_ns(t.count()) * sim::NS_PER_US;
+    schedule(sim::now() + _period);
+}
+
+void Ticker::detach()
+{
+    if (_event) {
+        sim::cancel(_event);
+        _event = 0;
+    }
+}
+
+void Ticker::schedule(sim::time_ns when)
+{
+    _due = when;
+    _event = sim::at(when, [this] { fire(); });
+}
+
+void Ticker::fire()
+{
+    _event = 0;
+    if (!_one_shot) {
+        // Rearm first so the handler may detach
+        schedule(_due + _period);
+    }
+    sim::cpu(sim::COST_ISR);
+    _function();
+}
+
+void Timeout::attach(Callback<void()> func, std::chrono::microseconds t)
+{
+    detach();
+    _function = func;
+    _one_shot = true;
+    _period = sim::time_ns(t.count()) * sim::NS_PER_US;
+    schedule(sim::now() + _period);
+}
+
+DigitalOut::DigitalOut(PinName pin, int value) : _pin(pin)
+{
+    sim::pin(_pin).drive(value);
+    sim::pin(_pin).set_output(true);
+}
+
+void DigitalOut::write(int value)
+{
+    sim::cpu(sim::COST_GPIO);
+    sim::pin(_pin).drive(value);
+}
+
+int DigitalOut::read()
+{
+    sim::cpu(sim::COST_GPIO);
+    return sim::pin(_pin).driven();
+}
+
+DigitalIn::DigitalIn(PinName pin, PinMode pull) : _pin(pin)
+{
+    sim::pin(_pin).set_output(false);
+    mode(pull);
+}
+
+int DigitalIn::read()
+{
+    sim::cpu(sim::COST_GPIO);
+    return sim::pin(_pin).level();
+}
+
+void DigitalIn::mode(PinMode pull)
+{
+    if (pull == PullUp) {
+        sim::pin(_pin).present(1);
+    } else if (pull == PullDown) {
+        sim::pin(_pin).present(0);
+    }
+}
+
+DigitalInOut::DigitalInOut(PinName pin) : _pin(pin)
+{
+    sim::pin(_pin).set_output(false);
+}
+
+void DigitalInOut::write(int value)
+{
+    sim::cpu(sim::COST_GPIO);
+    sim::pin(_pin).drive(value);
+}
+
+int DigitalInOut::read()
+{
+    sim::cpu(sim::COST_GPIO);
+    return sim::pin(_pin).level();
+}
+
+void DigitalInOut::output()
+{
+    sim::cpu(sim::COST_GPIO);
+    sim::pin(_pin).set_output(true);
+}
+
+void DigitalInOut::input()
+{
+    sim::cpu(sim::COST_GPIO);
+    sim::pin(_pin).set_output(false);
+}
+
+void DigitalInOut::mode(PinMode pull)
+{
+    if (pull == PullUp) {
+        sim::pin(_pin).present(1);
+    } else if (pull == PullDown) {
+        sim::pin(_pin).present(0);
+    }
+}
+
+InterruptIn::InterruptIn(PinName pin, PinMode pull) : _pin(pin)
+{
+    sim::Pin &p = sim::pin(_pin);
+    p.set_output(false);
+    mode(pull);
+    _last = p.level();
+    p.attach(this);
+}
+
+InterruptIn::~InterruptIn()
+{
+    sim::pin(_pin).detach(this);
+}
+
+int InterruptIn::read()
+{
+    sim::cpu(sim::COST_GPIO);
+    return sim::pin(_pin).level();
+}
+
+void InterruptIn::rise(Callback<void()> func)
+{
+    _rise = func;
+}
+
+void InterruptIn::fall(Callback<void()> func)
+{
+    _fall = func;
+}
+
+void InterruptIn::mode(PinMode pull)
+{
+    if (pull == PullUp) {
+        sim::pin(_pin).present(1);
+    } else if (pull == PullDown) {
+        sim::pin(_pin).present(0);
+    }
+}
+
+void InterruptIn::enable_irq()
+{
+    _enabled = true;
+}
+
+void InterruptIn::disable_irq()
+{
+    _enabled = false;
+}
+
+void InterruptIn::pin_changed(sim::Pin &pin)
+{
+    int level = pin.level();
+    if (level == _last) {
+        return;
+    }
+    _last = level;
+    Callback<void()> &handler = level ? _rise : _fall;
+    if (_enabled && handler) {
+        sim::isr_enter();
+        sim::cpu(sim::COST_ISR);
+        handler();
+        sim::isr_exit();
+    }
+}
+
+PwmOut::PwmOut(PinName pin) : _pin(pin)
+{
+    sim::pin(_pin).set_output(true);
+}
+
+void PwmOut::write(float value)
+{
+    sim::cpu(sim::COST_GPIO);
+    _duty = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    apply();
+}
+
+float PwmOut::read()
+{
+    return _duty;
+}
+
+void PwmOut::period(float seconds)
+{
+    sim::cpu(sim::COST_PWM_CONFIG);
+    _period = sim::time_ns(std::llround(double(seconds) * sim::NS_PER_S));
+    apply();
+}
+
+void PwmOut::period_ms(int ms)
+{
+    sim::cpu(sim::COST_PWM_CONFIG);
+    _period = sim::time_ns(ms) * sim::NS_PER_MS;
+    apply();
+}
+
+void PwmOut::period_us(int us)
+{
+    sim::cpu(sim::COST_PWM_CONFIG);
+    _period = sim::time_ns(us) * sim::NS_PER_US;
+    apply();
+}
+
+void PwmOut::pulsewidth(float seconds)
+{
+    write(_period ? float(double(seconds) * sim::NS_PER_S / _period) : 0.0f);
+}
+
+void PwmOut::pulsewidth_ms(int ms)
+{
+    pulsewidth(ms / 1000.0f);
+}
+
+void PwmOut::pulsewidth_us(int us)
+{
+    pulsewidth(us / 1000000.0f);
+}
+
+void PwmOut::suspend()
+{
+    _suspended = true;
+    apply();
+}
+
+void PwmOut::resume()
+{
+    _suspended = false;
+    apply();
+}
+
+void PwmOut::apply()
+{
+    sim::pin(_pin).set_pwm(_suspended ? 0 : _period, _suspended ? 0 : _duty);
+}
+
+I2C::I2C(PinName, PinName)
+{
+}
+
+I2C::~I2C()
+{
+    abort_transfer();
+}
+
+void I2C::frequency(int hz)
+{
+    _hz = hz;
+}
+
+void I2C::lock()
+{
+    if (sim::in_isr()) {
+        std::fprintf(stderr, "mbed error: I2C bus mutex taken in interrupt "
+                             "context\n");
+        std::abort();
+    }
+}
+
+int I2C::write(int address, const char *data, int length, bool)
+{
+    lock();
+    bool ack = sim::i2c_bus().write(
+        address, reinterpret_cast<const uint8_t *>(data), size_t(length), _hz);
+    // Polled transfer: the CPU is busy for the whole transaction
+    sim::cpu(sim::I2CBus::transaction_time(size_t(length), _hz));
+    unlock();
+    return ack ? 0 : 1;
+}
+
+int I2C::transfer(int address, const char *tx_buffer, int tx_length,
+                  char *rx_buffer, int rx_length,
+                  const event_callback_t &callback, int event, bool)
+{
+    lock();
+    if (_transfer) {
+        unlock();
+        return -1;
+    }
+    sim::cpu(sim::COST_I2C_START);
+    // The target sees the bytes as they are clocked out from now on; the
+    // completion interrupt fires once the bus is released.
+    bool ack = true;
+    if (tx_length > 0) {
+        ack = sim::i2c_bus().write(
+            address, reinterpret_cast<const uint8_t *>(tx_buffer),
+            size_t(tx_length), _hz);
+    }
+    if (rx_length > 0) {
+        std::memset(rx_buffer, 0, size_t(rx_length));
+    }
+    sim::time_ns busy = sim::I2CBus::transaction_time(
+        size_t(tx_length > 0 ? tx_length : 0) +
+            size_t(rx_length > 0 ? rx_length : 0),
+        _hz);
+    int occurred = ack ? I2C_EVENT_TRANSFER_COMPLETE
+                       : I2C_EVENT_ERROR | I2C_EVENT_ERROR_NO_SLAVE;
+    // The completion closure is simulator plumbing; the HAL does not allocate
+    sim::HostScope scope;
+    event_callback_t done = callback;
+    _transfer = sim::at(sim::now() + busy, [this, done, occurred, event] {
+        _transfer = 0;
+        sim::cpu(sim::COST_ISR);
+        if (done && (occurred & event)) {
+            done(occurred & event);
+        }
+    });
+    unlock();
+    return 0;
+}
+
+void I2C::abort_transfer()
+{
+    if (_transfer) {
+        sim::cancel(_transfer);
+        _transfer = 0;
+    }
+}
+
+int I2C::read(int, char *data, int length, bool)
+{
+    lock();
+    std::memset(data, 0, size_t(length));
+    sim::cpu(sim::I2CBus::transaction_time(size_t(length), _hz));
+    unlock();
+    return 0;
+}
+
+Watchdog &Watchdog::get_instance()
+{
+    static Watchdog instance;
+    return instance;
+}
+
+bool Watchdog::start(uint32_t timeout)
+{
+    _timeout = timeout;
+    return start();
+}
+
+bool Watchdog::start()
+{
+    _running = true;
+    arm();
+    return true;
+}
+
+bool Watchdog::stop()
+{
+    _running = false;
+    if (_event) {
+        sim::cancel(_event);
+        _event = 0;
+    }
+    return true;
+}
+
+void Watchdog::kick()
+{
+    if (_running) {
+        arm();
+    }
+}
+
+void Watchdog::arm()
+{
+    if (_event) {
+        sim::cancel(_event);
+    }
+    _event = sim::at(sim::now() + sim::time_ns(_timeout) * sim::NS_PER_MS,
+                     [this] {
+                         _event = 0;
+                         _resets++;
+                         std::fprintf(stderr,
+                                      "sim: watchdog expired at %.3f s\n",
+                                      double(sim::now()) / sim::NS_PER_S);
+                         arm();
+                     });
+}
+
+int FlashIAP::read(void *buffer, uint32_t addr, uint32_t size)
+{
+    sim::HostScope scope;
+    if (!sim::flash().read(addr, buffer, size)) {
+        return -1;
+    }
+    // Flash reads at the bus width with no wait beyond the ART accelerator's
+    sim::cpu(sim::COST_GPIO * (size / 8 + 1));
+    return 0;
+}
+
+int FlashIAP::program(const void *buffer, uint32_t addr, uint32_t size)
+{
+    sim::HostScope scope;
+    return sim::flash().program(addr, buffer, size) ? 0 : -1;
+}
+
+int FlashIAP::erase(uint32_t addr, uint32_t size)
+{
+    sim::HostScope scope;
+    return sim::flash().erase(addr, size) ? 0 : -1;
+}
+
+uint32_t FlashIAP::get_sector_size(uint32_t addr) const
+{
+    return addr - sim::FlashStore::START < sim::FlashStore::SIZE ? sim::FlashStore::SECTOR_SIZE : MBED_FLASH_INVALID_SIZE;
+}
+
+uint32_t FlashIAP::get_flash_start() const
+{
+    return sim::FlashStore::START;
+}
+
+uint32_t FlashIAP::get_flash_size() const
+{
+    return sim::FlashStore::SIZE;
+}
+
+uint32_t FlashIAP::get_page_size() const
+{
+    return sim::FlashStore::PAGE_SIZE;
+}
+
+uint8_t FlashIAP::get_erase_value() const
+{
+    return sim::FlashStore::ERASE_VALUE;
+}
+
+namespace {
+reset_reason_t reset_reason = RESET_REASON_POWER_ON;
+} // namespace
+
+reset_reason_t ResetReason::get()
+{
+    return reset_reason;
+}
+
+void ResetReason::sim_set(reset_reason_t reason)
+{
+    reset_reason = reason;
+}
+
+BufferedSerial::BufferedSerial(PinName tx, PinName, int baud)
+    : _port(sim::uart(tx)), _baud(baud)
+{
+}
+
+ssize_t BufferedSerial::read(void *buffer, size_t size)
+{
+    char *out = static_cast<char *>(buffer);
+    while (!_port.readable()) {
+        if (!_blocking) {
+            return -EAGAIN;
+        }
+        sim::block(&_port.readers, sim::FOREVER);
+    }
+    size_t n = 0;
+    while (n < size && _port.read(out[n])) {
+        n++;
+    }
+    sim::cpu(sim::COST_GPIO * n);
+    return ssize_t(n);
+}
+
+ssize_t BufferedSerial::write(const void *buffer, size_t size)
+{
+    const char *data = static_cast<const char *>(buffer);
+    const size_t capacity = MBED_CONF_DRIVERS_UART_SERIAL_TXBUF_SIZE;
+
+    // Start and stop bit around every byte
+    const sim::time_ns byte_time = 10 * sim::NS_PER_S / sim::time_ns(_baud);
+    size_t written = 0;
+    while (written < size) {
+        sim::time_ns now = sim::now();
+        if (_tx_done < now) {
+            _tx_done = now;
+        }
+        size_t queued = size_t((_tx_done - now + byte_time - 1) / byte_time);
+        size_t room = queued < capacity ? capacity - queued : 0;
+        size_t n = std::min(room, size - written);
+        if (n == 0) {
+            if (!_blocking) {
+                break;
+            }
+
+            // Wait until the rest fits, or the buffer is empty if it never will
+            size_t wanted = std::min(size - written, capacity);
+            sim::time_ns until = _tx_done - sim::time_ns(capacity - wanted) * byte_time;
+            if (sim::in_isr() || !sim::current()) {
+                sim::cpu(until - now);
+            } else {
+                sim::sleep_until(until);
+            }
+            continue;
+        }
+        _port.transmit(data + written, n);
+        sim::cpu(sim::COST_GPIO * n);
+        _tx_done += sim::time_ns(n) * byte_time;
+        written += n;
+    }
+    return written ? ssize_t(written) : -EAGAIN;
+}
+
+bool BufferedSerial::readable() const
+{
+    return _port.readable();
+}
+
+void BufferedSerial::sigio(Callback<void()> func)
+{
+    sim::HostScope scope;
+    _port.on_receive([func] {
+        if (func) {
+            func();
+        }
+    });
+}
+
+} // namespace mbed
+
+int kv_set(const char *full_name_key, const void *buffer, size_t size, uint32_t)
+{
+    sim::HostScope scope;
+    sim::flash().set(full_name_key, std::string(static_cast<const char *>(buffer), size));
+    return MBED_SUCCESS;
+}
+
+int kv_get(const char *full_name_key, void *buffer, size_t buffer_size, size_t *actual_size)
+{
+    sim::HostScope scope;
+    std::string value;
+    if (!sim::flash().get(full_name_key, value)) {
+        return MBED_ERROR_ITEM_NOT_FOUND;
+    }
+    size_t n = std::min(buffer_size, value.size());
+    std::memcpy(buffer, value.data(), n);
+    if (actual_size) {
+        *actual_size = n;
+    }
+    return MBED_SUCCESS;
+}
+
+uint32_t SystemCoreClock = sim::CORE_HZ;
+
+osThreadId_t osThreadGetId()
+{
+    return sim::current();
+}
+
+uint32_t osThreadEnumerate(osThreadId_t *thread_array, uint32_t array_items)
+{
+    sim::Task *tasks[16];
+    size_t n = sim::task_list(tasks, std::min<size_t>(array_items, 16));
+    for (size_t i = 0; i < n; i++) {
+        thread_array[i] = tasks[i];
+    }
+    return uint32_t(n);
+}
+
+const char *osThreadGetName(osThreadId_t thread_id)
+{
+    return sim::task_name(static_cast<sim::Task *>(thread_id));
+}
+
+osPriority_t osThreadGetPriority(osThreadId_t thread_id)
+{
+    return osPriority_t(sim::task_info(static_cast<sim::Task *>(thread_id)).priority);
+}
+
+uint32_t osThreadGetStackSize(osThreadId_t thread_id)
+{
+    return sim::task_info(static_cast<sim::Task *>(thread_id)).stack_size;
+}
+
+uint32_t osThreadGetStackSpace(osThreadId_t thread_id)
+{
+    const sim::TaskStats &s = sim::task_info(static_cast<sim::Task *>(thread_id));
+    return s.stack_peak < s.stack_size ? s.stack_size - s.stack_peak : 0;
+}
+
+void mbed_stats_heap_get(mbed_stats_heap_t *stats)
+{
+    sim::HeapStats heap = sim::heap_stats();
+    *stats = mbed_stats_heap_t{};
+    stats->current_size = uint32_t(heap.current);
+    stats->max_size = uint32_t(heap.peak);
+    stats->alloc_cnt = uint32_t(heap.allocations);
+}
+
+void mbed_stats_cpu_get(mbed_stats_cpu_t *stats)
+{
+    *stats = mbed_stats_cpu_t{};
+    stats->uptime = sim::now() / sim::NS_PER_US;
+    stats->idle_time = sim::idle_time() / sim::NS_PER_US;
+    stats->sleep_time = stats->idle_time;
+}
+
+namespace rtos {
+
+void Mutex::lock()
+{
+    sim::Task *self = sim::current();
+    MBED_ASSERT(!sim::in_isr());
+    if (_owner && _owner != self) {
+        // unlock() hands ownership straight to the oldest waiter, as RTX does
+        sim::block(&_waiters, sim::FOREVER);
+        MBED_ASSERT(_owner == self);
+        return;
+    }
+    _owner = self;
+    _count++;
+}
+
+bool Mutex::trylock()
+{
+    sim::Task *self = sim::current();
+    if (_owner && _owner != self) {
+        return false;
+    }
+    _owner = self;
+    _count++;
+    return true;
+}
+
+bool Mutex::trylock_for(Kernel::Clock::duration_u32 rel_time)
+{
+    sim::Task *self = sim::current();
+    sim::time_ns deadline =
+        sim::now() + sim::time_ns(rel_time.count()) * sim::NS_PER_MS;
+    if (_owner && _owner != self) {
+        return sim::block(&_waiters, deadline);
+    }
+    _owner = self;
+    _count++;
+    return true;
+}
+
+void Mutex::unlock()
+{
+    MBED_ASSERT(_owner == sim::current());
+    if (--_count == 0) {
+        sim::Task *next = _waiters.head;
+        _owner = next;
+        if (next) {
+            _count = 1;
+            sim::wake_one(&_waiters);
+        }
+    }
+}
+
+void Semaphore::acquire()
+{
+    while (_count == 0) {
+        sim::block(&_waiters, sim::FOREVER);
+    }
+    _count--;
+}
+
+bool Semaphore::try_acquire()
+{
+    if (_count == 0) {
+        return false;
+    }
+    _count--;
+    return true;
+}
+
+bool Semaphore::try_acquire_for(Kernel::Clock::duration_u32 rel_time)
+{
+    sim::time_ns deadline =
+        sim::now() + sim::time_ns(rel_time.count()) * sim::NS_PER_MS;
+    while (_count == 0) {
+        if (!sim::block(&_waiters, deadline)) {
+            return false;
+        }
+    }
+    _count--;
+    return true;
+}
+
+osStatus Semaphore::release()
+{
+    if (_count >= _max) {
+        return osError;
+    }
+    _count++;
+    sim::wake_one(&_waiters);
+    return osOK;
+}
+
+osStatus Thread::start(mbed::Callback<void()> task)
+{
+    if (_task) {
+        return osError;
+    }
+    static int unnamed = 0;
+    std::string name = _name ? _name : "thread#" + std::to_string(++unnamed);
+    _task = sim::spawn(
+        [this, task] {
+            task();
+            _finished = true;
+            sim::wake_all(&_joiners);
+        },
+        name, _priority, _stack_size);
+    return osOK;
+}
+
+osStatus Thread::join()
+{
+    while (!_finished) {
+        sim::block(&_joiners, sim::FOREVER);
+    }
+    return osOK;
+}
+
+} // namespace rtos
+
+namespace events {
+
+EventQueue::EventQueue(unsigned size, unsigned char *)
+{
+    _capacity = size / EVENTS_EVENT_SIZE;
+    if (_capacity == 0) {
+        _capacity = 1;
+    }
+    _slots = new Slot[_capacity];
+}
+
+EventQueue::~EventQueue()
+{
+    for (size_t i = 0; i < _capacity; i++) {
+        if (_slots[i].used) {
+            release(&_slots[i]);
+        }
+    }
+    delete[] _slots;
+}
+
+EventQueue::Slot *EventQueue::allocate()
+{
+    for (size_t i = 0; i < _capacity; i++) {
+        if (!_slots[i].used) {
+            _slots[i].used = true;
+            _slots[i].generation++;
+            return &_slots[i];
+        }
+    }
+    _overflows++;
+    return nullptr;
+}
+
+int EventQueue::enqueue(Slot *slot, sim::time_ns delay, sim::time_ns period)
+{
+    slot->due = sim::now() + delay;
+    slot->period = period;
+    slot->order = _order++;
+    sim::wake_all(&_waiters);
+    int index = int(slot - _slots);
+    return (int(slot->generation) << 8 | index) + 1;
+}
+
+void EventQueue::release(Slot *slot)
+{
+    slot->destroy(slot->storage);
+    slot->used = false;
+}
+
+bool EventQueue::cancel(int id)
+{
+    if (id <= 0) {
+        return false;
+    }
+    size_t index = size_t((id - 1) & 0xFF);
+    uint16_t generation = uint16_t((id - 1) >> 8);
+    if (index >= _capacity || !_slots[index].used ||
+        _slots[index].generation != generation) {
+        return false;
+    }
+    if (&_slots[index] == _running) {
+        // A periodic event cancelling itself is released once it returns;
+        // a one-shot event is already past cancelling
+        _running_cancelled = _running->period != 0;
+        return _running_cancelled;
+    }
+    release(&_slots[index]);
+    return true;
+}
+
+int EventQueue::time_left(int id)
+{
+    if (id <= 0) {
+        return -1;
+    }
+    size_t index = size_t((id - 1) & 0xFF);
+    if (index >= _capacity || !_slots[index].used) {
+        return -1;
+    }
+    sim::time_ns due = _slots[index].due;
+    return due > sim::now() ? int((due - sim::now()) / sim::NS_PER_MS) : 0;
+}
+
+EventQueue::Slot *EventQueue::next_due(sim::time_ns &earliest)
+{
+    Slot *best = nullptr;
+    for (size_t i = 0; i < _capacity; i++) {
+        Slot &s = _slots[i];
+        if (!s.used) {
+            continue;
+        }
+        if (!best || s.due < best->due ||
+            (s.due == best->due && s.order < best->order)) {
+            best = &s;
+        }
+    }
+    earliest = best ? best->due : sim::FOREVER;
+    return best && best->due <= sim::now() ? best : nullptr;
+}
+
+bool EventQueue::dispatch_until(sim::time_ns deadline)
+{
+    _break = false;
+    for (;;) {
+        sim::time_ns earliest;
+        Slot *slot = next_due(earliest);
+        if (slot) {
+            sim::time_ns late = sim::now() - slot->due;
+            if (late > _max_lateness) {
+                _max_lateness = late;
+            }
+            if (slot->period) {
+                slot->due += slot->period;
+                slot->order = _order++;
+            }
+            _running = slot;
+            slot->invoke(slot->storage);
+            _running = nullptr;
+            if (!slot->period || _running_cancelled) {
+                _running_cancelled = false;
+                release(slot);
+            }
+            if (_break) {
+                return true;
+            }
+            continue;
+        }
+        if (_break || sim::now() >= deadline) {
+            return _break;
+        }
+        sim::block(&_waiters, earliest < deadline ? earliest : deadline);
+    }
+}
+
+void EventQueue::dispatch_forever()
+{
+    dispatch_until(sim::FOREVER);
+}
+
+void EventQueue::dispatch_for(duration ms)
+{
+    dispatch_until(ms.count() < 0 ? sim::FOREVER : sim::now() + to_ns(ms));
+}
+
+void EventQueue::break_dispatch()
+{
+    _break = true;
+    sim::wake_all(&_waiters);
+}
+
+} // namespace events
+
+namespace mbed {
+
+events::EventQueue *mbed_event_queue()
+{
+    // Dispatched by its own thread, as with the default
+    // events.shared-dispatch-from-application setting
+    static events::EventQueue queue(MBED_CONF_EVENTS_SHARED_EVENTSIZE);
+    static rtos::Thread thread(osPriorityNormal,
+                               MBED_CONF_EVENTS_SHARED_STACKSIZE, nullptr,
+                               "shared_event_queue");
+    static bool started = false;
+    if (!started) {
+        started = true;
+        thread.start(mbed::callback(&queue, &events::EventQueue::dispatch_forever));
+    }
+    return &queue;
+}
+
+} // namespace mbed
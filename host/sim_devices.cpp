@@ -0,0 +1,426 @@
+#include "sim_devices.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace sim {
+
+// Pin numbers as in PinName: (port << 4) | pin
+static const int PORT_D = 3;
+static const int PORT_E = 4;
+
+double Environment::temperature_c(time_ns t) const
+{
+    if (fire_start == FOREVER || t < fire_start) {
+        return ambient_c;
+    }
+    double minutes = double(t - fire_start) / (60.0 * NS_PER_S);
+    double rise = std::min(minutes * ramp_c_per_min, peak_c - ambient_c);
+    if (t >= fire_start + fire_length) {
+        // Fire is out: cool down at the rate it heated up
+        double burn = double(fire_length) / (60.0 * NS_PER_S);
+        double peak = std::min(burn * ramp_c_per_min, peak_c - ambient_c);
+        double since = double(t - fire_start - fire_length) /
+                       (60.0 * NS_PER_S);
+        rise = std::max(0.0, peak - since * ramp_c_per_min);
+    }
+    return ambient_c + rise;
+}
+
+double Environment::humidity_at(time_ns) const
+{
+    return humidity;
+}
+
+double Environment::sensed_c(double celsius) const
+{
+    if (tenths) {
+        return std::round(std::max(-20.0, std::min(60.0, celsius)) * 10) / 10;
+    }
+    return std::max(0.0, std::min(60.0, std::floor(celsius)));
+}
+
+Dht11Sensor::Dht11Sensor(int pin_name, const Environment &env)
+    : _pin(pin(pin_name)), _env(env)
+{
+    // External pull-up on the data line
+    _pin.present(1);
+    _pin.attach(this);
+}
+
+void Dht11Sensor::pin_changed(Pin &p)
+{
+    bool low = p.is_output() && p.driven() == 0;
+    if (low && !_host_low) {
+        _host_low = true;
+        _low_since = now();
+    } else if (!low && _host_low) {
+        _host_low = false;
+        // A start signal is at least 18 ms low
+        _armed = now() - _low_since >= 18 * NS_PER_MS;
+        if (_armed && !_busy) {
+            respond(now() + 30 * NS_PER_US);
+        }
+    }
+}
+
+void Dht11Sensor::respond(time_ns start)
+{
+    if (_frames && start - _last_frame < NS_PER_S) {
+        _early++;
+    }
+    _busy = true;
+    _last_frame = start;
+    _frames++;
+
+    double t = _env.temperature_c(start);
+    if (_env.glitch_every && _frames % _env.glitch_every == 0) {
+        t += _env.glitch_c;
+        _glitches++;
+    }
+    double h = _env.humidity_at(start);
+    int tenths = int(std::lround(_env.sensed_c(t) * 10));
+    _previous_tenths = _last_tenths;
+    _last_tenths = tenths;
+
+    // Byte 2 holds the whole degrees and byte 3 the tenths, both of the
+    // magnitude, with the sign in bit 7 of byte 3
+    uint8_t bytes[5];
+    bytes[0] = uint8_t(std::max(0.0, std::min(95.0, std::round(h))));
+    bytes[1] = 0;
+    bytes[2] = uint8_t(std::abs(tenths) / 10);
+    bytes[3] = uint8_t(std::abs(tenths) % 10 | (tenths < 0 ? 0x80 : 0));
+    bytes[4] = uint8_t(bytes[0] + bytes[1] + bytes[2] + bytes[3]);
+
+    // 80 us low / 80 us high acknowledge, then per bit 50 us low followed by
+    // 26 us (0) or 70 us (1) high, and a final 50 us low before release.
+    time_ns when = start;
+    at(when, [this] { _pin.present(0); });
+    when += 80 * NS_PER_US;
+    at(when, [this] { _pin.present(1); });
+    when += 80 * NS_PER_US;
+    for (int i = 0; i < 40; i++) {
+        bool one = (bytes[i / 8] >> (7 - i % 8)) & 1;
+        at(when, [this] { _pin.present(0); });
+        when += 50 * NS_PER_US;
+        at(when, [this] { _pin.present(1); });
+        when += (one ? 70 : 26) * NS_PER_US;
+    }
+    at(when, [this] { _pin.present(0); });
+    when += 50 * NS_PER_US;
+    at(when, [this] {
+        _pin.present(1);
+        _busy = false;
+    });
+}
+
+Lcd1802::Lcd1802()
+{
+    std::fill(_ddram, _ddram + sizeof(_ddram), ' ');
+}
+
+bool Lcd1802::write(const uint8_t *data, size_t length, time_ns start,
+                    time_ns byte_ns)
+{
+    // Control byte: Co (bit 7) says another control byte follows the next
+    // data byte, RS (bit 6) selects data instead of command.
+    size_t i = 0;
+    while (i < length) {
+        uint8_t control = data[i++];
+        bool co = control & 0x80;
+        bool rs = control & 0x40;
+        do {
+            if (i >= length) {
+                break;
+            }
+            time_ns when = start + time_ns(i + 1) * byte_ns;
+            if (rs) {
+                this->data(data[i], when);
+            } else {
+                command(data[i], when);
+            }
+            i++;
+        } while (!co);
+    }
+    changed();
+    return true;
+}
+
+void Lcd1802::check_busy(time_ns at, time_ns exec)
+{
+    if (at < _busy_until) {
+        _violations++;
+    }
+    _busy_until = std::max(at, _busy_until) + exec;
+}
+
+void Lcd1802::command(uint8_t value, time_ns at)
+{
+    _commands++;
+    if (value & 0x80) {
+        _ac = value & 0x7F;
+        check_busy(at, 39 * NS_PER_US);
+    } else if (value & 0x40) {
+        check_busy(at, 39 * NS_PER_US);
+    } else if (value & 0x20) {
+        check_busy(at, 39 * NS_PER_US);
+    } else if (value & 0x10) {
+        check_busy(at, 39 * NS_PER_US);
+    } else if (value & 0x08) {
+        _display_on = value & 0x04;
+        check_busy(at, 39 * NS_PER_US);
+    } else if (value & 0x04) {
+        _increment = value & 0x02;
+        check_busy(at, 39 * NS_PER_US);
+    } else if (value & 0x02) {
+        _ac = 0;
+        check_busy(at, 1530 * NS_PER_US);
+    } else if (value & 0x01) {
+        std::fill(_ddram, _ddram + sizeof(_ddram), ' ');
+        _ac = 0;
+        check_busy(at, 1530 * NS_PER_US);
+    }
+}
+
+void Lcd1802::data(uint8_t value, time_ns at)
+{
+    _characters++;
+    check_busy(at, 43 * NS_PER_US);
+    _ddram[_ac & 0x7F] = value;
+    _ac = uint8_t((_ac + (_increment ? 1 : -1)) & 0x7F);
+}
+
+std::string Lcd1802::row(int row) const
+{
+    std::string text;
+    const uint8_t *line = _ddram + (row ? 0x40 : 0x00);
+    for (int col = 0; col < 16; col++) {
+        uint8_t c = line[col];
+        if (c == 0xDF) {
+            text += "°";
+        } else if (c >= 0x20 && c < 0x7F) {
+            text += char(c);
+        } else {
+            text += '?';
+        }
+    }
+    return text;
+}
+
+void Lcd1802::changed()
+{
+    if (!_trace) {
+        return;
+    }
+    // Report the panel once it has been stable for a few milliseconds
+    // instead of after every character
+    _trace_due = now() + 5 * NS_PER_MS;
+    if (_trace_pending) {
+        return;
+    }
+    _trace_pending = true;
+    at(_trace_due, [this] { show(); });
+}
+
+void Lcd1802::show()
+{
+    if (now() < _trace_due) {
+        at(_trace_due, [this] { show(); });
+        return;
+    }
+    _trace_pending = false;
+    std::string shown = row(0) + "|" + row(1);
+    if (shown != _shown) {
+        _shown = shown;
+        std::printf("[%10.3f s] lcd |%s|\n", double(now()) / NS_PER_S,
+                    shown.c_str());
+    }
+}
+
+bool RgbBacklight::write(const uint8_t *data, size_t length, time_ns,
+                         time_ns)
+{
+    if (length == 0) {
+        return true;
+    }
+    // Control register: register pointer in the low nibble, AI2 (bit 7)
+    // enables auto-increment over all 13 registers.
+    uint8_t reg = data[0] & 0x0F;
+    bool increment = data[0] & 0x80;
+    uint8_t before[3] = {_regs[2], _regs[3], _regs[4]};
+    for (size_t i = 1; i < length; i++) {
+        _regs[reg] = data[i];
+        if (increment) {
+            reg = uint8_t((reg + 1) % 13);
+        }
+    }
+    if (before[0] != _regs[2] || before[1] != _regs[3] ||
+        before[2] != _regs[4]) {
+        _changes++;
+    }
+    return true;
+}
+
+namespace {
+
+const char KEYMAP[4][4] = {
+    {'1', '2', '3', 'A'},
+    {'4', '5', '6', 'B'},
+    {'7', '8', '9', 'C'},
+    {'*', '0', '#', 'D'},
+};
+
+// Row 0 is driven by PD_6 down to row 3 on PD_3
+const int ROW_PINS[4] = {(PORT_D << 4) | 6, (PORT_D << 4) | 5,
+                         (PORT_D << 4) | 4, (PORT_D << 4) | 3};
+const int COL_PINS[4] = {(PORT_E << 4) | 2, (PORT_E << 4) | 4,
+                         (PORT_E << 4) | 5, (PORT_E << 4) | 6};
+
+} // namespace
+
+Keypad4x4::Keypad4x4()
+{
+    for (int r = 0; r < 4; r++) {
+        pin(ROW_PINS[r]).attach(this);
+    }
+}
+
+bool Keypad4x4::locate(char key, int &row, int &col)
+{
+    for (row = 0; row < 4; row++) {
+        for (col = 0; col < 4; col++) {
+            if (KEYMAP[row][col] == key) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Keypad4x4::tap(char key, time_ns when)
+{
+    _taps.push_back(Tap{key, when});
+    if (!_tap_active && _taps.size() == 1) {
+        at(when, [this] { start_next_tap(); });
+    }
+}
+
+void Keypad4x4::start_next_tap()
+{
+    if (_tap_active || _taps.empty()) {
+        return;
+    }
+    Tap tap = _taps.front();
+    if (tap.at > now()) {
+        at(tap.at, [this] { start_next_tap(); });
+        return;
+    }
+    _taps.pop_front();
+    if (!locate(tap.key, _tap_row, _tap_col)) {
+        start_next_tap();
+        return;
+    }
+    _tap_active = true;
+    _tap_seen = false;
+    _pressed[_tap_row][_tap_col] = true;
+    update();
+}
+
+void Keypad4x4::release_tap()
+{
+    _pressed[_tap_row][_tap_col] = false;
+    _tap_active = false;
+    _taps_done++;
+    update();
+    if (!_taps.empty()) {
+        // Leave a short gap between keys, as a person would
+        Tap &next = _taps.front();
+        next.at = std::max(next.at, now() + 50 * NS_PER_MS);
+        at(next.at, [this] { start_next_tap(); });
+    }
+}
+
+void Keypad4x4::hold(char key, time_ns when, time_ns duration)
+{
+    int row, col;
+    if (!locate(key, row, col)) {
+        return;
+    }
+    at(when, [this, row, col] {
+        _pressed[row][col] = true;
+        update();
+    });
+    at(when + duration, [this, row, col] {
+        _pressed[row][col] = false;
+        update();
+    });
+}
+
+void Keypad4x4::pin_changed(Pin &)
+{
+    update();
+}
+
+void Keypad4x4::update()
+{
+    if (_tap_active && !_tap_seen && pin(ROW_PINS[_tap_row]).level()) {
+        _tap_seen = true;
+        at(now() + TAP_HOLD, [this] { release_tap(); });
+    }
+    for (int c = 0; c < 4; c++) {
+        int level = 0;
+        for (int r = 0; r < 4; r++) {
+            if (_pressed[r][c] && pin(ROW_PINS[r]).level()) {
+                level = 1;
+            }
+        }
+        pin(COL_PINS[c]).present(level);
+    }
+}
+
+AlarmMonitor::AlarmMonitor(int led_pin, int buzzer_pin)
+    : _led_pin(led_pin), _buzzer_pin(buzzer_pin)
+{
+    pin(led_pin).attach(this);
+    pin(buzzer_pin).attach(this);
+}
+
+void AlarmMonitor::pin_changed(Pin &p)
+{
+    if (p.name() == _led_pin) {
+        int led = p.level();
+        if (led != _led) {
+            _led = led;
+            (led ? _on : _off).push_back(now());
+        }
+        return;
+    }
+    bool sounding = p.pwm_period() != 0 && p.pwm_duty() > 0.0f;
+    _tone_changes++;
+    if (sounding && !_sounding) {
+        _sound_since = now();
+    } else if (!sounding && _sounding) {
+        _sound_total += now() - _sound_since;
+    }
+    _sounding = sounding;
+}
+
+time_ns AlarmMonitor::first_on_after(time_ns t) const
+{
+    auto it = std::lower_bound(_on.begin(), _on.end(), t);
+    return it == _on.end() ? FOREVER : *it;
+}
+
+time_ns AlarmMonitor::first_off_after(time_ns t) const
+{
+    auto it = std::lower_bound(_off.begin(), _off.end(), t);
+    return it == _off.end() ? FOREVER : *it;
+}
+
+time_ns AlarmMonitor::buzzer_on_time() const
+{
+    return _sound_total + (_sounding ? now() - _sound_since : 0);
+}
+
+} // namespace sim
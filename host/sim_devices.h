@@ -0,0 +1,203 @@
+/*
+ * Models of the parts wired to the Nucleo: the DHT11 sensor line, the 1802
+ * LCD and its RGB backlight controller, the 4x4 keypad matrix, and a monitor
+ * on the buzzer and red LED. The harness drives them from an Environment.
+ */
+
+#ifndef SIM_DEVICES_H
+#define SIM_DEVICES_H
+
+#include "sim_io.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+/** Room the sensor sits in: ambient conditions plus an optional fire. */
+struct Environment {
+    double ambient_c = 22.0;
+    double humidity = 45.0;
+    time_ns fire_start = FOREVER;
+    time_ns fire_length = 20 * 60 * NS_PER_S;
+    double ramp_c_per_min = 5.0;
+    double peak_c = 60.0;
+    // Every Nth sensor frame reads glitch_c too hot (0: never)
+    int glitch_every = 0;
+    double glitch_c = 40.0;
+    // The sensor also sends tenths, with a sign bit below 0 C, as newer
+    // DHT11 parts do; older ones send whole degrees from 0 C
+    bool tenths = false;
+
+    double temperature_c(time_ns t) const;
+    double humidity_at(time_ns t) const;
+
+    /// @p celsius as the sensor reports it: clamped to its range, and
+    /// rounded down to whole degrees or to the nearest tenth.
+    double sensed_c(double celsius) const;
+};
+
+/** DHT11 single-wire sensor: answers a start pulse with a 40-bit frame. */
+class Dht11Sensor : public PinListener {
+public:
+    Dht11Sensor(int pin_name, const Environment &env);
+
+    void pin_changed(Pin &pin) override;
+
+    uint64_t frames() const { return _frames; }
+    uint64_t early_requests() const { return _early; }
+    uint64_t glitches() const { return _glitches; }
+
+    /// Temperature in tenths of a degree in the last frame sent, and in the
+    /// one before it.
+    int last_tenths() const { return _last_tenths; }
+    int previous_tenths() const { return _previous_tenths; }
+
+private:
+    void respond(time_ns start);
+
+    Pin &_pin;
+    const Environment &_env;
+    bool _host_low = false;
+    time_ns _low_since = 0;
+    bool _armed = false;
+    bool _busy = false;
+    time_ns _last_frame = 0;
+    uint64_t _frames = 0;
+    uint64_t _early = 0;
+    uint64_t _glitches = 0;
+    int _last_tenths = 0;
+    int _previous_tenths = 0;
+};
+
+/** JHD1802 text controller (HD44780 command set over I2C). */
+class Lcd1802 : public I2CDevice {
+public:
+    Lcd1802();
+
+    bool write(const uint8_t *data, size_t length, time_ns start,
+               time_ns byte_ns) override;
+
+    /// Visible text of @p row (16 columns), degree glyph as UTF-8.
+    std::string row(int row) const;
+
+    uint64_t commands() const { return _commands; }
+    uint64_t characters() const { return _characters; }
+
+    /// Bytes that arrived while the controller was still busy.
+    uint64_t timing_violations() const { return _violations; }
+
+    /// Print every visible change to stdout.
+    void set_trace(bool trace) { _trace = trace; }
+
+private:
+    void command(uint8_t value, time_ns at);
+    void data(uint8_t value, time_ns at);
+    void check_busy(time_ns at, time_ns exec);
+    void changed();
+    void show();
+
+    uint8_t _ddram[0x80];
+    uint8_t _ac = 0;
+    bool _increment = true;
+    bool _display_on = false;
+    time_ns _busy_until = 0;
+    uint64_t _commands = 0;
+    uint64_t _characters = 0;
+    uint64_t _violations = 0;
+    bool _trace = false;
+    bool _trace_pending = false;
+    time_ns _trace_due = 0;
+    std::string _shown;
+};
+
+/** PCA9633 RGB backlight controller of the Grove 1802 module. */
+class RgbBacklight : public I2CDevice {
+public:
+    bool write(const uint8_t *data, size_t length, time_ns start,
+               time_ns byte_ns) override;
+
+    uint8_t red() const { return _regs[4]; }
+    uint8_t green() const { return _regs[3]; }
+    uint8_t blue() const { return _regs[2]; }
+
+    /// Times the visible colour changed.
+    uint64_t colour_changes() const { return _changes; }
+
+private:
+    uint8_t _regs[16] = {};
+    uint64_t _changes = 0;
+};
+
+/** 4x4 membrane keypad: rows PD_6..PD_3 in, columns PE_2/4/5/6 out. */
+class Keypad4x4 : public PinListener {
+public:
+    Keypad4x4();
+
+    /// Press @p key at @p at and let go once the firmware has scanned it.
+    void tap(char key, time_ns at);
+
+    /// Hold @p key from @p at for @p duration.
+    void hold(char key, time_ns at, time_ns duration);
+
+    void pin_changed(Pin &pin) override;
+
+    uint64_t taps_done() const { return _taps_done; }
+    size_t taps_pending() const { return _taps.size() + (_tap_active ? 1 : 0); }
+
+    /// How long a tap stays down after its row was first driven.
+    static const time_ns TAP_HOLD = 80 * NS_PER_MS;
+
+private:
+    struct Tap {
+        char key;
+        time_ns at;
+    };
+
+    void start_next_tap();
+    void release_tap();
+    void update();
+    static bool locate(char key, int &row, int &col);
+
+    bool _pressed[4][4] = {};
+    std::deque<Tap> _taps;
+    bool _tap_active = false;
+    bool _tap_seen = false;
+    int _tap_row = 0;
+    int _tap_col = 0;
+    uint64_t _taps_done = 0;
+};
+
+/** Watches the red LED and the buzzer PWM. */
+class AlarmMonitor : public PinListener {
+public:
+    AlarmMonitor(int led_pin, int buzzer_pin);
+
+    void pin_changed(Pin &pin) override;
+
+    /// First LED switch-on at or after @p t, FOREVER if none.
+    time_ns first_on_after(time_ns t) const;
+
+    /// First LED switch-off at or after @p t, FOREVER if none.
+    time_ns first_off_after(time_ns t) const;
+
+    uint64_t led_on_count() const { return _on.size(); }
+    uint64_t tone_changes() const { return _tone_changes; }
+    time_ns buzzer_on_time() const;
+
+private:
+    int _led_pin;
+    int _buzzer_pin;
+    int _led = 0;
+    bool _sounding = false;
+    time_ns _sound_since = 0;
+    time_ns _sound_total = 0;
+    uint64_t _tone_changes = 0;
+    std::vector<time_ns> _on;
+    std::vector<time_ns> _off;
+};
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Global operator new and delete for the host simulation build.
+ *
+ * Every allocation of the process goes through here so that those made by
+ * the firmware can be counted; see sim::heap_stats().
+ */
+
+#include "sim_kernel.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Placed before every block so that delete knows its size and owner
+struct alignas(std::max_align_t) Header {
+    std::size_t size;
+    bool firmware;
+};
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+    bool firmware = sim::count_allocation(size);
+    Header *h = static_cast<Header *>(std::malloc(sizeof(Header) + size));
+    if (!h) {
+        throw std::bad_alloc();
+    }
+    h->size = size;
+    h->firmware = firmware;
+    return h + 1;
+}
+
+void operator delete(void *p) noexcept
+{
+    if (!p) {
+        return;
+    }
+    Header *h = static_cast<Header *>(p) - 1;
+    if (h->firmware) {
+        sim::count_free(h->size);
+    }
+    std::free(h);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
@@ -0,0 +1,508 @@
+#include "sim_io.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace sim {
+
+void Pin::set_output(bool output)
+{
+    if (_output != output) {
+        _output = output;
+        changed();
+    }
+}
+
+void Pin::drive(int value)
+{
+    value = value ? 1 : 0;
+    if (_out != value) {
+        _out = value;
+        gpio_port(port()).ODR.value =
+            (gpio_port(port()).ODR.value & ~(1u << bit())) | (value << bit());
+        if (_output) {
+            changed();
+        }
+    }
+}
+
+void Pin::present(int value)
+{
+    value = value ? 1 : 0;
+    if (_ext != value) {
+        _ext = value;
+        if (!_output) {
+            changed();
+        }
+    }
+}
+
+void Pin::set_pwm(time_ns period, float duty)
+{
+    if (_pwm_period != period || _pwm_duty != duty) {
+        _pwm_period = period;
+        _pwm_duty = duty;
+        changed();
+    }
+}
+
+void Pin::attach(PinListener *listener)
+{
+    _listeners.push_back(listener);
+}
+
+void Pin::detach(PinListener *listener)
+{
+    _listeners.erase(
+        std::remove(_listeners.begin(), _listeners.end(), listener),
+        _listeners.end());
+}
+
+void Pin::changed()
+{
+    HostScope scope;
+    // Index loop: a listener may attach another one while we iterate
+    for (size_t i = 0; i < _listeners.size(); i++) {
+        _listeners[i]->pin_changed(*this);
+    }
+}
+
+Pin &pin(int name)
+{
+    static std::unique_ptr<Pin> pins[8 * 16];
+    int index = name & 0x7F;
+    if (!pins[index]) {
+        pins[index].reset(new Pin(index));
+    }
+    return *pins[index];
+}
+
+namespace {
+
+void moder_written(Reg &reg, uint32_t old)
+{
+    uint32_t changed = reg.value ^ old;
+    for (int bit = 0; bit < 16; bit++) {
+        if ((changed >> (2 * bit)) & 0x3) {
+            uint32_t mode = (reg.value >> (2 * bit)) & 0x3;
+            pin((reg.port << 4) | bit).set_output(mode == 1);
+        }
+    }
+}
+
+void odr_written(Reg &reg, uint32_t old)
+{
+    uint32_t changed = (reg.value ^ old) & 0xFFFF;
+    uint32_t value = reg.value;
+    for (int bit = 0; bit < 16; bit++) {
+        if (changed & (1u << bit)) {
+            pin((reg.port << 4) | bit).drive((value >> bit) & 1);
+        }
+    }
+}
+
+void bsrr_written(Reg &reg, uint32_t)
+{
+    GpioPort &p = gpio_port(reg.port);
+    uint32_t set = reg.value & 0xFFFF;
+    uint32_t reset = reg.value >> 16;
+    p.ODR = (p.ODR.value & ~reset) | set;
+    reg.value = 0;
+}
+
+// Pull-up or pull-down: the level seen while nothing else drives the line
+void pupdr_written(Reg &reg, uint32_t old)
+{
+    uint32_t changed = reg.value ^ old;
+    for (int bit = 0; bit < 16; bit++) {
+        if ((changed >> (2 * bit)) & 0x3) {
+            uint32_t pull = (reg.value >> (2 * bit)) & 0x3;
+            if (pull == 1) {
+                pin((reg.port << 4) | bit).present(1);
+            } else if (pull == 2) {
+                pin((reg.port << 4) | bit).present(0);
+            }
+        }
+    }
+}
+
+uint32_t idr_read(const Reg &reg)
+{
+    uint32_t value = 0;
+    for (int bit = 0; bit < 16; bit++) {
+        value |= uint32_t(pin((reg.port << 4) | bit).level()) << bit;
+    }
+    return value;
+}
+
+} // namespace
+
+GpioPort &gpio_port(int index)
+{
+    static GpioPort ports[8];
+    static bool wired = false;
+    if (!wired) {
+        wired = true;
+        for (int i = 0; i < 8; i++) {
+            ports[i].MODER.port = i;
+            ports[i].MODER.on_write = moder_written;
+            ports[i].ODR.port = i;
+            ports[i].ODR.on_write = odr_written;
+            ports[i].BSRR.port = i;
+            ports[i].BSRR.on_write = bsrr_written;
+            ports[i].PUPDR.port = i;
+            ports[i].PUPDR.on_write = pupdr_written;
+            ports[i].IDR.port = i;
+            ports[i].IDR.on_read = idr_read;
+        }
+    }
+    return ports[index & 7];
+}
+
+namespace {
+
+uint32_t core_cycles()
+{
+    return uint32_t(now() * (CORE_HZ / 1000000) / NS_PER_US);
+}
+
+// CYCCNT keeps the offset from the core clock in its value
+void cyccnt_written(Reg &reg, uint32_t)
+{
+    reg.value -= core_cycles();
+}
+
+uint32_t cyccnt_read(const Reg &reg)
+{
+    return core_cycles() + reg.value;
+}
+
+} // namespace
+
+DwtBlock &dwt()
+{
+    static DwtBlock block;
+    if (!block.CYCCNT.on_read) {
+        block.CYCCNT.on_write = cyccnt_written;
+        block.CYCCNT.on_read = cyccnt_read;
+    }
+    return block;
+}
+
+CoreDebugBlock &core_debug()
+{
+    static CoreDebugBlock block;
+    return block;
+}
+
+RccBlock &rcc()
+{
+    static RccBlock block;
+    return block;
+}
+
+void I2CBus::attach(int addr, I2CDevice *dev)
+{
+    _devices[addr & 0xFF] = dev;
+}
+
+time_ns I2CBus::transaction_time(size_t length, int hz)
+{
+    // START + address + payload, 9 clocks per byte, STOP
+    return time_ns((length + 1) * 9 + 2) * NS_PER_S / time_ns(hz);
+}
+
+bool I2CBus::write(int addr, const uint8_t *data, size_t length, int hz)
+{
+    HostScope scope;
+    I2CStats &s = _stats[addr & 0xFF];
+    time_ns busy = transaction_time(length, hz);
+    s.transactions++;
+    s.bytes += length;
+    s.busy += busy;
+    _total.transactions++;
+    _total.bytes += length;
+    _total.busy += busy;
+
+    I2CDevice *dev = _devices[addr & 0xFF];
+    time_ns byte_ns = 9 * NS_PER_S / time_ns(hz);
+    if (!dev || !dev->write(data, length, now(), byte_ns)) {
+        s.nacks++;
+        _total.nacks++;
+        return false;
+    }
+    return true;
+}
+
+I2CBus &i2c_bus()
+{
+    static I2CBus bus;
+    return bus;
+}
+
+void Console::receive(char c)
+{
+    _rx.push_back(c);
+    wake_all(&readers);
+    if (_listener) {
+        _listener();
+    }
+}
+
+bool Console::read(char &c)
+{
+    if (_rx.empty()) {
+        return false;
+    }
+    c = _rx.front();
+    _rx.pop_front();
+    return true;
+}
+
+void Console::transmit(const char *data, size_t length)
+{
+    // Whatever the host does with the bytes is not the firmware's
+    HostScope scope;
+    if (_out) {
+        std::fwrite(data, 1, length, _out);
+    }
+    if (_monitor) {
+        _monitor(data, length);
+    }
+    _transmitted += length;
+}
+
+Console &console()
+{
+    static Console port;
+    return port;
+}
+
+Console &uart(int tx)
+{
+    // USBTX, as PG_7 in mbed.h
+    if (tx == 0x67) {
+        return console();
+    }
+    static std::map<int, std::unique_ptr<Console>> ports;
+    std::unique_ptr<Console> &port = ports[tx];
+    if (!port) {
+        port.reset(new Console(nullptr));
+    }
+    return *port;
+}
+
+namespace {
+
+// Time to erase and program a KVStore record of internal flash, pessimistically
+const time_ns FLASH_WRITE_NS = 25 * NS_PER_MS;
+
+// Data sheet times of the STM32L4R5: programming one double word, erasing a page
+const time_ns FLASH_PROGRAM_NS = 90 * NS_PER_US;
+const time_ns FLASH_ERASE_NS = 25 * NS_PER_MS;
+
+void put32(std::string &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out += char(value >> (8 * i));
+    }
+}
+
+void put_string(std::string &out, const std::string &value)
+{
+    put32(out, uint32_t(value.size()));
+    out += value;
+}
+
+bool get32(const std::string &in, size_t &at, uint32_t &value)
+{
+    if (in.size() - at < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= uint32_t(uint8_t(in[at + i])) << (8 * i);
+    }
+    at += 4;
+    return true;
+}
+
+bool get_string(const std::string &in, size_t &at, std::string &value)
+{
+    uint32_t length;
+    if (!get32(in, at, length) || in.size() - at < length) {
+        return false;
+    }
+    value = in.substr(at, length);
+    at += length;
+    return true;
+}
+
+} // namespace
+
+// The file holds a little-endian u32 count of items, each as a u32 length and
+// the bytes of the key and then of the value, and a u32 count of sectors,
+// each as its u32 address, u32 erase count and u32 length and bytes
+bool FlashStore::open(const std::string &path)
+{
+    _path = path;
+    _items.clear();
+    _sectors.clear();
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) {
+        return true;
+    }
+    std::string data;
+    char chunk[4096];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data.append(chunk, n);
+    }
+    std::fclose(f);
+
+    size_t at = 0;
+    uint32_t count;
+    if (!get32(data, at, count)) {
+        return false;
+    }
+    std::string key, value;
+    while (count--) {
+        if (!get_string(data, at, key) || !get_string(data, at, value)) {
+            return false;
+        }
+        _items[key] = value;
+    }
+    if (!get32(data, at, count)) {
+        return false;
+    }
+    while (count--) {
+        uint32_t addr;
+        Sector sector;
+        if (!get32(data, at, addr) || !get32(data, at, sector.erases) ||
+            !get_string(data, at, sector.data) ||
+            sector.data.size() != SECTOR_SIZE) {
+            return false;
+        }
+        _sectors[addr] = sector;
+    }
+    return at == data.size();
+}
+
+void FlashStore::save() const
+{
+    if (_path.empty()) {
+        return;
+    }
+    std::string data;
+    put32(data, uint32_t(_items.size()));
+    for (const auto &item : _items) {
+        put_string(data, item.first);
+        put_string(data, item.second);
+    }
+    put32(data, uint32_t(_sectors.size()));
+    for (const auto &sector : _sectors) {
+        put32(data, sector.first);
+        put32(data, sector.second.erases);
+        put_string(data, sector.second.data);
+    }
+    std::FILE *f = std::fopen(_path.c_str(), "wb");
+    if (f) {
+        std::fwrite(data.data(), 1, data.size(), f);
+        std::fclose(f);
+    }
+}
+
+bool FlashStore::get(const std::string &key, std::string &value) const
+{
+    auto item = _items.find(key);
+    if (item == _items.end()) {
+        return false;
+    }
+    value = item->second;
+    return true;
+}
+
+void FlashStore::set(const std::string &key, const std::string &value)
+{
+    cpu(FLASH_WRITE_NS);
+    _items[key] = value;
+    _writes++;
+    save();
+}
+
+bool FlashStore::in_flash(uint32_t addr, size_t size) const
+{
+    return addr >= START && size <= SIZE && addr - START <= SIZE - size;
+}
+
+bool FlashStore::read(uint32_t addr, void *buffer, size_t size) const
+{
+    if (!in_flash(addr, size)) {
+        return false;
+    }
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    for (size_t i = 0; i < size; i++) {
+        uint32_t a = addr + uint32_t(i);
+        auto sector = _sectors.find(a - a % SECTOR_SIZE);
+        out[i] = sector == _sectors.end() ? ERASE_VALUE
+                                          : uint8_t(sector->second.data[a % SECTOR_SIZE]);
+    }
+    return true;
+}
+
+bool FlashStore::program(uint32_t addr, const void *buffer, size_t size)
+{
+    // Double words must be erased before they are programmed
+    std::vector<uint8_t> current(size);
+    if (!in_flash(addr, size) || addr % PAGE_SIZE || size % PAGE_SIZE ||
+        !read(addr, current.data(), size) ||
+        std::any_of(current.begin(), current.end(),
+                    [](uint8_t b) { return b != ERASE_VALUE; })) {
+        _errors++;
+        return false;
+    }
+    cpu(FLASH_PROGRAM_NS * (size / PAGE_SIZE));
+    const uint8_t *in = static_cast<const uint8_t *>(buffer);
+    for (size_t i = 0; i < size; i++) {
+        uint32_t a = addr + uint32_t(i);
+        Sector &sector = _sectors[a - a % SECTOR_SIZE];
+        if (sector.data.empty()) {
+            sector.data.assign(SECTOR_SIZE, char(ERASE_VALUE));
+        }
+        sector.data[a % SECTOR_SIZE] = char(in[i]);
+    }
+    save();
+    return true;
+}
+
+bool FlashStore::erase(uint32_t addr, size_t size)
+{
+    if (!in_flash(addr, size) || addr % SECTOR_SIZE || size % SECTOR_SIZE) {
+        _errors++;
+        return false;
+    }
+    for (size_t offset = 0; offset < size; offset += SECTOR_SIZE) {
+        cpu(FLASH_ERASE_NS);
+        Sector &sector = _sectors[addr + uint32_t(offset)];
+        sector.data.assign(SECTOR_SIZE, char(ERASE_VALUE));
+        sector.erases++;
+    }
+    save();
+    return true;
+}
+
+uint32_t FlashStore::erase_count(uint32_t addr) const
+{
+    auto sector = _sectors.find(addr - addr % SECTOR_SIZE);
+    return sector == _sectors.end() ? 0 : sector->second.erases;
+}
+
+FlashStore &flash()
+{
+    static FlashStore store;
+    return store;
+}
+
+} // namespace sim
@@ -0,0 +1,317 @@
+/*
+ * Simulated I/O fabric for the host build: GPIO lines, the memory-mapped GPIO
+ * registers the firmware pokes directly, and the shared I2C bus.
+ */
+
+#ifndef SIM_IO_H
+#define SIM_IO_H
+
+#include "sim_kernel.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+class Pin;
+
+/// Something that wants to know when a GPIO line changes.
+class PinListener {
+public:
+    virtual ~PinListener() {}
+
+    /// Called whenever the level, the MCU drive state or the PWM setting of
+    /// @p pin changes.
+    virtual void pin_changed(Pin &pin) = 0;
+};
+
+/// One GPIO line as seen from both sides: the MCU (mode and output level)
+/// and the outside world (level presented while the MCU is not driving it).
+class Pin {
+public:
+    explicit Pin(int name) : _name(name) {}
+
+    int name() const { return _name; }
+    int port() const { return (_name >> 4) & 0xF; }
+    int bit() const { return _name & 0xF; }
+
+    /// Level on the wire.
+    int level() const { return _output ? _out : _ext; }
+
+    bool is_output() const { return _output; }
+    int driven() const { return _out; }
+
+    /// MCU side: switch between output and input mode.
+    void set_output(bool output);
+
+    /// MCU side: set the output latch.
+    void drive(int value);
+
+    /// Outside world: level seen while the MCU is not driving the line.
+    void present(int value);
+
+    /// MCU side: PWM generator on this line (period 0 means off).
+    void set_pwm(time_ns period, float duty);
+    time_ns pwm_period() const { return _pwm_period; }
+    float pwm_duty() const { return _pwm_duty; }
+
+    void attach(PinListener *listener);
+    void detach(PinListener *listener);
+
+private:
+    void changed();
+
+    int _name;
+    bool _output = false;
+    int _out = 0;
+    int _ext = 0;
+    time_ns _pwm_period = 0;
+    float _pwm_duty = 0.0f;
+    std::vector<PinListener *> _listeners;
+};
+
+/// Line registry indexed by PinName.
+Pin &pin(int name);
+
+/// A memory-mapped peripheral register with optional side effects.
+struct Reg {
+    uint32_t value = 0;
+    int port = -1;
+    void (*on_write)(Reg &reg, uint32_t old) = nullptr;
+    uint32_t (*on_read)(const Reg &reg) = nullptr;
+
+    operator uint32_t() const { return on_read ? on_read(*this) : value; }
+    Reg &operator=(uint32_t v) { store(v); return *this; }
+    Reg &operator|=(uint32_t v) { store(uint32_t(*this) | v); return *this; }
+    Reg &operator&=(uint32_t v) { store(uint32_t(*this) & v); return *this; }
+    Reg &operator^=(uint32_t v) { store(uint32_t(*this) ^ v); return *this; }
+
+private:
+    void store(uint32_t v)
+    {
+        uint32_t old = value;
+        value = v;
+        if (on_write) {
+            on_write(*this, old);
+        }
+    }
+};
+
+/// Subset of the STM32L4 GPIO register block.
+struct GpioPort {
+    Reg MODER;
+    Reg OTYPER;
+    Reg OSPEEDR;
+    Reg PUPDR;
+    Reg IDR;
+    Reg ODR;
+    Reg BSRR;
+    Reg LCKR;
+    Reg AFR[2];
+    Reg BRR;
+};
+
+/// Subset of the STM32L4 RCC register block.
+struct RccBlock {
+    Reg CR;
+    Reg AHB1ENR;
+    Reg AHB2ENR;
+    Reg AHB3ENR;
+    Reg APB1ENR1;
+    Reg APB2ENR;
+};
+
+/// Core clock of the simulated MCU.
+const uint32_t CORE_HZ = 120000000;
+
+/// Subset of the Cortex-M4 DWT block. CYCCNT counts core clocks on the
+/// virtual clock; writing it sets the count from then on.
+struct DwtBlock {
+    Reg CTRL;
+    Reg CYCCNT;
+};
+
+/// Subset of the Cortex-M4 CoreDebug block.
+struct CoreDebugBlock {
+    Reg DEMCR;
+};
+
+DwtBlock &dwt();
+CoreDebugBlock &core_debug();
+
+/// GPIO register block of port @p index (0 = A ... 7 = H).
+GpioPort &gpio_port(int index);
+
+RccBlock &rcc();
+
+/// A target on the simulated I2C bus.
+class I2CDevice {
+public:
+    virtual ~I2CDevice() {}
+
+    /// Receive one write transaction. Byte i of @p data arrives at
+    /// @p start + (i + 2) * @p byte_ns (after the address byte).
+    ///
+    /// @returns true to acknowledge.
+    virtual bool write(const uint8_t *data, size_t length, time_ns start,
+                       time_ns byte_ns) = 0;
+};
+
+/// Per-address traffic counters.
+struct I2CStats {
+    uint64_t transactions = 0;
+    uint64_t bytes = 0;      ///< payload bytes, address excluded
+    uint64_t nacks = 0;
+    time_ns busy = 0;        ///< bus time including address and framing
+};
+
+/// The one I2C bus of the board (PB_9/PB_8).
+class I2CBus {
+public:
+    /// Register @p dev at 8-bit address @p addr.
+    void attach(int addr, I2CDevice *dev);
+
+    /// Bus time of a @p length byte transaction at @p hz.
+    static time_ns transaction_time(size_t length, int hz);
+
+    /// Deliver a write and account for it. Does not consume CPU.
+    ///
+    /// @returns true on ACK.
+    bool write(int addr, const uint8_t *data, size_t length, int hz);
+
+    const I2CStats &stats(int addr) const { return _stats[addr & 0xFF]; }
+    const I2CStats &total() const { return _total; }
+
+private:
+    I2CDevice *_devices[256] = {};
+    I2CStats _stats[256];
+    I2CStats _total;
+};
+
+I2CBus &i2c_bus();
+
+/// A UART, seen from the host end of its line. The one on the ST-LINK virtual
+/// COM port (USBTX/USBRX) is written to stdout; the harness types into it
+/// with receive().
+class Console {
+public:
+    /// A character arrives from the host terminal; interrupt context.
+    void receive(char c);
+
+    /// True if a received character is waiting.
+    bool readable() const { return !_rx.empty(); }
+
+    /// Take the oldest received character; false if there is none.
+    bool read(char &c);
+
+    explicit Console(std::FILE *out = stdout) : _out(out) {}
+
+    /// Send @p length bytes to the host terminal. Does not consume CPU.
+    void transmit(const char *data, size_t length);
+
+    /// Send what the firmware transmits to @p out instead; nullptr drops it.
+    void capture(std::FILE *out) { _out = out; }
+
+    /// Call @p fn with every block of bytes the firmware transmits.
+    void on_transmit(std::function<void(const char *, size_t)> fn) { _monitor = std::move(fn); }
+
+    /// Bytes transmitted so far.
+    uint64_t transmitted() const { return _transmitted; }
+
+    /// Call @p fn in interrupt context after each received character.
+    void on_receive(std::function<void()> fn) { _listener = std::move(fn); }
+
+    /// Threads waiting for a character.
+    WaitQueue readers;
+
+private:
+    std::deque<char> _rx;
+    std::function<void()> _listener;
+    std::function<void(const char *, size_t)> _monitor;
+    std::FILE *_out;
+    uint64_t _transmitted = 0;
+};
+
+Console &console();
+
+/// The UART whose TX is on pin @p tx: console() for USBTX, otherwise a port
+/// whose output is dropped until it is captured.
+Console &uart(int tx);
+
+/// Internal flash: items behind the KVStore global API (kv_set/kv_get) and
+/// raw sectors behind FlashIAP. Kept in a file when one is given, so a second
+/// run of the simulation boots with what the first one stored, as the board
+/// does after a power cycle.
+class FlashStore {
+public:
+    /// Geometry of the STM32L4R5ZI flash in dual-bank mode.
+    static const uint32_t START = 0x08000000;
+    static const uint32_t SIZE = 2 * 1024 * 1024;
+    static const uint32_t SECTOR_SIZE = 4096;
+    static const uint32_t PAGE_SIZE = 8;
+    static const uint8_t ERASE_VALUE = 0xFF;
+
+    /// Back the store with @p path, loading what it holds if it exists.
+    ///
+    /// @returns false if the file exists but cannot be read.
+    bool open(const std::string &path);
+
+    /// True if nothing is stored.
+    bool empty() const { return _items.empty(); }
+
+    /// Value of @p key; false if it is not stored.
+    bool get(const std::string &key, std::string &value) const;
+
+    /// Store @p value under @p key and rewrite the file. Holds the calling
+    /// thread for the time the flash takes to program.
+    void set(const std::string &key, const std::string &value);
+
+    /// Number of set() calls so far.
+    uint64_t writes() const { return _writes; }
+
+    /// Copy raw flash at @p addr; false if outside the flash.
+    bool read(uint32_t addr, void *buffer, size_t size) const;
+
+    /// Program raw flash at @p addr, a whole number of PAGE_SIZE double words
+    /// that must be erased. Holds the calling thread for the programming time.
+    ///
+    /// @returns false, changing nothing, if the range is misaligned, outside
+    ///          the flash or not erased.
+    bool program(uint32_t addr, const void *buffer, size_t size);
+
+    /// Erase whole sectors; holds the calling thread for the erase time.
+    bool erase(uint32_t addr, size_t size);
+
+    /// Times the sector at @p addr was erased, over every run on the file.
+    uint32_t erase_count(uint32_t addr) const;
+
+    /// Program and erase calls refused so far.
+    uint64_t errors() const { return _errors; }
+
+private:
+    struct Sector {
+        std::string data;
+        uint32_t erases = 0;
+    };
+
+    bool in_flash(uint32_t addr, size_t size) const;
+    void save() const;
+
+    std::map<std::string, std::string> _items;
+    std::map<uint32_t, Sector> _sectors; // Sectors ever written, by address
+    std::string _path;
+    uint64_t _writes = 0;
+    uint64_t _errors = 0;
+};
+
+FlashStore &flash();
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,565 @@
+#include "sim_kernel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace sim {
+
+// RTX round-robin time slice (OS_ROBIN_TIMEOUT of 5 ticks)
+static const time_ns TIME_SLICE = 5 * NS_PER_MS;
+
+enum TaskState { TASK_READY, TASK_RUNNING, TASK_BLOCKED, TASK_DONE };
+
+struct Task {
+    std::function<void()> entry;
+    TaskStats stats;
+    int id;
+    TaskState state = TASK_READY;
+    std::condition_variable cv;
+
+    // Wait bookkeeping
+    WaitQueue *queue = nullptr;
+    Task *next = nullptr;
+    uint64_t wait_gen = 0;
+    bool timed_out = false;
+
+    // Accounting
+    const char *stack_top = nullptr;
+    time_ns switched_in = 0;
+    time_ns activated = 0;
+};
+
+namespace {
+
+struct Entry {
+    time_ns when;
+    event_id seq;
+    Task *task;       // timeout of a blocked task, or null for an event
+    uint64_t gen;
+    std::function<void()> fn;
+};
+
+struct Later {
+    bool operator()(const Entry &a, const Entry &b) const
+    {
+        return a.when != b.when ? a.when > b.when : a.seq > b.seq;
+    }
+};
+
+struct Kernel {
+    time_ns now = 0;
+    Task *current = nullptr;
+    std::vector<Task *> tasks;
+    std::deque<Task *> ready;
+    std::vector<Entry> heap;
+    std::vector<event_id> cancelled;
+    event_id seq = 0;
+    time_ns slice_end = 0;
+    int isr_depth = 0;
+    int irq_mask = 0;
+    std::mutex lock;
+};
+
+Kernel &k()
+{
+    static Kernel kernel;
+    return kernel;
+}
+
+// Heap allocations are counted once run() starts
+std::atomic<bool> counting{false};
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> heap_current{0};
+std::atomic<uint64_t> heap_peak{0};
+
+// Nesting of HostScope on this host thread
+thread_local int host_depth = 0;
+
+void push_entry(Entry e)
+{
+    HostScope scope;
+    Kernel &kk = k();
+    kk.heap.push_back(std::move(e));
+    std::push_heap(kk.heap.begin(), kk.heap.end(), Later());
+}
+
+void account_out(Task *t)
+{
+    t->stats.cpu += k().now - t->switched_in;
+}
+
+void end_activation(Task *t)
+{
+    time_ns busy = k().now - t->activated;
+    t->stats.activations++;
+    t->stats.busy_total += busy;
+    t->stats.busy_max = std::max(t->stats.busy_max, busy);
+}
+
+void make_ready(Task *t)
+{
+    HostScope scope;
+    t->state = TASK_READY;
+    k().ready.push_back(t);
+}
+
+void wake(Task *t)
+{
+    t->activated = k().now;
+    make_ready(t);
+}
+
+Task *pick_ready()
+{
+    std::deque<Task *> &r = k().ready;
+    if (r.empty()) {
+        return nullptr;
+    }
+    // Highest priority first, FIFO within a priority
+    auto best = r.begin();
+    for (auto it = r.begin(); it != r.end(); ++it) {
+        if ((*it)->stats.priority > (*best)->stats.priority) {
+            best = it;
+        }
+    }
+    Task *t = *best;
+    r.erase(best);
+    return t;
+}
+
+void switch_in(Task *t)
+{
+    Kernel &kk = k();
+    kk.current = t;
+    t->state = TASK_RUNNING;
+    t->switched_in = kk.now;
+    kk.slice_end = kk.now + TIME_SLICE;
+}
+
+// Hand the CPU to next and park the calling host thread until it is
+// scheduled again. The caller has already accounted its own CPU time.
+void switch_to(Task *next)
+{
+    Kernel &kk = k();
+    Task *self = kk.current;
+    if (next == self) {
+        switch_in(self);
+        return;
+    }
+    std::unique_lock<std::mutex> lk(kk.lock);
+    switch_in(next);
+    next->cv.notify_one();
+    if (self && self->state != TASK_DONE) {
+        self->cv.wait(lk, [&kk, self] { return kk.current == self; });
+    }
+}
+
+void unlink(Task *t)
+{
+    WaitQueue *q = t->queue;
+    if (!q) {
+        return;
+    }
+    Task **link = &q->head;
+    Task *prev = nullptr;
+    while (*link && *link != t) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = t->next;
+        if (q->tail == t) {
+            q->tail = prev;
+        }
+    }
+    t->next = nullptr;
+    t->queue = nullptr;
+}
+
+bool is_cancelled(event_id id)
+{
+    std::vector<event_id> &c = k().cancelled;
+    auto it = std::find(c.begin(), c.end(), id);
+    if (it == c.end()) {
+        return false;
+    }
+    *it = c.back();
+    c.pop_back();
+    return true;
+}
+
+void fire_next()
+{
+    Kernel &kk = k();
+    std::pop_heap(kk.heap.begin(), kk.heap.end(), Later());
+    Entry e = std::move(kk.heap.back());
+    kk.heap.pop_back();
+    if (e.when > kk.now) {
+        kk.now = e.when;
+    }
+    if (is_cancelled(e.seq)) {
+        return;
+    }
+    if (e.task) {
+        Task *t = e.task;
+        if (t->state == TASK_BLOCKED && t->wait_gen == e.gen) {
+            unlink(t);
+            t->timed_out = true;
+            wake(t);
+        }
+        return;
+    }
+    kk.isr_depth++;
+    e.fn();
+    kk.isr_depth--;
+}
+
+// Called by a thread that can no longer run: pick the next one, advancing
+// time through the event heap while nothing is ready.
+void reschedule()
+{
+    Kernel &kk = k();
+    for (;;) {
+        Task *next = pick_ready();
+        if (next) {
+            switch_to(next);
+            return;
+        }
+        if (kk.heap.empty()) {
+            std::fprintf(stderr, "sim: every thread is blocked forever\n");
+            stop(2);
+        }
+        fire_next();
+    }
+}
+
+void maybe_preempt()
+{
+    Kernel &kk = k();
+    Task *self = kk.current;
+    if (kk.ready.empty() || !self || kk.isr_depth || kk.irq_mask) {
+        return;
+    }
+    int best = 0;
+    for (Task *t : kk.ready) {
+        best = std::max(best, t->stats.priority);
+    }
+    if (best > self->stats.priority ||
+        (best == self->stats.priority && kk.now >= kk.slice_end)) {
+        account_out(self);
+        make_ready(self);
+        switch_to(pick_ready());
+    }
+}
+
+// Record how deep the running thread's host stack is. Interrupt handlers
+// borrow the stack of the thread they interrupt and are not counted.
+void note_stack()
+{
+    Kernel &kk = k();
+    Task *t = kk.current;
+    if (!t || kk.isr_depth || !t->stack_top) {
+        return;
+    }
+    char here;
+    uint32_t depth = uint32_t(t->stack_top - &here);
+    t->stats.stack_peak = std::max(t->stats.stack_peak, depth);
+}
+
+void task_entry(Task *t)
+{
+    Kernel &kk = k();
+    char top;
+    t->stack_top = &top;
+    {
+        std::unique_lock<std::mutex> lk(kk.lock);
+        t->cv.wait(lk, [&kk, t] { return kk.current == t; });
+    }
+    t->entry();
+    account_out(t);
+    end_activation(t);
+    t->state = TASK_DONE;
+    reschedule();
+}
+
+} // namespace
+
+time_ns now()
+{
+    return k().now;
+}
+
+void cpu(time_ns d)
+{
+    Kernel &kk = k();
+    time_ns until = kk.now + d;
+    if (!kk.current || kk.isr_depth || kk.irq_mask) {
+        kk.now = until;
+        return;
+    }
+    while (!kk.heap.empty() && kk.heap.front().when <= until) {
+        fire_next();
+    }
+    if (kk.now < until) {
+        kk.now = until;
+    }
+    note_stack();
+    maybe_preempt();
+}
+
+bool block(WaitQueue *q, time_ns deadline)
+{
+    Kernel &kk = k();
+    Task *self = kk.current;
+    assert(self && !kk.isr_depth && "blocking call outside thread context");
+    note_stack();
+    account_out(self);
+    end_activation(self);
+    self->state = TASK_BLOCKED;
+    self->timed_out = false;
+    self->wait_gen++;
+    if (q) {
+        self->queue = q;
+        self->next = nullptr;
+        if (q->tail) {
+            q->tail->next = self;
+        } else {
+            q->head = self;
+        }
+        q->tail = self;
+    }
+    if (deadline != FOREVER) {
+        push_entry(Entry{deadline, ++kk.seq, self, self->wait_gen, nullptr});
+    }
+    reschedule();
+    return !self->timed_out;
+}
+
+void sleep_until(time_ns t)
+{
+    block(nullptr, t);
+}
+
+void yield()
+{
+    Kernel &kk = k();
+    kk.slice_end = kk.now;
+    maybe_preempt();
+}
+
+bool wake_one(WaitQueue *q)
+{
+    Task *t = q->head;
+    if (!t) {
+        return false;
+    }
+    unlink(t);
+    wake(t);
+    maybe_preempt();
+    return true;
+}
+
+void wake_all(WaitQueue *q)
+{
+    while (Task *t = q->head) {
+        unlink(t);
+        wake(t);
+    }
+    maybe_preempt();
+}
+
+Task *spawn(std::function<void()> entry, const std::string &name,
+            int priority, uint32_t stack_size)
+{
+    HostScope scope;
+    Kernel &kk = k();
+    Task *t = new Task;
+    t->entry = std::move(entry);
+    t->id = int(kk.tasks.size());
+    t->stats = TaskStats{name, priority, 0, 0, 0, 0, stack_size, 0};
+    t->activated = kk.now;
+    kk.tasks.push_back(t);
+    make_ready(t);
+    std::thread(task_entry, t).detach();
+    maybe_preempt();
+    return t;
+}
+
+Task *current()
+{
+    return k().current;
+}
+
+const char *task_name(const Task *t)
+{
+    return t ? t->stats.name.c_str() : "-";
+}
+
+int task_id(const Task *t)
+{
+    return t ? t->id : -1;
+}
+
+bool in_isr()
+{
+    return k().isr_depth > 0;
+}
+
+void isr_enter()
+{
+    k().isr_depth++;
+}
+
+void isr_exit()
+{
+    k().isr_depth--;
+}
+
+void irq_disable()
+{
+    k().irq_mask++;
+}
+
+void irq_enable()
+{
+    Kernel &kk = k();
+    kk.irq_mask--;
+}
+
+event_id at(time_ns when, std::function<void()> fn)
+{
+    Kernel &kk = k();
+    event_id id = ++kk.seq;
+    push_entry(Entry{when, id, nullptr, 0, std::move(fn)});
+    return id;
+}
+
+void cancel(event_id id)
+{
+    HostScope scope;
+    Kernel &kk = k();
+    for (const Entry &e : kk.heap) {
+        if (e.seq == id) {
+            kk.cancelled.push_back(id);
+            return;
+        }
+    }
+}
+
+const TaskStats &task_info(const Task *t)
+{
+    return t->stats;
+}
+
+size_t task_list(Task **out, size_t count)
+{
+    Kernel &kk = k();
+    size_t n = std::min(count, kk.tasks.size());
+    std::copy(kk.tasks.begin(), kk.tasks.begin() + n, out);
+    return n;
+}
+
+time_ns idle_time()
+{
+    Kernel &kk = k();
+    time_ns busy = 0;
+    for (Task *t : kk.tasks) {
+        busy += t->stats.cpu;
+        if (t == kk.current && t->state == TASK_RUNNING) {
+            busy += kk.now - t->switched_in;
+        }
+    }
+    return kk.now - busy;
+}
+
+std::vector<TaskStats> task_stats()
+{
+    Kernel &kk = k();
+    std::vector<TaskStats> out;
+    for (Task *t : kk.tasks) {
+        TaskStats s = t->stats;
+        if (t == kk.current && t->state == TASK_RUNNING) {
+            s.cpu += kk.now - t->switched_in;
+        }
+        out.push_back(s);
+    }
+    return out;
+}
+
+void run(std::function<void()> app_main, time_ns end,
+         std::function<int()> finish)
+{
+    Kernel &kk = k();
+    counting = true;
+    at(end, [finish] { stop(finish()); });
+    spawn(std::move(app_main), "main", 24);
+
+    // The harness thread is not a simulated thread: hand the CPU over and
+    // park. The simulation ends the process from inside via stop().
+    std::unique_lock<std::mutex> lk(kk.lock);
+    Task *first = pick_ready();
+    switch_in(first);
+    first->cv.notify_one();
+    std::condition_variable never;
+    for (;;) {
+        never.wait(lk);
+    }
+}
+
+HostScope::HostScope()
+{
+    host_depth++;
+}
+
+HostScope::~HostScope()
+{
+    host_depth--;
+}
+
+HeapStats heap_stats()
+{
+    return HeapStats{heap_current.load(), heap_peak.load(), allocations.load()};
+}
+
+uint64_t thread_allocations()
+{
+    return allocations.load();
+}
+
+bool count_allocation(size_t size)
+{
+    if (!counting.load(std::memory_order_relaxed) || host_depth) {
+        return false;
+    }
+    Kernel &kk = k();
+    if (!kk.current || kk.isr_depth) {
+        return false;
+    }
+    allocations++;
+    uint64_t current = heap_current += size;
+    if (current > heap_peak) {
+        heap_peak = current;
+    }
+    return true;
+}
+
+void count_free(size_t size)
+{
+    heap_current -= size;
+}
+
+void stop(int code)
+{
+    // Every output stream, including a console capture file
+    std::fflush(nullptr);
+    std::_Exit(code);
+}
+
+} // namespace sim
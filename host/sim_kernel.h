@@ -0,0 +1,167 @@
+/*
+ * Virtual-time kernel for the host simulation build.
+ *
+ * Every RTOS thread of the firmware runs on its own host thread, but only one
+ * of them holds the simulated CPU at a time. Time never advances on its own:
+ * it moves forward when the running code burns CPU (cpu()), or, when every
+ * thread is blocked, it jumps straight to the next timed event. That keeps a
+ * run deterministic and lets hours of firmware time pass in seconds.
+ *
+ * Timed events (sensor waveforms, tickers, key presses) run in simulated
+ * interrupt context: they may wake threads but never block.
+ */
+
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+/// Virtual time in nanoseconds since simulated power-on.
+typedef uint64_t time_ns;
+
+const time_ns NS_PER_US = 1000ULL;
+const time_ns NS_PER_MS = 1000000ULL;
+const time_ns NS_PER_S = 1000000000ULL;
+const time_ns FOREVER = UINT64_MAX;
+
+struct Task;
+
+/// FIFO of tasks blocked on a synchronisation primitive.
+struct WaitQueue {
+    Task *head = nullptr;
+    Task *tail = nullptr;
+};
+
+/// Per-thread accounting, reported by the harness.
+struct TaskStats {
+    std::string name;
+    int priority;
+    time_ns cpu;           ///< time spent holding the CPU
+    uint64_t activations;  ///< wake-up to block cycles
+    time_ns busy_total;    ///< sum of wake-up to block durations
+    time_ns busy_max;      ///< longest wake-up to block duration
+    uint32_t stack_size;   ///< stack the firmware asked for, in bytes
+    uint32_t stack_peak;   ///< deepest host stack seen at a kernel call
+};
+
+/// Current virtual time.
+time_ns now();
+
+/// Burn @p d nanoseconds of CPU on the running context. Pending timed events
+/// due in that window are delivered and the running thread may be preempted.
+void cpu(time_ns d);
+
+/// Block the running thread on @p q (or just sleep if @p q is null) until it
+/// is woken or @p deadline passes.
+///
+/// @returns true if woken, false on timeout.
+bool block(WaitQueue *q, time_ns deadline);
+
+/// Sleep the running thread until @p t.
+void sleep_until(time_ns t);
+
+/// Give up the rest of the time slice to equal priority threads.
+void yield();
+
+/// Wake the oldest waiter on @p q. @returns false if nobody was waiting.
+bool wake_one(WaitQueue *q);
+
+/// Wake every waiter on @p q.
+void wake_all(WaitQueue *q);
+
+/// Create a ready thread running @p entry.
+Task *spawn(std::function<void()> entry, const std::string &name, int priority,
+            uint32_t stack_size = 4096);
+
+/// The thread holding the CPU (null before the simulation starts).
+Task *current();
+
+/// Name of @p t.
+const char *task_name(const Task *t);
+
+/// Identifier of @p t, stable for the run.
+int task_id(const Task *t);
+
+/// Accounting of @p t so far, without allocating. The CPU time of the
+/// running thread does not include its current time slice.
+const TaskStats &task_info(const Task *t);
+
+/// Store up to @p count threads in creation order into @p out.
+///
+/// @returns the number stored.
+size_t task_list(Task **out, size_t count);
+
+/// Time no thread held the CPU since power-on.
+time_ns idle_time();
+
+/// True while simulated interrupt handlers run.
+bool in_isr();
+
+/// Enter/leave simulated interrupt context.
+void isr_enter();
+void isr_exit();
+
+/// Mask/unmask timed event delivery (critical sections).
+void irq_disable();
+void irq_enable();
+
+typedef uint64_t event_id;
+
+/// Run @p fn in interrupt context at virtual time @p when.
+event_id at(time_ns when, std::function<void()> fn);
+
+/// Drop a pending timed event. Safe to call on events that already ran.
+void cancel(event_id id);
+
+/// Snapshot of the per-thread accounting.
+std::vector<TaskStats> task_stats();
+
+/// Start @p app_main as the "main" thread and run until @p end, then call
+/// @p finish and exit the process with its return value. Never returns.
+[[noreturn]] void run(std::function<void()> app_main, time_ns end,
+                      std::function<int()> finish);
+
+/// Marks simulator work done on a firmware thread, such as kernel bookkeeping,
+/// device models and HAL plumbing, for the life of the object: its heap
+/// allocations are not counted as the firmware's.
+struct HostScope {
+    HostScope();
+    ~HostScope();
+    HostScope(const HostScope &) = delete;
+    HostScope &operator=(const HostScope &) = delete;
+};
+
+/// Heap use of the firmware: allocations made by simulated threads since
+/// run() started, outside interrupt context and HostScope.
+struct HeapStats {
+    uint64_t current;      ///< bytes allocated and not yet freed
+    uint64_t peak;         ///< most bytes allocated at once
+    uint64_t allocations;  ///< allocations so far
+};
+
+/// Heap use of the firmware so far.
+HeapStats heap_stats();
+
+/// Heap allocations of the firmware since run() started.
+uint64_t thread_allocations();
+
+/// Called by operator new.
+///
+/// @returns true if the allocation of @p size bytes is the firmware's.
+bool count_allocation(size_t size);
+
+/// Called by operator delete for a block count_allocation() returned true for.
+void count_free(size_t size);
+
+/// Exit the process from inside the simulation with @p code after @p finish.
+[[noreturn]] void stop(int code);
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Telemetry stream decoder.
+ *
+ * Reads the binary frames the firmware sends to the building controller
+ * (Telemetry.cpp) from a capture file, a serial device or a pseudo-terminal,
+ * and writes every reading as CSV. A terminal is switched to raw mode first.
+ * At the end a summary of good frames, CRC errors, frames missing by
+ * sequence number and readings the sender lost goes to stderr.
+ *
+ *   telemetry_decode [--summary] [--frames N] [PATH]
+ *
+ * Exits with status 1 if a frame failed its CRC or went missing.
+ */
+
+#include "telemetry_frame.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+
+void usage()
+{
+    std::fprintf(stderr, "usage: telemetry_decode [--summary] [--frames N] [PATH]\n");
+    std::exit(2);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool summary_only = false;
+    unsigned long max_frames = 0;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--summary") {
+            summary_only = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            max_frames = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg[0] == '-' && arg != "-") {
+            usage();
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            usage();
+        }
+    }
+
+    int fd = STDIN_FILENO;
+    if (path && std::strcmp(path, "-") != 0) {
+        fd = open(path, O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            std::perror(path);
+            return 2;
+        }
+    }
+    if (isatty(fd)) {
+        termios tio;
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+
+    if (!summary_only) {
+        std::printf("sequence,time_ms,celsius_tenths,rise,humidity,level,status,failures\n");
+    }
+    telemetry_frame::Parser parser;
+    uint8_t chunk[4096];
+    bool done = false;
+    while (!done) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // End of file, or EIO once the other end of a pseudo-terminal closes
+            break;
+        }
+        parser.feed(chunk, size_t(n), [&](const telemetry_frame::Frame &frame) {
+            if (!summary_only) {
+                for (const telemetry_frame::Sample &s : frame.samples) {
+                    std::printf("%u,%lu,%d,%d,%u,%u,%d,%u\n", frame.sequence,
+                                (unsigned long)s.time_ms, s.celsius, s.rise,
+                                s.humidity, s.level, s.status, s.failures);
+                }
+            }
+            if (max_frames && parser.stats().frames >= max_frames) {
+                done = true;
+            }
+        });
+    }
+    std::fflush(stdout);
+
+    const telemetry_frame::Parser::Stats &st = parser.stats();
+    std::fprintf(stderr,
+                 "telemetry: %llu frames, %llu readings, %llu crc errors, "
+                 "%llu frames missing, %llu readings lost by the sender, "
+                 "%llu bytes skipped, %zu bytes incomplete\n",
+                 (unsigned long long)st.frames, (unsigned long long)st.samples,
+                 (unsigned long long)st.crc_errors, (unsigned long long)st.gaps,
+                 (unsigned long long)st.lost, (unsigned long long)st.skipped,
+                 parser.pending());
+    return st.crc_errors || st.gaps ? 1 : 0;
+}
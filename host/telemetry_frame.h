@@ -0,0 +1,190 @@
+/*
+ * Telemetry frames on the host side.
+ *
+ * Encodes and decodes the frames Telemetry.cpp sends to the building
+ * controller, without the firmware headers, so the decoder and the load
+ * generator build on their own. See TelemetryLink in Telemetry.h for the
+ * layout; the constants here must match it.
+ */
+
+#ifndef HOST_TELEMETRY_FRAME_H
+#define HOST_TELEMETRY_FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace telemetry_frame {
+
+const uint8_t SYNC0 = 0xA5;
+const uint8_t SYNC1 = 0x5A;
+const uint8_t VERSION = 1;
+const size_t HEADER_SIZE = 8;
+const size_t SAMPLE_SIZE = 12;
+const size_t CRC_SIZE = 4;
+const unsigned MAX_BATCH = 255;
+
+struct Sample {
+    uint32_t time_ms;
+    int16_t celsius; // Tenths of a degree
+    int16_t rise; // Tenths of a degree per minute
+    uint8_t humidity;
+    uint8_t level;
+    int8_t status;
+    uint8_t failures;
+};
+
+struct Frame {
+    uint16_t sequence;
+    uint16_t lost; // Readings the sender lost since the frame before
+    std::vector<Sample> samples;
+};
+
+/// CRC-32 of @p size bytes, as MbedCRC<POLY_32BIT_ANSI, 32> computes it.
+inline uint32_t crc32(const uint8_t *data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+inline void put16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(uint8_t(value));
+    out.push_back(uint8_t(value >> 8));
+}
+
+inline void put32(std::vector<uint8_t> &out, uint32_t value)
+{
+    put16(out, uint16_t(value));
+    put16(out, uint16_t(value >> 16));
+}
+
+inline uint16_t get16(const uint8_t *p)
+{
+    return uint16_t(p[0] | p[1] << 8);
+}
+
+inline uint32_t get32(const uint8_t *p)
+{
+    return uint32_t(get16(p)) | uint32_t(get16(p + 2)) << 16;
+}
+
+/// Append @p frame, encoded, to @p out.
+inline void encode(const Frame &frame, std::vector<uint8_t> &out)
+{
+    size_t start = out.size();
+    out.push_back(SYNC0);
+    out.push_back(SYNC1);
+    out.push_back(VERSION);
+    out.push_back(uint8_t(frame.samples.size()));
+    put16(out, frame.sequence);
+    put16(out, frame.lost);
+    for (const Sample &s : frame.samples) {
+        put32(out, s.time_ms);
+        put16(out, uint16_t(s.celsius));
+        put16(out, uint16_t(s.rise));
+        out.push_back(s.humidity);
+        out.push_back(s.level);
+        out.push_back(uint8_t(s.status));
+        out.push_back(s.failures);
+    }
+    put32(out, crc32(out.data() + start + 2, out.size() - start - 2));
+}
+
+/** Finds frames in a byte stream that may start mid-frame or be corrupted.
+ *
+ * Bytes are fed as they arrive. A candidate frame starts at the sync bytes
+ * and is accepted only if its version and CRC match; otherwise the search
+ * goes on from the byte after its first sync byte, so a bad frame costs
+ * nothing but itself.
+ */
+class Parser {
+public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t samples = 0;
+        uint64_t crc_errors = 0; // Candidate frames whose CRC did not match
+        uint64_t skipped = 0; // Bytes outside any good frame
+        uint64_t gaps = 0; // Frames missing by sequence number
+        uint64_t lost = 0; // Readings the sender reported lost
+    };
+
+    /// Feed @p size bytes; @p on_frame is called as on_frame(const Frame &) for each good frame.
+    template <typename F>
+    void feed(const uint8_t *data, size_t size, F &&on_frame)
+    {
+        _buffer.insert(_buffer.end(), data, data + size);
+        size_t at = 0;
+        while (_buffer.size() - at >= 2) {
+            if (_buffer[at] != SYNC0 || _buffer[at + 1] != SYNC1) {
+                at++;
+                _stats.skipped++;
+                continue;
+            }
+            if (_buffer.size() - at < HEADER_SIZE) {
+                break;
+            }
+            const uint8_t *p = _buffer.data() + at;
+            size_t length = HEADER_SIZE + p[3] * SAMPLE_SIZE + CRC_SIZE;
+            if (p[2] != VERSION || p[3] == 0) {
+                at++;
+                _stats.skipped++;
+                continue;
+            }
+            if (_buffer.size() - at < length) {
+                break;
+            }
+            if (get32(p + length - CRC_SIZE) != crc32(p + 2, length - CRC_SIZE - 2)) {
+                _stats.crc_errors++;
+                at++;
+                _stats.skipped++;
+                continue;
+            }
+            Frame frame;
+            frame.sequence = get16(p + 4);
+            frame.lost = get16(p + 6);
+            for (unsigned i = 0; i < p[3]; i++) {
+                const uint8_t *q = p + HEADER_SIZE + i * SAMPLE_SIZE;
+                Sample s;
+                s.time_ms = get32(q);
+                s.celsius = int16_t(get16(q + 4));
+                s.rise = int16_t(get16(q + 6));
+                s.humidity = q[8];
+                s.level = q[9];
+                s.status = int8_t(q[10]);
+                s.failures = q[11];
+                frame.samples.push_back(s);
+            }
+            if (_stats.frames > 0) {
+                _stats.gaps += uint16_t(frame.sequence - _next_sequence);
+            }
+            _next_sequence = uint16_t(frame.sequence + 1);
+            _stats.frames++;
+            _stats.samples += frame.samples.size();
+            _stats.lost += frame.lost;
+            on_frame(frame);
+            at += length;
+        }
+        _buffer.erase(_buffer.begin(), _buffer.begin() + long(at));
+    }
+
+    const Stats &stats() const { return _stats; }
+
+    /// Bytes held waiting for the rest of a frame.
+    size_t pending() const { return _buffer.size(); }
+
+private:
+    std::vector<uint8_t> _buffer;
+    uint16_t _next_sequence = 0;
+    Stats _stats;
+};
+
+} // namespace telemetry_frame
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * Telemetry load generator.
+ *
+ * Opens a pseudo-terminal, prints the path of its terminal end and writes
+ * telemetry frames into it at a given rate, as the firmware would on its
+ * UART, so telemetry_decode or the building controller's own reader can be
+ * tested at any load without a board. Frames can be corrupted or left out
+ * on purpose to exercise CRC checking and loss detection.
+ *
+ *   telemetry_load [--frames N] [--rate FRAMES_PER_S] [--batch N]
+ *                  [--corrupt-every N] [--skip-every N] [--wait S] [--out PATH]
+ *
+ * With --out the frames go to PATH, or to stdout for -, instead of a
+ * pseudo-terminal. A summary of what a decoder should report goes to stderr.
+ */
+
+#include "telemetry_frame.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options {
+    unsigned long frames = 1000;
+    double rate = 100.0;
+    unsigned batch = 8;
+    unsigned long corrupt_every = 0;
+    unsigned long skip_every = 0;
+    double wait = 1.0;
+    const char *out = nullptr;
+};
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: telemetry_load [--frames N] [--rate FRAMES_PER_S] "
+                 "[--batch N]\n"
+                 "                      [--corrupt-every N] [--skip-every N] "
+                 "[--wait S] [--out PATH]\n");
+    std::exit(2);
+}
+
+Options parse(int argc, char **argv)
+{
+    Options o;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char * {
+            if (i + 1 >= argc) {
+                usage();
+            }
+            return argv[++i];
+        };
+        if (arg == "--frames") {
+            o.frames = std::strtoul(value(), nullptr, 10);
+        } else if (arg == "--rate") {
+            o.rate = std::atof(value());
+        } else if (arg == "--batch") {
+            o.batch = unsigned(std::atoi(value()));
+        } else if (arg == "--corrupt-every") {
+            o.corrupt_every = std::strtoul(value(), nullptr, 10);
+        } else if (arg == "--skip-every") {
+            o.skip_every = std::strtoul(value(), nullptr, 10);
+        } else if (arg == "--wait") {
+            o.wait = std::atof(value());
+        } else if (arg == "--out") {
+            o.out = value();
+        } else {
+            usage();
+        }
+    }
+    if (o.batch < 1 || o.batch > telemetry_frame::MAX_BATCH || o.rate <= 0) {
+        usage();
+    }
+    return o;
+}
+
+void sleep_for(double seconds)
+{
+    if (seconds <= 0) {
+        return;
+    }
+    timespec ts;
+    ts.tv_sec = time_t(seconds);
+    ts.tv_nsec = long((seconds - double(ts.tv_sec)) * 1e9);
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+bool write_all(int fd, const uint8_t *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options o = parse(argc, argv);
+
+    int fd;
+    int terminal = -1; // Kept open so the line stays up between readers
+    if (o.out) {
+        fd = std::strcmp(o.out, "-") == 0
+                 ? STDOUT_FILENO
+                 : open(o.out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::perror(o.out);
+            return 2;
+        }
+    } else {
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+            std::perror("posix_openpt");
+            return 2;
+        }
+        const char *name = ptsname(fd);
+        terminal = open(name, O_RDWR | O_NOCTTY);
+        termios tio;
+        if (terminal < 0 || tcgetattr(terminal, &tio) < 0) {
+            std::perror(name);
+            return 2;
+        }
+
+        // Binary frames must reach the reader byte for byte
+        cfmakeraw(&tio);
+        tcsetattr(terminal, TCSANOW, &tio);
+        std::printf("%s\n", name);
+        std::fflush(stdout);
+        sleep_for(o.wait);
+    }
+
+    // A room that warms slowly, with the alarm level a decoder can check
+    telemetry_frame::Frame frame;
+    uint32_t time_ms = 0;
+    double celsius = 22.0;
+    unsigned long corrupted = 0, skipped = 0;
+    unsigned long missing = 0, gaps = 0; // A decoder only sees a gap once a later frame arrives
+    std::vector<uint8_t> bytes;
+    for (unsigned long i = 0; i < o.frames; i++) {
+        frame.sequence = uint16_t(i);
+        frame.lost = 0;
+        frame.samples.clear();
+        for (unsigned j = 0; j < o.batch; j++) {
+            time_ms += 1100;
+            celsius += 0.01 * double((i * 7 + j * 3) % 11) - 0.04;
+            telemetry_frame::Sample s;
+            s.time_ms = time_ms;
+            s.celsius = int16_t(std::lround(celsius * 10));
+            s.rise = 0;
+            s.humidity = 45;
+            s.level = s.celsius > 300 ? 3 : s.celsius > 250 ? 2 : 0;
+            s.status = 0;
+            s.failures = 0;
+            frame.samples.push_back(s);
+        }
+        if (o.skip_every && (i + 1) % o.skip_every == 0) {
+            skipped++;
+            missing++;
+        } else {
+            bytes.clear();
+            telemetry_frame::encode(frame, bytes);
+            if (o.corrupt_every && (i + 1) % o.corrupt_every == 0) {
+                // One bit flipped in the readings, as line noise would
+                bytes[telemetry_frame::HEADER_SIZE + 1] ^= 0x10;
+                corrupted++;
+                missing++;
+            } else {
+                gaps += missing;
+                missing = 0;
+            }
+            if (!write_all(fd, bytes.data(), bytes.size())) {
+                std::perror("write");
+                return 1;
+            }
+        }
+        sleep_for(1.0 / o.rate);
+    }
+
+    // Leave the line up until the reader has taken everything
+    if (terminal >= 0) {
+        for (int i = 0; i < 500; i++) {
+            int queued = 0;
+            if (ioctl(terminal, FIONREAD, &queued) < 0 || queued == 0) {
+                break;
+            }
+            sleep_for(0.01);
+        }
+    }
+    std::fprintf(stderr,
+                 "telemetry_load: %lu frames, %lu corrupted, %lu skipped; "
+                 "expect %lu crc errors and %lu frames missing\n",
+                 o.frames, corrupted, skipped, corrupted, gaps);
+    return 0;
+}
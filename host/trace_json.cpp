@@ -0,0 +1,191 @@
+/*
+ * Trace dump decoder.
+ *
+ * Reads what the firmware wrote on the serial console after a t command
+ * (Trace.cpp) and writes it as Chrome trace JSON, for chrome://tracing or
+ * https://ui.perfetto.dev. Console text around the dump is skipped; if the
+ * input holds several dumps the last one is decoded.
+ *
+ *   trace_json [CONSOLE_CAPTURE] > trace.json
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t HEADER_SIZE = 24;
+const size_t NAME_SIZE = 16;
+const size_t THREAD_SIZE = 4 + NAME_SIZE;
+const size_t RECORD_SIZE = 12;
+
+// Exception numbers below this are handlers, anything else a thread
+const uint32_t MAX_EXCEPTION = 256;
+
+uint32_t get16(const unsigned char *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8;
+}
+
+uint32_t get32(const unsigned char *p)
+{
+    return get16(p) | get16(p + 2) << 16;
+}
+
+std::string get_name(const unsigned char *p)
+{
+    return std::string(reinterpret_cast<const char *>(p),
+                       strnlen(reinterpret_cast<const char *>(p), NAME_SIZE));
+}
+
+// JSON string literal of @p text
+std::string quote(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += (unsigned char)c < 0x20 ? ' ' : c;
+    }
+    return out + "\"";
+}
+
+std::vector<unsigned char> read_all(FILE *in)
+{
+    std::vector<unsigned char> data;
+    unsigned char chunk[4096];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    return data;
+}
+
+int fail(const char *message)
+{
+    std::fprintf(stderr, "trace_json: %s\n", message);
+    return 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    if (argc > 2) {
+        std::fprintf(stderr, "usage: trace_json [CONSOLE_CAPTURE]\n");
+        return 2;
+    }
+    if (argc == 2 && !(in = std::fopen(argv[1], "rb"))) {
+        std::perror(argv[1]);
+        return 1;
+    }
+    std::vector<unsigned char> data = read_all(in);
+
+    // The last dump in the capture
+    const unsigned char magic[] = {'F', 'A', 'T', 'R'};
+    auto start = std::find_end(data.begin(), data.end(), std::begin(magic),
+                               std::end(magic));
+    if (start == data.end()) {
+        return fail("no trace dump found");
+    }
+    const unsigned char *p = &*start;
+    size_t left = size_t(data.end() - start);
+    if (left < HEADER_SIZE) {
+        return fail("truncated header");
+    }
+    uint32_t version = get16(p + 4);
+    uint32_t record_size = get16(p + 6);
+    double cycles_per_us = get32(p + 8) / 1e6;
+    uint32_t written = get32(p + 12);
+    uint32_t records = get16(p + 16);
+    uint32_t threads = get16(p + 18);
+    uint32_t points = get16(p + 20);
+    if (version != 1 || record_size != RECORD_SIZE || cycles_per_us <= 0) {
+        return fail("unsupported dump format");
+    }
+    size_t size = HEADER_SIZE + threads * THREAD_SIZE + points * NAME_SIZE +
+                  records * RECORD_SIZE;
+    if (left < size) {
+        return fail("truncated dump");
+    }
+    p += HEADER_SIZE;
+
+    std::map<uint32_t, std::string> thread_names;
+    for (uint32_t i = 0; i < threads; i++, p += THREAD_SIZE) {
+        thread_names[get32(p)] = get_name(p + 4);
+    }
+    std::vector<std::string> point_names;
+    for (uint32_t i = 0; i < points; i++, p += NAME_SIZE) {
+        point_names.push_back(get_name(p));
+    }
+
+    std::printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"records\":%u,"
+                "\"overwritten\":%u},\"traceEvents\":[\n",
+                records, written - records);
+    const char *separator = "";
+
+    // Regions still open on each context, innermost last. An end marker
+    // whose begin was overwritten is dropped.
+    std::map<uint32_t, std::vector<uint32_t>> open;
+    uint64_t cycles = 0;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < records; i++, p += RECORD_SIZE) {
+        uint32_t raw = get32(p);
+        uint32_t context = get32(p + 4);
+        uint32_t point = get16(p + 8);
+        bool begin = get16(p + 10) == 0;
+
+        // The counter wraps every 2^32 cycles; consecutive markers are far
+        // closer than that, and may be a little out of order when a slot
+        // was claimed just before an interrupt
+        if (i > 0) {
+            cycles += int64_t(int32_t(raw - last));
+        }
+        last = raw;
+
+        std::vector<uint32_t> &stack = open[context];
+        if (!begin) {
+            if (stack.empty() || stack.back() != point) {
+                continue;
+            }
+            stack.pop_back();
+        } else {
+            stack.push_back(point);
+        }
+        std::string name =
+            point < point_names.size() ? point_names[point] : "point " + std::to_string(point);
+        std::printf("%s{\"name\":%s,\"ph\":\"%s\",\"ts\":%.3f,\"pid\":0,"
+                    "\"tid\":%u}",
+                    separator, quote(name).c_str(), begin ? "B" : "E",
+                    int64_t(cycles) / cycles_per_us, context);
+        separator = ",\n";
+    }
+
+    // Name every context that appears
+    for (const auto &entry : open) {
+        uint32_t context = entry.first;
+        std::string name;
+        auto thread = thread_names.find(context);
+        if (thread != thread_names.end()) {
+            name = thread->second;
+        } else if (context < MAX_EXCEPTION) {
+            name = "exception " + std::to_string(context);
+        } else {
+            name = "thread " + std::to_string(context);
+        }
+        std::printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                    "\"tid\":%u,\"args\":{\"name\":%s}}",
+                    separator, context, quote(name).c_str());
+        separator = ",\n";
+    }
+    std::printf("\n]}\n");
+    return 0;
+}
@@ -5,18 +5,30 @@
  * Purpose                  : A temperature/humidity based fire alert system that can be programmed using Nucleo L4R5ZI, DHT-11 temperature-humidity sensor, 4x4 keypad, an 1802 LCD 
  *                            panel and a buzzer
  *
- * Modules/Subroutines      : void col1_isr_handler(void); void col2_isr_handler(void); void col3_isr_handler(void); void col4_isr_handler(void);
- *                            void keypad_cycle(void); void set_celsius_threshold(void); void set_fahrenheit_threshold(void); void set_humidity_threshold(void);
- *                            void print_sensor_data(void); void check_sensor_data(void); void siren (void)
+ * Modules/Subroutines      : char next_key(void);
+ *                            void set_celsius_threshold(AlarmConfig &config); void set_fahrenheit_threshold(AlarmConfig &config);
+ *                            void set_humidity_threshold(AlarmConfig &config);
+ *                            void enter_thresholds(void); void reconfigure(void); void apply_config(const AlarmConfig &config);
+ *                            void hold_display(Semaphore *held); void release_display(void);
+ *                            void acquire_sample(void); void start_sampling(void); void filter_sample(DHT11::Sample sample);
+ *                            AlarmLevel alarm_level(const SensorReading &reading, const AlarmConfig &config);
+ *                            AlarmLevel evaluate_reading(const SensorReading &reading);
+ *                            void render_reading(void); int32_t parse_hundredths(const string &text)
+ *                            void select_screen(char key); void render_diagnostics(int page);
+ *                            void console_input(void); void serve_console(void);
+ *                            void flush_log(void); void record_config(void); void export_log(void);
+ *                            void store_history(uint32_t time_ms, Tenths celsius, int humidity);
+ *                            void render_trend(void); void export_history(void)
  *
  *
- * Inputs                   : 4x4 Keypad, DHT-11 sensor
+ * Inputs                   : 4x4 Keypad, DHT-11 sensor, serial console, configuration in internal flash
  *
- * Outputs                  : 1802 LCD, LEDs, Buzzer
+ * Outputs                  : 1802 LCD, LEDs, Buzzer, serial console, event log in internal flash,
+ *                            binary telemetry to a building controller on a second UART
  *
  * Constraints              : Temperature must be displayed in °F/°C.
  *                            Humidity must be displayed in percentage.
- *                            User must use a prompt to enter thresholds.
+ *                            User must use a prompt to enter thresholds; they are kept in flash across resets.
  *                            The system will run forever.
  *
  * Sources/References       : https://os.mbed.com/docs/mbed-os/v6.15/apis/index.html
@@ -28,88 +40,257 @@
 #include "mbed.h"
 #include <string>
 #include "1802.h"
+#include "AlarmConfig.h"
+#include "Boot.h"
 #include "DHT11.h"
-
-// Time delay to address bounce in microseconds
-#define BOUNCE_DELAY_US 50000
+#include "Diagnostics.h"
+#include "FlightRecorder.h"
+#include "Keypad.h"
+#include "LcdText.h"
+#include "Pipeline.h"
+#include "RateOfRise.h"
+#include "SampleFilter.h"
+#include "SampleHistory.h"
+#include "Seqlock.h"
+#include "Siren.h"
+#include "Telemetry.h"
+#include "Temperature.h"
+#include "Trace.h"
+
+// Time each keypad row is driven before its columns are sampled, in microseconds
+#define KEYPAD_ROW_PERIOD_US 500
 
 // Watchdog timeout
 #define TIMEOUT_MS 10000
 
-// Interrupt Handler functions
-void col1_isr_handler(void);
-void col2_isr_handler(void);
-void col3_isr_handler(void);
-void col4_isr_handler(void);
+// Sensor read period; the DHT-11 needs more than a second between reads
+#define SAMPLE_PERIOD_MS 1100
+
+// LCD refresh period when the reading does not change
+#define DISPLAY_REFRESH_MS 10000
+
+// Degrees below the temperature threshold, in the unit it was entered in, at which the
+// backlight turns amber
+#define WARNING_MARGIN 5
+
+// Failed sensor reads in a row before the fault beep sounds
+#define SENSOR_FAULT_READS 3
+
+// Samples the rate of rise is fitted over, about 35 s at SAMPLE_PERIOD_MS
+#define ROR_WINDOW 32
+
+// Rate of rise that raises the alarm whatever the threshold, in tenths of a degree celsius
+// per minute; 8.3 is the 15 F/min of rate-of-rise heat detectors
+#define ROR_ALARM_RISE 83
+
+// Period of the heap, CPU and stack snapshots kept by the diagnostics
+#define DIAG_PERIOD_MS 10000
+
+// Baud rate of the serial console
+#define CONSOLE_BAUD 115200
+
+// UART4 on CN10, wired to the building controller, and its baud rate
+#define TELEMETRY_TX PA_0
+#define TELEMETRY_RX PA_1
+#define TELEMETRY_BAUD 115200
+
+// Period of the readings kept in the flight recorder, between the events it logs
+#define RECORDER_SAMPLE_MS 60000
+
+// Period at which queued flight records are handed to the flash
+#define RECORDER_WRITE_MS 1000
+
+// Flight records written to the console per print queue event while the log is exported
+#define RECORDER_EXPORT_LINES 8
+
+// Time span of the trend screen
+#define TREND_MS (60 * 60 * 1000)
+
+// Readings written to the console per print queue event while the history is exported
+#define HISTORY_EXPORT_LINES 16
+
+// Noise filter of each sensor channel. A median of three drops any single bad frame for one
+// sample of latency; MedianFilter<N>, EmaFilter<Shift> and NoFilter can be swapped in here.
+typedef MedianFilter<3> TemperatureFilter;
+typedef MedianFilter<3> HumidityFilter;
+
+// How bad the current reading is, in increasing order. LEVEL_RISE is an alarm raised by the
+// rate of rise before a threshold is crossed; it sounds as LEVEL_ALARM and is kept apart so
+// the LCD, the flight log and telemetry show which detector tripped.
+enum AlarmLevel { LEVEL_NORMAL, LEVEL_FAULT, LEVEL_WARNING, LEVEL_ALARM, LEVEL_RISE };
 
-// Keypad polling function
-void keypad_cycle(void);
+// The latest sensor reading, published as a whole by the filter stage
+struct SensorReading {
+    int status; // DHTLIB status of the last read
+    Tenths celsius; // Last good temperature in tenths of a degree celsius
+    int humidity; // Last good humidity in percent
+    int failures; // Failed reads in a row
+    int rise; // Temperature rise over the last ROR_WINDOW good reads, tenths of a degree celsius per minute
+    uint32_t time_ms; // Kernel clock time of the last read
+    uint32_t sequence; // Reads published so far, 0 before the first one
+    bool settled; // True once both channel filters are full; thresholds are not checked before
+};
+
+// Waits for the next key pressed on the keypad
+char next_key(void);
 
 // Set temperature threshold in celsius
-void set_celsius_threshold(void);
+void set_celsius_threshold(AlarmConfig &config);
 
 // Set temperature threshold in Fahrenheit
-void set_fahrenheit_threshold(void);
+void set_fahrenheit_threshold(AlarmConfig &config);
 
 // Set humidity threshold
-void set_humidity_threshold(void);
+void set_humidity_threshold(AlarmConfig &config);
+
+// Asks for the unit and thresholds on the keypad and stores them in flash
+void enter_thresholds(void);
+
+// Enters new thresholds while the alarm keeps monitoring with the old ones
+void reconfigure(void);
+
+// Makes a configuration, stored or just entered, the current one
+void apply_config(const AlarmConfig &config);
+
+// Print queue: hands the LCD panel to the keypad prompts
+void hold_display(Semaphore *held);
+
+// Print queue: takes the LCD panel back from the keypad prompts
+void release_display(void);
+
+// Acquire stage: starts a sensor read that completes on the check queue
+void acquire_sample(void);
+
+// Check queue: reads the sensor every SAMPLE_PERIOD_MS from now on
+void start_sampling(void);
+
+// Filter stage: turns a sensor sample into the latest reading
+void filter_sample(DHT11::Sample sample);
+
+// Compares a reading with the thresholds
+AlarmLevel alarm_level(const SensorReading &reading, const AlarmConfig &config);
+
+// Evaluate stage: sounds the siren for the level of a reading
+AlarmLevel evaluate_reading(const SensorReading &reading);
+
+// Render stage: prints the latest reading, or the diagnostic screen, in LCD panel
+void render_reading(void);
+
+// Switches between the reading and the diagnostic screens on a key press
+void select_screen(char key);
+
+// Prints a diagnostic screen in LCD panel
+void render_diagnostics(int page);
+
+// Serial console interrupt: a character arrived
+void console_input(void);
+
+// Runs the commands typed on the serial console
+void serve_console(void);
 
-// Prints current temperature and humidity in LCD panel
-void print_sensor_data(void);
+// Print queue: programs the queued flight records that are due
+void flush_log(void);
 
-// Checks current temperature and humidity with the thresholds
-void check_sensor_data(void);
+// Check queue: logs the thresholds just entered
+void record_config(void);
 
-// Handles buzzer sound
-void siren (void);
+// Print queue: writes the next records of the flight log to the console
+void export_log(void);
 
-// Interrupt Objects. Establishes an interrupt triggered by button on keypad.
-InterruptIn col1(PE_2, PullDown);
-InterruptIn col2(PE_4, PullDown);
-InterruptIn col3(PE_5, PullDown);
-InterruptIn col4(PE_6, PullDown);
+// Print queue: adds a good reading to the history
+void store_history(uint32_t time_ms, Tenths celsius, int humidity);
+
+// Prints the lowest and highest readings of the last TREND_MS in LCD panel
+void render_trend(void);
+
+// Print queue: writes the next readings of the history to the console
+void export_history(void);
+
+// Reads a typed number with up to two decimals as hundredths
+int32_t parse_hundredths(const string &text);
+
+// Keys as printed on the keypad, by row and column
+struct FireAlarmKeymap {
+    static constexpr char key(int row, int col) { return "123A456B789C*0#D"[row * 4 + col]; }
+};
+
+// Keypad with rows on PD_6 to PD_3 and columns on PE_2, PE_4, PE_5 and PE_6
+Keypad<KeypadPins<PD_6, PD_5, PD_4, PD_3>, KeypadPins<PE_2, PE_4, PE_5, PE_6>, FireAlarmKeymap> keypad;
 
 // LCD Object with initialization
 CSE321_LCD lcd(16, 2, LCD_5x8DOTS, PB_9, PB_8);
 
-// DigitalOut object
-DigitalOut siren_led(PD_7);
+// Buzzer on PD_14 and red LED on PD_7, sounded in the background while the alarm is on
+Siren siren(PD_14, PD_7);
 
-// DHT-11 sensor object with initialization
-DHT11 sensor(PF_13);
+// Tone pattern of each alarm level, generated at compile time
+const TonePattern *const level_tone[] = {
+    nullptr,                // LEVEL_NORMAL
+    &tones::FAULT_BEEP,     // LEVEL_FAULT
+    &tones::PRE_ALARM_CHIRP, // LEVEL_WARNING
+    &tones::SWEEP,          // LEVEL_ALARM
+    &tones::SWEEP,          // LEVEL_RISE
+};
 
-// Buzzer object with initialization
-PwmOut buzzer(PD_14);
+// DHT-11 sensor object with initialization; frames are decoded from
+// interrupt edge timestamps so the reading thread sleeps through them
+DHT11 sensor(PF_13, DHT11::DECODER_EDGES);
 
-// Thread object to print on LCD display
-Thread print_thread;
+// Thread object to print on LCD display, named for the diagnostics
+Thread print_thread(osPriorityNormal, OS_STACK_SIZE, nullptr, "print");
 
 // Thread object to check temperature and humidity
-Thread check_thread;
+Thread check_thread(osPriorityNormal, OS_STACK_SIZE, nullptr, "check");
+
+// Heap, CPU and stack statistics, sampled on the print queue
+Diagnostics diagnostics;
+
+// Start and end of each boot phase
+BootSequencer boot;
+
+// Alarm events and periodic readings kept in internal flash across resets. Records are queued
+// by the check thread and programmed by the print thread.
+FlightRecorder recorder;
 
-// Mutex object 
-Mutex mutex;
+// Line to the building controller. Writes never wait: a frame that does not fit the transmit
+// buffer is finished on a later poll.
+BufferedSerial telemetry_port(TELEMETRY_TX, TELEMETRY_RX, TELEMETRY_BAUD);
 
-// Creates a event queue to print sensor data
+// Every reading and the alarm level, batched into CRC-framed binary for the building controller.
+// Readings are queued by the check thread and sent by the print thread.
+TelemetryLink telemetry(telemetry_port);
+
+// Readings of the last hours, delta coded; kept and read on the print queue
+SampleHistory<HISTORY_BYTES> history(SAMPLE_PERIOD_MS);
+
+// Serial console on the ST-LINK virtual COM port; type d for a diagnostics dump, t for a trace dump,
+// b for the boot timing, l for the flight log and h for the reading history
+BufferedSerial console(CONSOLE_TX, CONSOLE_RX, CONSOLE_BAUD);
+
+// Creates a event queue for the render stage
 EventQueue print_queue (32 * EVENTS_EVENT_SIZE);
 
-// Creates a event queue to check sensor data
+// Creates a event queue for the acquire, filter and evaluate stages
 EventQueue check_queue (32 * EVENTS_EVENT_SIZE);
 
 // Gets a reference to the single Watchdog instance.
 Watchdog &watchdog = Watchdog::get_instance();
 
-int row = 0; // Row counter
-float temperature_threshold = 0; // Temperature threshold holder
-int humidity_threshold = 0; // Humidity threshold holder
-float current_fahrenheit = 0; // Current temperature holder (in fahrenheit)
-int current_celsius = 0; // Current temperature holder (in celsius)
-int current_humidity = 0; // Current humidity holder
-
-string key = ""; // Empty string
-string to_print = ""; // Empty string
-bool is_key_pressed = false; // Button press flag. True when a button is pressed.
-bool flag_celsius = false; // Celsius unit enable flag.
+// Thresholds and unit before any are set: no threshold can be crossed, and fahrenheit is shown
+const AlarmConfig NO_THRESHOLDS = {INT16_MAX, INT16_MAX, 0, false};
+
+Seqlock<AlarmConfig> alarm_config(NO_THRESHOLDS); // Thresholds and unit in use, read by the print and check threads without locking; set once written
+Seqlock<SensorReading> latest_reading; // Latest reading, read by the print and check threads without locking
+uint32_t acquire_start_us = 0; // us_ticker time the pending sensor read was requested
+bool acquire_timed = false; // True while acquire_start_us is the start of the read in progress
+RateOfRise<ROR_WINDOW> rate_of_rise; // Sliding regression of the temperature, fed by the filter stage
+TemperatureFilter temperature_filter; // Filter state of the temperature channel
+HumidityFilter humidity_filter; // Filter state of the humidity channel
+
+int screen = 0; // Screen shown by the print thread: 0 for the reading, then the diagnostic pages and the trend
+uint32_t history_block = 0; // Block of the history being exported
+unsigned history_skip = 0; // Readings of it already exported
+bool display_held = true; // True while the boot or the keypad prompts use the LCD panel; the print thread leaves it alone
 bool flag_decimal_point = false; // Decimal point flag. True when B is pressed.
 bool flag_threshold = false; // Threshold flag. True when D is press to enter threshold
 char degree = (char)223; // Degree Sign charecter
@@ -118,55 +299,131 @@ const char *degree_sign = &degree; // Pointer to degree variale
 // main() runs in its own thread in the OS
 int main()
 {   
-    // Enable clock to Port D
-    RCC->AHB2ENR |= 0x8;
-
-    // Enable pin PD_3, PD_4, PD_5 and PD_6 as output
-    GPIOD->MODER |= 0x1540;
-    GPIOD->MODER &= ~(0x2A80);
+    // Starts the cycle counter of the trace points, if they are compiled in
+    trace_start();
+
+    // Times every step of the bring-up, from reset to the first alarm decision
+    boot.start(BOOT_DECISION);
+
+    // Set LCD to correct state. The init sequence and its power-up delays are queued and sent
+    // in the background while the rest boots.
+    boot.start(BOOT_LCD, std::chrono::microseconds(LCD_POWERUP_US));
+    CSE321_LCD::Token lcd_ready = lcd.begin();
+
+    // Configures the keypad pins and scans one row every KEYPAD_ROW_PERIOD_US in the background
+    keypad.start(std::chrono::microseconds(KEYPAD_ROW_PERIOD_US));
+
+    // Restores the thresholds stored at the last setup, so the alarm is protecting the room
+    // again right after a power cycle or a watchdog reset. Only a board that was never set
+    // up, or whose record is damaged, waits for someone to type them.
+    boot.start(BOOT_CONFIG);
+    AlarmConfig config;
+    bool restored = load_config(config);
+    if (restored) {
+        apply_config(config);
+    }
+    boot.finish(BOOT_CONFIG);
+
+    // Finds the end of the flight log and logs this boot with the cause of the reset, so a
+    // watchdog reset shows in the log. The check thread is the only one to log from here on.
+    int log_error = recorder.mount();
+    if (log_error == RECORDER_ERROR_KVSTORE) {
+        static const char message[] = "log: off, the KVStore overlaps it in flash\r\n";
+        console.write(message, sizeof(message) - 1);
+    } else if (log_error) {
+        static const char message[] = "log: off, flash not usable\r\n";
+        console.write(message, sizeof(message) - 1);
+    }
+    recorder.record(FLIGHT_BOOT, LEVEL_NORMAL, 0, 0, DHTLIB_OK, ResetReason::get());
 
-    // Set LCD to correct state
-    lcd.begin();
+    // The print thread polls the telemetry link, which must never hold it on a full port
+    telemetry_port.set_blocking(false);
 
-    buzzer.write(0.0);
+    // Start a thread to print sensor data in LCD
+    print_thread.start(callback(&print_queue, &EventQueue::dispatch_forever));
 
-    // Attach the isr_row1() function's address to the rising edge
-    col1.rise(&col1_isr_handler);
+    // Start a thread to check sensor data
+    check_thread.start(callback(&check_queue, &EventQueue::dispatch_forever));
 
-    // Attach the isr_row2() function's address to the rising edge
-    col2.rise(&col2_isr_handler);
+    // Start the Watchdog timer. The check thread kicks it on every sample from now on, also
+    // while a first setup waits on the keypad.
+    watchdog.start(TIMEOUT_MS);
 
-    // Attach the isr_row3() function's address to the rising edge
-    col3.rise(&col3_isr_handler);
+    // Reads the sensor now and then as often as it allows. The first read is started at once
+    // and held by the driver until the sensor has settled after power-up; the periodic reads
+    // start a period after that, so the second start signal is a full second after the first
+    // frame. Each sample is filtered and evaluated on the check queue as soon as it arrives,
+    // and the LCD is redrawn when the reading changes. Until thresholds are set only the rate
+    // of rise and a failed sensor are reported.
+    boot.start(BOOT_SENSOR, sensor.settle_time());
+    check_queue.call(&acquire_sample);
+    check_queue.call_in(sensor.settle_time() + std::chrono::milliseconds(SAMPLE_PERIOD_MS), &start_sampling);
+
+    // Redraws the LCD now and then even if nothing changed
+    print_queue.call_every(std::chrono::milliseconds(DISPLAY_REFRESH_MS), &render_reading);
+    
+    // Samples the diagnostics now and then, and dumps them when d is typed on the console
+    print_queue.call(callback(&diagnostics, &Diagnostics::sample));
+    print_queue.call_every(std::chrono::milliseconds(DIAG_PERIOD_MS), callback(&diagnostics, &Diagnostics::sample));
+    console.sigio(callback(&console_input));
+
+    // Programs the flight records in batches; only this thread waits for the flash
+    print_queue.call(&flush_log);
+    print_queue.call_every(std::chrono::milliseconds(RECORDER_WRITE_MS), &flush_log);
+
+    // The display is held for this thread until the LCD is initialized and the board set up
+    lcd.wait(lcd_ready);
+    boot.finish(BOOT_LCD);
+    if (!restored) {
+        boot.start(BOOT_SETUP);
+
+        // Clear LCD panel
+        lcd.clear();
 
-    // Attach the isr_row4() function's address to the rising edge
-    col4.rise(&col4_isr_handler);
+        // Display text in LCD
+        lcd.print("Press D to enter");
 
-    // Clear LCD panel
-    lcd.clear();
-    
-    // Display text in LCD
-    lcd.print("Press D to enter");
+        // Sets LCD cursor to row 1 and column 3
+        lcd.setCursor(3, 1);
 
-    // Sets LCD cursor to row 1 and column 3
-    lcd.setCursor(3, 1);
+        // Display text in LCD
+        lcd.print("thresholds");
 
-    // Display text in LCD
-    lcd.print("thresholds");
+        // Spins a loop
+        while (true) {
 
-    // Spins a loop
-    while (true) {
+            // Checks if D is pressed
+            if(next_key() == 'D'){
+                break;
+            }
+        }
 
-        // Cycles power through keypad row pins
-        keypad_cycle();
+        // Asks for the thresholds and stores them
+        enter_thresholds();
+        boot.finish(BOOT_SETUP);
+    }
+    print_queue.call(&release_display);
 
-        // Checks if D is pressed
-        if(is_key_pressed && key.compare("D")==0){
-            is_key_pressed = false;
-            key = "";
-            break;
+    // Serves the diagnostic screens and D for new thresholds from the keypad; the print and
+    // check threads do the rest
+    while (true) {
+        char key = next_key();
+        if (key == 'D') {
+            reconfigure();
         }
-    }    
+        else {
+            print_queue.call(&select_screen, key);
+        }
+    }
+    return 0;
+}
+
+/* This function asks for the unit and the thresholds on the keypad, as after D is pressed,
+   and stores them in flash for the next boot. The answers are collected in a local
+   configuration and published to both threads in one go once the last one is in.
+*/
+void enter_thresholds(void){
+    AlarmConfig config = {};
 
     // Clears the LCD panel
     lcd.clear();
@@ -186,35 +443,31 @@ int main()
 
     // Spins a loop
     while (true) {
-
-        // Cycles power through keypad row pins
-        keypad_cycle();
+        char key = next_key();
         
         // Checks if C is pressed
-        if(is_key_pressed && key.compare("C")==0){
-            flag_celsius = true;
-            is_key_pressed = false;
-            key = "";
+        if(key == 'C'){
+            config.celsius = true;
             break;
         }
 
         // Checks if B is pressed
-        if(is_key_pressed && key.compare("B")==0){
-            is_key_pressed = false;
+        if(key == 'B'){
+            config.celsius = false;
             flag_threshold = true;
-            key = "";
+            flag_decimal_point = false;
             break;
         }
     }
 
-    // Checks if flag_celsius is true
-    if(flag_celsius){
+    // Checks if celsius was chosen
+    if(config.celsius){
         // Invokes the function to set temperature threshold in celsius.
-        set_celsius_threshold();
+        set_celsius_threshold(config);
 
     }else {
         // Invokes the function to set temperature threshold in fahrenheit.
-        set_fahrenheit_threshold();
+        set_fahrenheit_threshold(config);
     }
 
     // Clears the LCD panel
@@ -224,161 +477,484 @@ int main()
     lcd.print("Humidity (%): ");
 
     // Invokes the function to set humidity threshold in fahrenheit.
-    set_humidity_threshold();
+    set_humidity_threshold(config);
 
-    // Start a thread to print sensor data in LCD
-    print_thread.start(callback(&print_queue, &EventQueue::dispatch_forever));
+    // Stores the configuration; the alarm works on without it, but would ask again after a reset
+    if (!save_config(config)) {
+        static const char message[] = "config: not saved to flash\r\n";
+        console.write(message, sizeof(message) - 1);
+    }
 
-    // Start a thread to check sensor data
-    check_thread.start(callback(&check_queue, &EventQueue::dispatch_forever));
+    // The check thread switches to the whole new configuration between two samples, and logs
+    // it. A full queue is waited out, so neither is lost.
+    while (check_queue.call(&apply_config, config) == 0) {
+        ThisThread::sleep_for(10ms);
+    }
+    while (check_queue.call(&record_config) == 0) {
+        ThisThread::sleep_for(10ms);
+    }
+}
 
-    // Calls an print_sensor_data on the queue every second.
-    print_queue.call_every(2000ms, &print_sensor_data);
-    
-    //Start the Watchdog timer.
-    watchdog.start(TIMEOUT_MS);
+/* This function runs the setup prompts again when D is pressed while monitoring. The print
+   thread hands over the LCD panel first, and the check thread keeps evaluating every sample
+   with the old thresholds until the new ones are entered.
+*/
+void reconfigure(void){
+    // A full print queue is waited out; the hand-over must be queued before waiting on it
+    Semaphore held;
+    while (print_queue.call(&hold_display, &held) == 0) {
+        ThisThread::sleep_for(10ms);
+    }
+    held.acquire();
 
-    // Calls an check_sensor_data on the queue every second. 
-    check_queue.call_every(2000ms, &check_sensor_data);
-    
-    // Spins a main loop
-    while (true) {
+    screen = 0;
+    enter_thresholds();
+
+    while (print_queue.call(&release_display) == 0) {
+        ThisThread::sleep_for(10ms);
     }
-    return 0;
 }
 
-/* This function reads sensor and prints temperature in celsius or in fahrenheit
-   and humidity in percentage in LCD. The function uses mutex to to synchronize
-   the access to its critical section.
+/* This function makes a configuration the current one. It runs on the main thread at boot,
+   before the threads start, and on the check queue after the prompts, so there is one
+   writer. The configuration is published through a seqlock, so a render or a check copies
+   either the old one or the new one as a whole, never a new threshold with the old unit.
+*/
+void apply_config(const AlarmConfig &config){
+    alarm_config.write(config);
+}
+
+/* This function runs on the print queue before the setup prompts take the LCD panel. Once it
+   has run no render is in progress and none starts until release_display().
+*/
+void hold_display(Semaphore *held){
+    display_held = true;
+    held->release();
+}
+
+/* This function runs on the print queue after the setup prompts, and shows the reading again. */
+void release_display(void){
+    display_held = false;
+    render_reading();
+}
+
+/* Acquire stage. This function starts a sensor read without waiting for it. The sensor
+   transaction runs from interrupts and filter_sample() receives the sample on the check
+   queue, so no thread is held across it.
+*/
+void acquire_sample(void){
+    uint32_t start = us_ticker_read();
+    TRACE_SCOPE(TRACE_ACQUIRE);
+
+    // A read started before the sensor has settled is held until then; the stage starts after
+    uint32_t settle_us = uint32_t(std::chrono::microseconds(sensor.settle_time()).count());
+    // A read still in progress makes this period skipped. Its sample is then left out of the
+    // acquire stage time, which would otherwise include the skipped period.
+    if (sensor.start_read(&check_queue, callback(&filter_sample))) {
+        acquire_start_us = start + settle_us;
+        acquire_timed = true;
+    } else {
+        acquire_timed = false;
+    }
+}
+
+/* This function runs on the check queue a period after the first read was started, and
+   reads the sensor every SAMPLE_PERIOD_MS from then on.
+*/
+void start_sampling(void){
+    acquire_sample();
+    check_queue.call_every(std::chrono::milliseconds(SAMPLE_PERIOD_MS), &acquire_sample);
+}
+
+/* Filter stage. This function takes a sensor sample, validates it, runs it through the
+   temperature and humidity filters and publishes it as the latest reading. The reading is
+   published through a seqlock, so the render stage never waits for this function. It then
+   evaluates the reading straight away and asks for a redraw if the displayed values or the
+   alarm level changed.
 */ 
-void print_sensor_data(void){
-    
-    mutex.lock(); // Wait until a Mutex becomes available. 
-    sensor.read(); // Update sensor data
-    
-    float temp_f = sensor.getFahrenheit(); // Gets temperature in fahrenheit.
-    int temp_c = sensor.getCelsius(); // Gets temperature in celsius.
+void filter_sample(DHT11::Sample sample){
 
-    if(temp_f <=(current_fahrenheit + 2.0) || temp_f >= (current_fahrenheit - 2.0) )
+    uint32_t start = us_ticker_read();
+    TRACE_SCOPE(TRACE_FILTER);
+    if (acquire_timed) {
+        stage_done(STAGE_ACQUIRE, acquire_start_us);
+        acquire_timed = false;
+    }
+    boot.finish(BOOT_SENSOR);
+
+    // Only this thread writes the reading, so its own copy is always current
+    SensorReading reading = latest_reading.read();
+    SensorReading previous = reading;
+
+    // Keeps the previous reading if the sensor did not answer. Good frames go through the
+    // channel filters, so a single glitch can neither raise nor clear the alarm.
+    if (sample.status == DHTLIB_OK)
     {
-        current_fahrenheit = temp_f; 
+        reading.celsius = temperature_filter.update(sample.temperature); // Temperature in celsius
+        reading.humidity = humidity_filter.update(sample.humidity); // Humidity in percent
+        reading.failures = 0;
+        reading.settled = temperature_filter.settled() && humidity_filter.settled();
     }
-    if(temp_c <= (current_celsius + 2.0) || temp_c >= (current_celsius - 2.0) )
+    else
     {
-        current_celsius = temp_c; 
+        reading.failures++;
+    }
+    reading.status = sample.status;
+    reading.time_ms = (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+
+    // Fits the temperature slope over the last ROR_WINDOW good reads; only a full window counts
+    if (sample.status == DHTLIB_OK)
+    {
+        rate_of_rise.add(reading.time_ms, reading.celsius);
+        reading.rise = rate_of_rise.full() ? rate_of_rise.per_minute() : 0;
+    }
+    reading.sequence++;
+    latest_reading.write(reading);
+    stage_done(STAGE_FILTER, start);
+
+    // Detection runs on every sample, independent of the display
+    static AlarmLevel last_level = LEVEL_NORMAL;
+    AlarmLevel level = evaluate_reading(reading);
+
+    bool changed = previous.sequence == 0 || level != last_level ||
+                   reading.celsius != previous.celsius ||
+                   reading.humidity != previous.humidity;
+
+    // Logs what led up to an alarm or a fault: every change of level, the first failed reads
+    // of a run and a reading every RECORDER_SAMPLE_MS. Queuing a record never waits.
+    static uint32_t last_logged_ms = 0;
+    if (level != last_level) {
+        recorder.record(FLIGHT_LEVEL, level, reading.celsius, reading.humidity, reading.status, last_level);
+    }
+    if (sample.status != DHTLIB_OK && reading.failures <= SENSOR_FAULT_READS) {
+        recorder.record(FLIGHT_SENSOR_ERROR, level, reading.celsius, reading.humidity, reading.status, reading.failures);
+    }
+    if (sample.status == DHTLIB_OK &&
+        (last_logged_ms == 0 || reading.time_ms - last_logged_ms >= RECORDER_SAMPLE_MS)) {
+        recorder.record(FLIGHT_SAMPLE, level, reading.celsius, reading.humidity, reading.status, reading.rise);
+        last_logged_ms = reading.time_ms;
+    }
+    last_level = level;
+    if (changed) {
+        print_queue.call(&render_reading);
+    }
+
+    // Keeps every good reading for the trend screen and the console
+    if (sample.status == DHTLIB_OK) {
+        print_queue.call(&store_history, reading.time_ms, reading.celsius, reading.humidity);
+    }
+
+    // Sends every read, good or not, to the building controller. Queuing never waits; the print
+    // thread batches and transmits.
+    TelemetrySample telemetry_sample = { reading.time_ms, reading.celsius, int16_t(reading.rise), uint8_t(reading.humidity),
+                                         uint8_t(level), int8_t(reading.status), uint8_t(reading.failures > 255 ? 255 : reading.failures) };
+    telemetry.post(telemetry_sample);
+    print_queue.call(callback(&telemetry, &TelemetryLink::poll));
+}
+
+/* This function compares a reading with the thresholds. A temperature higher than the
+   temperature threshold or a humidity less than the humidity threshold is an alarm, a
+   temperature rising faster than ROR_ALARM_RISE short of those a rate-of-rise alarm, a
+   temperature within WARNING_MARGIN of its threshold a warning and a sensor that failed
+   SENSOR_FAULT_READS reads in a row a fault. Nothing is reported before the first read, and
+   only a fault until the channel filters are full, so one bad frame at boot cannot raise
+   the alarm.
+*/
+AlarmLevel alarm_level(const SensorReading &reading, const AlarmConfig &config){
+
+    if (reading.sequence == 0) {
+        return LEVEL_NORMAL;
+    }
+    if (!reading.settled) {
+        return reading.failures >= SENSOR_FAULT_READS ? LEVEL_FAULT : LEVEL_NORMAL;
+    }
+
+    // Thresholds are kept in the sensor's unit, so this is integer math whatever unit was entered
+    if (reading.celsius > config.temperature_threshold || reading.humidity < config.humidity_threshold) {
+        return LEVEL_ALARM;
+    }
+
+    // A fast fire is caught by how quickly it heats the room, well before the threshold
+    if (reading.rise >= ROR_ALARM_RISE) {
+        return LEVEL_RISE;
+    }
+    if (reading.celsius > config.warning_threshold) {
+        return LEVEL_WARNING;
+    }
+    if (reading.failures >= SENSOR_FAULT_READS) {
+        return LEVEL_FAULT;
+    }
+    return LEVEL_NORMAL;
+}
+
+/* Evaluate stage. This function checks a reading with the thresholds. On an alarm it starts
+   the siren, which sounds the buzzer and turns on the red LED in the background. A warning
+   chirps and a sensor fault beeps, both without the LED. Otherwise it silences the siren.
+*/ 
+AlarmLevel evaluate_reading(const SensorReading &reading){
+
+    uint32_t start = us_ticker_read();
+    TRACE_SCOPE(TRACE_EVALUATE);
+    AlarmLevel level = alarm_level(reading, alarm_config.read());
+
+    // Plays the tone of the level or stops the siren; neither waits for the sound, so the
+    // check keeps its rate. Only an alarm lights the red LED.
+    if (level_tone[level]) {
+        siren.play(*level_tone[level], level >= LEVEL_ALARM);
+    }
+    else{
+        siren.stop();
     }
     
-    
-    current_humidity = sensor.getHumidity(); // Gets humidity in percent
-    
-    /* Checks if flag_celsius is true and print temeperature in celsius unit otherwise prints
-       prints temperature in fahrenheit unit
+    //Refresh the Watchdog timer.
+    Watchdog::get_instance().kick();
+
+    // The first decision that could sound the alarm on a crossed threshold ends the boot
+    if (alarm_config.writes() && reading.settled) {
+        boot.finish(BOOT_DECISION);
+    }
+
+    stage_done(STAGE_EVALUATE, start);
+    return level;
+}
+
+/* Render stage. This function prints the latest temperature in celsius or in fahrenheit and
+   humidity in percentage in LCD and fades the backlight to the colour of the alarm level.
+   The reading is copied from the seqlock, so no lock is taken.
+*/
+void render_reading(void){
+
+    // The setup prompts have the LCD panel
+    if (display_held) {
+        return;
+    }
+
+    uint32_t start = us_ticker_read();
+    TRACE_SCOPE(TRACE_RENDER);
+    SensorReading reading = latest_reading.read();
+    AlarmConfig config = alarm_config.read();
+    AlarmLevel level = alarm_level(reading, config);
+
+    // An alarm always brings the reading back on the screen
+    if (level >= LEVEL_ALARM) {
+        screen = 0;
+    }
+
+    /* Checks if celsius is set and print temeperature in celsius unit otherwise prints
+       prints temperature in fahrenheit unit, with ^ after it on a rate-of-rise alarm. Both
+       rows are formatted straight into the LCD frame buffer in fixed-width fields, without
+       allocating.
     */
-    if (flag_celsius) 
+    if (screen != 0)
     {
-      
-      to_print = "Temp.: " + to_string(current_celsius) + degree + "C";
-      
-      // Clears the LCD panel
-      lcd.clear();
-
-      // Display text in LCD
-      lcd.print(to_print.c_str());
+      render_diagnostics(screen);
+    }
+    else if (config.celsius) 
+    {
+      LcdText<LCD_FRAME_COLS>(lcd.line(0)).text("Temp.: ").fixed<5, 1>(reading.celsius).glyph(degree).text("C").text(" ").glyph(level == LEVEL_RISE ? '^' : ' ').end();
     } 
     else 
     {
-      to_print = "Temp.: " + to_string(current_fahrenheit) + degree + "F";
-      
-      // Clears the LCD panel
-      lcd.clear();
+      LcdText<LCD_FRAME_COLS>(lcd.line(0)).text("Temp.: ").fixed<5, 1>(temperature::to_fahrenheit(reading.celsius)).glyph(degree).text("F").text(" ").glyph(level == LEVEL_RISE ? '^' : ' ').end();
+    }
+    if (screen == 0)
+    {
+      LcdText<LCD_FRAME_COLS>(lcd.line(1)).text("Humidity: ").integer<3>(reading.humidity).text("%").end();
+    }
+
+    // Sends only the characters that changed since the last update
+    lcd.update();
 
-      // Display text in LCD
-      lcd.print(to_print.c_str());
+    // Fades the backlight green, amber or red in the background, one step at a time on this queue
+    if (level >= LEVEL_ALARM) {
+        lcd.fadeTo(255, 0, 0, 500ms, &print_queue);
+    } else if (level == LEVEL_WARNING) {
+        lcd.fadeTo(255, 128, 0, 1000ms, &print_queue);
+    } else {
+        lcd.fadeTo(0, 255, 0, 1000ms, &print_queue);
     }
 
-    // Sets LCD cursor to row 1 and column 0
-    lcd.setCursor(0, 1);
-    
-    to_print = "Humidity: " + to_string(current_humidity) + "%";
-    
-    // Clears the LCD panel
-    lcd.print(to_print.c_str());
+    stage_done(STAGE_RENDER, start);
+}
 
-    mutex.unlock(); // Unlock a mutex that has been locked by the same thread previously.
-    
-    Watchdog::get_instance().kick();
+/* This function runs on the print queue for every key pressed once the thresholds are set.
+   A steps through the diagnostic pages and the trend, and # goes back to the reading.
+*/
+void select_screen(char key){
+    int pages = 3 + diagnostics.threads();
+    if (key == 'A') {
+        screen = (screen + 1) % pages;
+    } else if (key == '#') {
+        screen = 0;
+    } else {
+        return;
+    }
+    render_reading();
 }
 
-/* This function checks temperature and humidity with the thresholds and if temperature
-   is higher than the temperature threshold or humidity is less than the humidity threshold,
-   it calls siren() function to activate the buzzer and turn on the red LED. Otherwise it 
-   keeps checking. The function uses mutex to synchronize the access to its critical section.
-*/ 
-void check_sensor_data(void){
+/* This function prints diagnostic page 1, heap and CPU load, or the stack use of one
+   thread on the pages after it, from the latest snapshot. The trend is the last page.
+*/
+void render_diagnostics(int page){
+    int pages = 3 + int(diagnostics.threads());
+    if (page == pages - 1) {
+        render_trend();
+        return;
+    }
+    DiagSample sample = diagnostics.count() ? diagnostics.history(0) : DiagSample();
+    if (page == 1) {
+        LcdText<LCD_FRAME_COLS>(lcd.line(0)).text("Heap ").integer<5>(sample.heap_current).text("/").integer<5>(sample.heap_max).end();
+        LcdText<LCD_FRAME_COLS>(lcd.line(1)).text("CPU ").fixed<5, 1>(sample.cpu_load).text("% F").integer<4>(sample.heap_failures).end();
+    } else {
+        const DiagThread &thread = diagnostics.thread(page - 2);
+        LcdText<LCD_FRAME_COLS>(lcd.line(0)).field<LCD_FRAME_COLS>(thread.name ? thread.name : "?");
+        LcdText<LCD_FRAME_COLS>(lcd.line(1)).text("Stack").integer<5>(sample.stack_used[page - 2]).text("/").integer<5>(thread.stack_size).end();
+    }
+}
 
-    mutex.lock(); // Wait until a Mutex becomes available.
+/* This function prints the lowest and highest temperature, in the unit entered, and humidity
+   of the last TREND_MS. Only the history blocks of that hour are decoded.
+*/
+void render_trend(void){
+    bool celsius = alarm_config.read().celsius;
+    Tenths low = INT16_MAX, high = INT16_MIN;
+    int dry = 100, wet = 0;
+    uint32_t now = (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+    history.query(now - TREND_MS, now, [&](const HistorySample &sample) {
+        Tenths value = celsius ? sample.celsius : temperature::to_fahrenheit(sample.celsius);
+        low = value < low ? value : low;
+        high = value > high ? value : high;
+        dry = sample.humidity < dry ? sample.humidity : dry;
+        wet = sample.humidity > wet ? sample.humidity : wet;
+    });
+    if (low > high) {
+        low = high = 0;
+        dry = wet = 0;
+    }
+    LcdText<LCD_FRAME_COLS>(lcd.line(0)).text("T ").fixed<5, 1>(low).text("-").fixed<5, 1>(high).glyph(degree).text(celsius ? "C" : "F").end();
+    LcdText<LCD_FRAME_COLS>(lcd.line(1)).text("RH ").integer<3>(dry).text("-").integer<3>(wet).text("% 1h").end();
+}
 
-    // Checks if flag_celsius is true. 
-    if (flag_celsius){
-        
-        /* Checks if current temperature in celsius is greater than temperature threshold or
-           current humidity less than humidity threshold and it calls siren() function 
-           to activate the buzzer.
-        */   
-        if (current_celsius > temperature_threshold || current_humidity < humidity_threshold) {
-            // 
-            siren();
-        }
-        else{
-            // Turn off the buzzer.
-            buzzer.write(0.0);
-            siren_led = 0;
-        }
-    }else{
+/* This function runs on the print queue for every good reading and adds it to the history. */
+void store_history(uint32_t time_ms, Tenths celsius, int humidity){
+    history.append(time_ms, celsius, humidity);
+}
 
-        /* Checks if current temperature in fahrenheit is greater than temperature threshold or
-           current humidity less than humidity threshold and it calls siren() function 
-           to activate the buzzer.
-        */ 
-        if (current_fahrenheit > temperature_threshold || current_humidity < humidity_threshold) {
-            siren();
-        }else {
-            // Turn off the buzzer
-            buzzer.write(0.0);
-            siren_led = 0;
-        }
+/* This function writes a few readings of the history to the console, oldest first, and
+   queues itself again until the whole history is out. Readings added meanwhile are
+   exported too; a block evicted meanwhile is skipped.
+*/
+void export_history(void){
+    if (history_block < history.first_block()) {
+        history_block = history.first_block();
+        history_skip = 0;
+    }
+    if (history_block == history.end_block()) {
+        return;
+    }
+    unsigned lines = history.read_block(history_block, history_skip, HISTORY_EXPORT_LINES, [](const HistorySample &sample) {
+        char line[32];
+        int length = snprintf(line, sizeof(line), "%lu,%d,%u\r\n", (unsigned long)sample.time_ms, sample.celsius, sample.humidity);
+        console.write(line, length);
+    });
+    history_skip += lines;
+    if (lines < HISTORY_EXPORT_LINES) {
+        history_block++;
+        history_skip = 0;
+    }
+    if (history_block != history.end_block()) {
+        print_queue.call(&export_history);
     }
+}
 
-    mutex.unlock(); // Unlock a mutex that has been locked by the same thread previously.
-    
-    //Refresh the Watchdog timer.
-    Watchdog::get_instance().kick();
+/* This function runs in interrupt context when a character arrives on the serial console.
+   The command is served on the print queue.
+*/
+void console_input(void){
+    print_queue.call(&serve_console);
 }
 
-// Handles buzzer sound and red LED
-void siren (void){
-    siren_led = 1;
-    for(int i =400; i<600; i++){
-        buzzer.period(1.0/(float)i);
-        buzzer.write(0.5);
-        wait_us(10000);
+/* This function runs the commands waiting on the serial console: d dumps the diagnostics
+   and b the boot timing as text, t the trace ring in binary, for host/trace_json, and l the
+   flight log and h the reading history as CSV.
+*/
+void serve_console(void){
+    char command;
+    while (console.readable() && console.read(&command, 1) == 1) {
+        if (command == 'd') {
+            diagnostics.dump(console);
+        } else if (command == 't') {
+            trace_dump(console);
+        } else if (command == 'b') {
+            boot.dump(console);
+        } else if (command == 'l') {
+            recorder.flush(true);
+            recorder.rewind();
+            export_log();
+        } else if (command == 'h') {
+            static const char header[] = "time_ms,celsius_tenths,humidity\r\n";
+            console.write(header, sizeof(header) - 1);
+            history_block = history.first_block();
+            history_skip = 0;
+            export_history();
+        }
     }
-    wait_us(2000000);
-    
-    for(int i =600; i>400; i--){
-        buzzer.period(1.0/(float)i);
-        buzzer.write(0.5);
-        wait_us(10000);
+}
+
+/* This function runs on the print queue every RECORDER_WRITE_MS and programs the flight
+   records that are due. It blocks the print thread, never the check thread, while the flash
+   is programmed or erased.
+*/
+void flush_log(void){
+    recorder.flush();
+}
+
+/* This function runs on the check queue after thresholds are entered, so the check thread
+   stays the only one queuing flight records.
+*/
+void record_config(void){
+    SensorReading reading = latest_reading.read();
+    AlarmConfig config = alarm_config.read();
+    recorder.record(FLIGHT_CONFIG, alarm_level(reading, config), config.temperature_threshold,
+                    config.humidity_threshold, reading.status, config.celsius ? 1 : 0);
+}
+
+/* This function writes a few flight records to the console and queues itself again until
+   the whole log is out, so renders and other commands run in between.
+*/
+void export_log(void){
+    if (recorder.read(console, RECORDER_EXPORT_LINES)) {
+        print_queue.call(&export_log);
     }
+}
 
-    Watchdog::get_instance().kick();
+/* This function reads the number typed on the keypad, with up to two decimals after the
+   point, as hundredths. It uses integer math only.
+*/
+int32_t parse_hundredths(const string &text){
+    int32_t value = 0;
+    int decimals = -1; // Digits after the point, -1 before the point
+    for (char c : text) {
+        if (c == '.') {
+            decimals = 0;
+        } else if (decimals < 2) {
+            value = value * 10 + (c - '0');
+            if (decimals >= 0) {
+                decimals++;
+            }
+        }
+    }
+    for (int i = decimals < 0 ? 0 : decimals; i < 2; i++) {
+        value *= 10;
+    }
+    return value;
 }
 
 /* This function handles user input from keypad to set humidity threshold */
-void set_humidity_threshold(void){
+void set_humidity_threshold(AlarmConfig &config){
     int count = 0;
     string humidity = ""; 
-    humidity_threshold = 0;
+    int threshold = 0; // Typed threshold, published once it is in range
 
     // Clears the LCD panel
     lcd.clear();
@@ -390,7 +966,7 @@ void set_humidity_threshold(void){
     lcd.setCursor(4, 1);
 
     // Spins a loop to check the user input if it is within the range.
-    while (humidity_threshold < 20 || humidity_threshold > 80) {
+    while (threshold < 20 || threshold > 80) {
       
       // Spins a loop and runs until count equals to 2.
       while (count < 2) {
@@ -398,15 +974,12 @@ void set_humidity_threshold(void){
         // Spins a loop.
         while (true) {
 
-          // Invokes the keypad_cycles method to power through the row pins.
-          keypad_cycle();
+          char key = next_key();
 
           // Checks if any key is pressed other than A, B, C, D, * and #.
-          if (is_key_pressed && key.compare("A") != 0 && key.compare("B") != 0 && key.compare("C") != 0 && key.compare("D") != 0 && key.compare("*") != 0 && key.compare("#") != 0) {
-            is_key_pressed = false;
+          if (key >= '0' && key <= '9') {
             humidity = humidity + key; // Concatenate strings
             lcd.print(humidity.c_str()); // Display text in LCD.
-            key = "";
             break;
           }
         }
@@ -425,13 +998,13 @@ void set_humidity_threshold(void){
         lcd.print(humidity.c_str());
       }
 
-      // Converts humidity to string and assign resultant to humidity_threshold
-      humidity_threshold = stoi(humidity);
+      // Converts humidity to string and assign resultant to threshold
+      threshold = stoi(humidity);
 
-      /* Checks if humidity_threshold outside of the range. If true, then 
+      /* Checks if threshold outside of the range. If true, then 
          resets the LCD panel.
       */   
-      if(humidity_threshold < 20 || humidity_threshold > 80){
+      if(threshold < 20 || threshold > 80){
           lcd.clear(); // Clears the LCD panel
           lcd.print("Humidity (%): "); // Display text in LCD
           lcd.setCursor(4, 1); // Sets LCD cursor to row 1 and column 4
@@ -439,164 +1012,41 @@ void set_humidity_threshold(void){
           count = 0;
       }
     }
-}
-
-/* This function cycles through the keypad by providing power to one column 
-   and turning off other columns.  
-*/
-void keypad_cycle(void) {
-
-  if (row == 0) 
-  { 
-    // Sets Pin PD_6 to 1 and PD_3, PD_4 and PD_5 to 0.
-    GPIOD->ODR |= 0x40;
-    GPIOD->ODR &= ~(0x38);
-    wait_us(BOUNCE_DELAY_US);
-  } 
-  else if (row == 1) 
-  {
-    // Sets Pin PD_5 to 1 and PD_3, PD_4 and PD_6 to 0.
-    GPIOD->ODR |= 0x20;
-    GPIOD->ODR &= ~(0x58);
-    wait_us(BOUNCE_DELAY_US);
-  } 
-  else if (row == 2) 
-  {
-    // Sets Pin PD_4 to 1 and PD_3, PD_5 and PD_6 to 0.
-    GPIOD->ODR |= 0x10;
-    GPIOD->ODR &= ~(0x68);
-    wait_us(BOUNCE_DELAY_US);
-  } 
-  else if (row == 3) 
-  {
-    // Sets Pin PD_3 to 1 and PD_4, PD_5 and PD_6 to 0.
-    GPIOD->ODR |= 0x8;
-    GPIOD->ODR &= ~(0x70);
-    wait_us(BOUNCE_DELAY_US);
-  }
-  row += 1; // Increment row by 1.
-  row %= 4; 
-}
-
-/* This functions run when interrupt is triggered by column #1 button's rising edge. */
-void col1_isr_handler(void)
-{
-    if (row == 0) {
-    is_key_pressed = true;
-    key = "1";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 1) {
-    is_key_pressed = true;
-    key = "4";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 2) {
-    is_key_pressed = true;
-    key = "7";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 3) {
-    is_key_pressed = true;
-    if (flag_threshold){
-        flag_decimal_point = true;
-    }
-    key = "*";
-    wait_us(BOUNCE_DELAY_US);
-  }
-
-}
-
-/* This functions run when interrupt is triggered by column #2 button's rising edge. */
-void col2_isr_handler(void)
-{
-
-    if (row == 0) {
-    is_key_pressed = true;
-    key = "2";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 1) {
-    is_key_pressed = true;
-    key = "5";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 2) {
-    is_key_pressed = true;
-    key = "8";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 3) {
-    is_key_pressed = true;
-    key = "0";
-    wait_us(BOUNCE_DELAY_US);
-  }
 
+    config.humidity_threshold = threshold;
 }
 
-/* This functions run when interrupt is triggered by column #3 button's rising edge. */
-void col3_isr_handler(void)
-{
-
-    if (row == 0) {
-    is_key_pressed = true;
-    key = "3";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 1) {
-    is_key_pressed = true;
-    key = "6";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 2) {
-    is_key_pressed = true;
-    key = "9";
-    wait_us(BOUNCE_DELAY_US);
-
-  } else if (row == 3) {
-    is_key_pressed = true;
-    key = "#";
-    wait_us(BOUNCE_DELAY_US);
-  }
-
-}
-
-/* This functions run when interrupt is triggered by column #4 button's rising edge. */
-void col4_isr_handler(void)
+/* This function waits for the next key press queued by the keypad scanner. The thread
+   sleeps until a key event arrives instead of polling the keypad.
+*/
+char next_key(void)
 {
+    while (true) {
+        KeyEvent event = keypad.wait();
+        if (event.type != KEY_PRESS) {
+            continue;
+        }
 
-    if (row == 0) {
-    is_key_pressed = true;
-    key = "A";
-    wait_us(BOUNCE_DELAY_US);
-  } else if (row == 1) {
-    is_key_pressed = true;
-    key = "B";
-    wait_us(BOUNCE_DELAY_US);
-  } else if (row == 2) {
-    is_key_pressed = true;
-    key = "C";
-    wait_us(BOUNCE_DELAY_US);
-  } else if (row == 3) {
-    is_key_pressed = true;
-    key = "D";
-    wait_us(BOUNCE_DELAY_US);
-  }
-
+        // The * key is the decimal point while a fahrenheit threshold is entered
+        if (event.key == '*' && flag_threshold) {
+            flag_decimal_point = true;
+        }
+        return event.key;
+    }
 }
 
 /* This function handles user input from keypad to set temperature threshold
    in celsius
 */
-void set_celsius_threshold(void)
+void set_celsius_threshold(AlarmConfig &config)
 {   
-    // Checks if flag_celsius is false
-    if(!flag_celsius){
+    // Checks if celsius was not chosen
+    if(!config.celsius){
         return;
     }
     int count = 0;
     string temperature = "";
-    temperature_threshold = 100;
+    int threshold = 100; // Typed threshold in whole degrees
     
     lcd.clear(); // Clears the LCD panel
     lcd.print("Temp. ("); // Display text in LCD
@@ -604,8 +1054,8 @@ void set_celsius_threshold(void)
     lcd.print("C): "); // Display text in LCD
     lcd.setCursor(4, 1); // Sets LCD cursor to row 1 and column 4
 
-    // Spins a loop and runs till temperature_threshold greater than 50 
-    while (temperature_threshold > 50) {
+    // Spins a loop and runs till threshold greater than 50 
+    while (threshold > 50) {
         
         // Spins a loop and runs until count equals to 2.
         while (count<2) {
@@ -613,15 +1063,12 @@ void set_celsius_threshold(void)
           //Spins a loop
           while (true) {
 
-            // Invokes the keypad_cycles method to power through the row pins.
-            keypad_cycle();
+            char key = next_key();
 
             // Checks if any key is pressed other than A, B, C, D, * and #.
-            if (is_key_pressed && key.compare("A") != 0 && key.compare("B") != 0 && key.compare("C") != 0 && key.compare("D") != 0 && key.compare("#") != 0 && key.compare("*") != 0){
-              is_key_pressed = false;
+            if (key >= '0' && key <= '9'){
               temperature = temperature + key; // Concatenate strings.
               lcd.print(temperature.c_str()); // Display text in LCD.
-              key = "";
               break;
             }
           }
@@ -642,13 +1089,13 @@ void set_celsius_threshold(void)
           lcd.print(temperature.c_str());
         }
 
-        // Converts temperature to string and assign resultant to temperature_threshold
-        temperature_threshold = stoi(temperature);
+        // Converts temperature to string and assign resultant to threshold
+        threshold = stoi(temperature);
 
         /* Checks if humidity_threshold outside of the range. If true, then 
          resets the LCD panel.
         */ 
-        if(temperature_threshold>50){
+        if(threshold>50){
             lcd.clear(); // Clears the LCD panel
             lcd.print("Temp. ("); // Display text in LCD
             lcd.print(degree_sign); // Display text in LCD
@@ -658,20 +1105,24 @@ void set_celsius_threshold(void)
             count = 0;
         }
     }
+
+    // Stores the thresholds in tenths of a degree celsius
+    config.temperature_threshold = temperature::from_whole(threshold);
+    config.warning_threshold = temperature::from_whole(threshold - WARNING_MARGIN);
 }
 
 /* This function handles user input from keypad to set temperature threshold
    in fahrenheit
 */
-void set_fahrenheit_threshold(void)
+void set_fahrenheit_threshold(AlarmConfig &config)
 {
-    // Checks if flag_celsius is true
-    if(flag_celsius){
+    // Checks if celsius was chosen
+    if(config.celsius){
         return;
     }
     int count = 0;
     string temperature = "";
-    temperature_threshold = 123;
+    int32_t threshold = 12300; // Typed threshold in hundredths of a degree
 
     lcd.clear(); // Clears the LCD panel
     lcd.print("Temp. ("); // Display text in LCD
@@ -679,8 +1130,8 @@ void set_fahrenheit_threshold(void)
     lcd.print("F): "); // Display text in LCD
     lcd.setCursor(4, 1); // Sets LCD cursor to row 1 and column 4
 
-    // Spins a loop and runs till temperature_threshold greater than 122.
-    while (temperature_threshold > 122) {
+    // Spins a loop and runs till threshold greater than 122.
+    while (threshold > 12200) {
         
         // Spins a loop and runs until count equals to 5.
         while (count<5) {
@@ -688,15 +1139,13 @@ void set_fahrenheit_threshold(void)
           //Spins a loop
           while (true) {
 
-            // Invokes the keypad_cycles method to power through the row pins.
-            keypad_cycle();
+            char key = next_key();
 
             // Checks if any key is pressed other than A, B, C, D, and #.
-            if (is_key_pressed && key.compare("A") != 0 && key.compare("B") != 0 && key.compare("C") != 0 && key.compare("D") != 0 && key.compare("#") != 0) {
-              is_key_pressed = false;
+            if ((key >= '0' && key <= '9') || key == '*') {
 
               // Checks if * key is pressed. 
-              if(key.compare("*") == 0){
+              if(key == '*'){
 
                 // Checks if flag_decimal_point is true.
                   if (flag_decimal_point){
@@ -709,7 +1158,6 @@ void set_fahrenheit_threshold(void)
                   temperature = temperature + key; // Concatenate strings.
                   count += 1; // Increment count by 1.
               }
-              key = "";
               break;
             }
           }
@@ -729,10 +1177,10 @@ void set_fahrenheit_threshold(void)
           lcd.print(temperature.c_str());
         }
 
-        // Converts temperature to string and assign resultant to temperature_threshold
-        temperature_threshold = stof(temperature);
+        // Converts temperature to string and assign resultant to threshold
+        threshold = parse_hundredths(temperature);
 
-        if (temperature_threshold>122){
+        if (threshold>12200){
           lcd.clear(); // Clears the LCD panel
           lcd.print("Temp. ("); // Display text in LCD
           lcd.print(degree_sign); // Display text in LCD
@@ -742,4 +1190,9 @@ void set_fahrenheit_threshold(void)
           count = 0;
         }
     }
+
+    // Converts the thresholds to tenths of a degree celsius, rounded down so that the
+    // comparison with the sensor reading stays exact
+    config.temperature_threshold = temperature::from_fahrenheit_hundredths(threshold);
+    config.warning_threshold = temperature::from_fahrenheit_hundredths(threshold - WARNING_MARGIN * 100);
 }